@@ -3,41 +3,198 @@
 #include "address.h"
 
 #include <stdint.h>
+#include <string.h>
 
+#include "bus.h"
+#include "debug.h"
+#include "decode.h"
+#include "io.h"
 #include "w86.h"
 
-uint8_t w86_get_byte(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer) {
-  return state->memory[W86_REAL_ADDRESS(segment, pointer)];
+static inline void mark_dirty(uint32_t* bitmap, uint32_t address) {
+  uint32_t line = address >> W86_DIRTY_LINE_SIZE;
+  bitmap[line / 32] |= UINT32_C(1) << line % 32;
 }
 
-void w86_set_byte(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer, uint8_t value) {
-  state->memory[W86_REAL_ADDRESS(segment, pointer)] = value;
+static inline void mark_page(uint32_t* bitmap, uint32_t address) {
+  uint32_t page = address >> W86_SNAPSHOT_PAGE_SIZE;
+  bitmap[page / 32] |= UINT32_C(1) << page % 32;
 }
 
-uint16_t w86_get_word(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer) {
-  return state->memory[W86_REAL_ADDRESS(segment, pointer)]
-       | state->memory[W86_REAL_ADDRESS(segment, pointer + 1)] << 8;
+// the byte at address changed, address is already wrapped
+static inline void touch(struct w86_cpu_state* state, uint32_t address) {
+  mark_dirty(state->dirty.memory, address);
+  mark_page(state->snapshot_dirty.memory, address);
+  if (state->decode_cache.pages[W86_CODE_PAGE(address)]) w86_decode_invalidate_page(state, W86_CODE_PAGE(address));
 }
 
-void w86_set_word(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer, uint16_t value) {
-  state->memory[W86_REAL_ADDRESS(segment, pointer)] = value;
-  state->memory[W86_REAL_ADDRESS(segment, pointer + 1)] = value >> 8;
+// remembers what's about to be overwritten, for undoing it or telling what changed
+static inline void journal(struct w86_cpu_state* state, uint32_t entry) {
+  struct w86_journal* journal = state->journal;
+  journal->entries[journal->head++ & (journal->size - 1)] = entry;
+}
+
+// pages with watchpoints have their host memory moved out of the bus, so only their accesses get this far
+// fetches go straight to what's behind the watch
+static inline uint8_t load_byte(struct w86_cpu_state* state, uint32_t address, bool fetch) {
+  const struct w86_bus_page* page = &state->bus[W86_BUS_PAGE(address)];
+  if (!page->read && page->watch) {
+    page = fetch ? &state->debug->pages[W86_BUS_PAGE(address)] : w86_debug_access(state, address, W86_DEBUG_READ);
+  }
+  if (page->read) return page->read[W86_BUS_OFFSET(address)];
+  return page->device.read(page->device.context, W86_BOUND_ADDRESS(address));
+}
+
+static inline void store_byte(struct w86_cpu_state* state, uint32_t address, uint8_t value) {
+  const struct w86_bus_page* page = &state->bus[W86_BUS_PAGE(address)];
+  if (!page->write && page->watch) page = w86_debug_access(state, address, W86_DEBUG_WRITE);
+  if (page->write) {
+    if (state->journal) journal(state, W86_JOURNAL_ENTRY(W86_BOUND_ADDRESS(address), page->write[W86_BUS_OFFSET(address)]));
+    page->write[W86_BUS_OFFSET(address)] = value;
+    touch(state, W86_BOUND_ADDRESS(address));
+  } else if (page->device.write) {
+    page->device.write(page->device.context, W86_BOUND_ADDRESS(address), value);
+  }
+}
+
+// has to be called whenever a segment register changes
+void w86_segments_update(struct w86_cpu_state* state) {
+  state->bases = (struct w86_segment_bases) {
+    .cs = W86_SEGMENT_BASE(state->registers.cs),
+    .ds = W86_SEGMENT_BASE(state->registers.ds),
+    .es = W86_SEGMENT_BASE(state->registers.es),
+    .ss = W86_SEGMENT_BASE(state->registers.ss)
+  };
+}
+
+static inline uint16_t load_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, bool fetch) {
+  uint32_t address = W86_LINEAR_ADDRESS(base, pointer);
+  const struct w86_bus_page* page = &state->bus[W86_BUS_PAGE(address)];
+  if (pointer == 0xffff || W86_BUS_OFFSET(address + 1) == 0 || !page->read) {
+    return load_byte(state, address, fetch) | load_byte(state, W86_LINEAR_ADDRESS(base, pointer + 1), fetch) << 8;
+  }
+
+  uint16_t value;
+  memcpy(&value, &page->read[W86_BUS_OFFSET(address)], sizeof(value));
+  return value;
+}
+
+uint8_t w86_get_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer) {
+  return load_byte(state, W86_LINEAR_ADDRESS(base, pointer), false);
+}
+
+void w86_set_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint8_t value) {
+  store_byte(state, W86_LINEAR_ADDRESS(base, pointer), value);
+}
+
+// words are little endian on both sides, so they're a single unaligned access
+// unless they wrap around the segment, straddle two pages or hit a device
+uint16_t w86_get_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer) {
+  return load_word(state, base, pointer, false);
+}
+
+void w86_set_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint16_t value) {
+  uint32_t address = W86_LINEAR_ADDRESS(base, pointer);
+  const struct w86_bus_page* page = &state->bus[W86_BUS_PAGE(address)];
+  if (pointer == 0xffff || W86_BUS_OFFSET(address + 1) == 0 || !page->write) {
+    store_byte(state, address, value);
+    store_byte(state, W86_LINEAR_ADDRESS(base, pointer + 1), value >> 8);
+    return;
+  }
+
+  if (state->journal) {
+    journal(state, W86_JOURNAL_ENTRY(W86_BOUND_ADDRESS(address), page->write[W86_BUS_OFFSET(address)]));
+    journal(state, W86_JOURNAL_ENTRY(W86_BOUND_ADDRESS(address + 1), page->write[W86_BUS_OFFSET(address + 1)]));
+  }
+  memcpy(&page->write[W86_BUS_OFFSET(address)], &value, sizeof(value));
+  touch(state, W86_BOUND_ADDRESS(address));
+  touch(state, W86_BOUND_ADDRESS(address + 1));
+}
+
+// reads that aren't the program's own and so don't set off read watchpoints, like instruction fetches
+uint8_t w86_fetch_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer) {
+  return load_byte(state, W86_LINEAR_ADDRESS(base, pointer), true);
+}
+
+uint16_t w86_fetch_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer) {
+  return load_word(state, base, pointer, true);
+}
+
+static inline uint8_t* span(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size, bool write) {
+  uint32_t address = W86_LINEAR_ADDRESS(base, pointer);
+  if (!size || pointer + size > 1 << W86_REAL_POINTER_SIZE || address + size > W86_MEMORY_SIZE) return nullptr;
+
+  uint32_t first = W86_BUS_PAGE(address);
+  uint8_t* host = write ? state->bus[first].write : state->bus[first].read;
+  if (!host) return nullptr;
+  for (uint32_t i = first + 1; i <= W86_BUS_PAGE(address + size - 1); i++) {
+    if ((write ? state->bus[i].write : state->bus[i].read) != host + ((i - first) << W86_BUS_PAGE_SIZE)) return nullptr;
+  }
+
+  return host + W86_BUS_OFFSET(address);
+}
+
+// host memory behind size bytes from base:pointer, for string instructions that want to work on a whole range at once
+// nullptr if the range wraps around the segment or the address space or isn't one contiguous run of plain memory
+const uint8_t* w86_span_read(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size) {
+  return span(state, base, pointer, size, false);
+}
+
+// has to be followed by w86_span_written once the range has been written
+// with a journal attached the whole range gets journaled up front, so the caller has to write all of it
+uint8_t* w86_span_write(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size) {
+  uint8_t* host = span(state, base, pointer, size, true);
+  if (host && state->journal) {
+    uint32_t address = W86_LINEAR_ADDRESS(base, pointer);
+    for (uint32_t i = 0; i < size; i++) journal(state, W86_JOURNAL_ENTRY(address + i, host[i]));
+  }
+
+  return host;
+}
+
+void w86_span_written(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size) {
+  uint32_t address = W86_LINEAR_ADDRESS(base, pointer);
+  for (uint32_t line = address >> W86_DIRTY_LINE_SIZE; line <= (address + size - 1) >> W86_DIRTY_LINE_SIZE; line++) {
+    mark_dirty(state->dirty.memory, line << W86_DIRTY_LINE_SIZE);
+  }
+  for (uint32_t page = address >> W86_SNAPSHOT_PAGE_SIZE; page <= (address + size - 1) >> W86_SNAPSHOT_PAGE_SIZE; page++) {
+    mark_page(state->snapshot_dirty.memory, page << W86_SNAPSHOT_PAGE_SIZE);
+  }
+  for (uint32_t page = W86_CODE_PAGE(address); page <= W86_CODE_PAGE(address + size - 1); page++) {
+    if (state->decode_cache.pages[page]) w86_decode_invalidate_page(state, page);
+  }
+}
+
+// ports nobody mapped a device on read and write the io arrays
+static inline uint8_t in_byte(struct w86_cpu_state* state, uint16_t port) {
+  uint8_t device = state->io_devices.ports[port];
+  if (device) return w86_io_device_read(state, device - 1, port);
+  return state->io.reads[port];
+}
+
+static inline void out_byte(struct w86_cpu_state* state, uint16_t port, uint8_t value) {
+  uint8_t device = state->io_devices.ports[port];
+  if (device && w86_io_device_write(state, device - 1, port, value)) return;
+  if (state->journal) journal(state, W86_JOURNAL_ENTRY(port | W86_JOURNAL_IO, state->io.writes[port]));
+  state->io.writes[port] = value;
+  mark_dirty(state->dirty.io, port);
+  mark_page(&state->snapshot_dirty.io, port);
 }
 
 uint8_t w86_in_byte(struct w86_cpu_state* state, uint16_t port) {
-  return state->io.reads[W86_BOUND_IO_PORT(port)];
+  return in_byte(state, W86_BOUND_IO_PORT(port));
 }
 
 void w86_out_byte(struct w86_cpu_state* state, uint16_t port, uint8_t value) {
-  state->io.writes[W86_BOUND_IO_PORT(port)] = value;
+  out_byte(state, W86_BOUND_IO_PORT(port), value);
 }
 
 uint16_t w86_in_word(struct w86_cpu_state* state, uint16_t port) {
-  return state->io.reads[W86_BOUND_IO_PORT(port)]
-       | state->io.reads[W86_BOUND_IO_PORT(port + 1)] << 8;
+  return in_byte(state, W86_BOUND_IO_PORT(port))
+       | in_byte(state, W86_BOUND_IO_PORT(port + 1)) << 8;
 }
 
 void w86_out_word(struct w86_cpu_state* state, uint16_t port, uint16_t value) {
-  state->io.writes[W86_BOUND_IO_PORT(port)] = value;
-  state->io.writes[W86_BOUND_IO_PORT(port + 1)] = value >> 8;
+  out_byte(state, W86_BOUND_IO_PORT(port), value);
+  out_byte(state, W86_BOUND_IO_PORT(port + 1), value >> 8);
 }
@@ -16,14 +16,26 @@ extern "C" {
 #define W86_REAL_POINTER_SIZE 16
 #define W86_BOUND_ADDRESS(address) ((address) % (1 << W86_ADDRESS_SIZE))
 #define W86_REAL_ADDRESS(segment, pointer) W86_BOUND_ADDRESS(((segment) % (1 << W86_REAL_SEGMENT_SIZE) << 4) + (pointer) % (1 << W86_REAL_POINTER_SIZE))
+#define W86_SEGMENT_BASE(segment) ((uint32_t) (uint16_t) (segment) << 4)
+// unwrapped, only for indexing memory since the mirror takes care of the wraparound
+#define W86_LINEAR_ADDRESS(base, pointer) ((base) + (uint16_t) (pointer))
 
 #define W86_IO_PORT_SIZE 16
 #define W86_BOUND_IO_PORT(port) ((port) % (1 << W86_IO_PORT_SIZE))
 
-uint8_t w86_get_byte(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer);
-void w86_set_byte(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer, uint8_t value);
-uint16_t w86_get_word(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer);
-void w86_set_word(struct w86_cpu_state* state, uint16_t segment, uint16_t pointer, uint16_t value);
+void w86_segments_update(struct w86_cpu_state* state);
+
+// base is one of state->bases
+uint8_t w86_get_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer);
+void w86_set_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint8_t value);
+uint16_t w86_get_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer);
+void w86_set_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint16_t value);
+uint8_t w86_fetch_byte(struct w86_cpu_state* state, uint32_t base, uint16_t pointer);
+uint16_t w86_fetch_word(struct w86_cpu_state* state, uint32_t base, uint16_t pointer);
+
+const uint8_t* w86_span_read(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size);
+uint8_t* w86_span_write(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size);
+void w86_span_written(struct w86_cpu_state* state, uint32_t base, uint16_t pointer, uint32_t size);
 
 uint8_t w86_in_byte(struct w86_cpu_state* state, uint16_t port);
 void w86_out_byte(struct w86_cpu_state* state, uint16_t port, uint8_t value);
@@ -0,0 +1,226 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "block.h"
+
+#include <stdint.h>
+
+#include "address.h"
+#include "debug.h"
+#include "decode.h"
+#include "jit.h"
+#include "schedule.h"
+#include "w86.h"
+
+static inline bool ends_block(const struct w86_instruction_info* instruction) {
+  uint8_t opcode = instruction->opcode;
+  return (opcode & 0b11110000) == 0x70 // jcc
+      || opcode == 0x9a || opcode == 0xe8 // call
+      || opcode == 0xc2 || opcode == 0xc3 || opcode == 0xca || opcode == 0xcb // ret
+      || (opcode >= 0xcc && opcode <= 0xcf) // int and iret
+      || (opcode >= 0xe9 && opcode <= 0xeb) // jmp
+      || (opcode == 0xff && (instruction->modrm >> 3 & 0b111) >= 0b010 && (instruction->modrm >> 3 & 0b111) <= 0b101) // indirect call and jmp
+      || opcode == 0xf4; // hlt
+}
+
+// ret, int and jmp r/m16 can go anywhere, so their successors aren't worth linking
+static inline bool is_indirect(const struct w86_instruction_info* instruction) {
+  uint8_t opcode = instruction->opcode;
+  return opcode == 0xc2 || opcode == 0xc3 || (opcode >= 0xca && opcode <= 0xcf) || (opcode == 0xff && ends_block(instruction));
+}
+
+static inline bool is_valid(struct w86_cpu_state* state, const struct w86_block* block, uint32_t address) {
+  return block->length
+      && block->address == address
+      && block->epoch == state->block_cache.epoch
+      && block->generation == state->decode_cache.generations[W86_CODE_PAGE(address)]
+      && state->registers.ip + block->bytes <= 1 << W86_REAL_POINTER_SIZE; // the block must not wrap around the segment
+}
+
+// one instruction outside of any block, w86_cpu_step would count it a second time with a history running
+static inline enum w86_status step(struct w86_cpu_state* state) {
+  const struct w86_instruction_info* instruction;
+  enum w86_status status = w86_decode(state, state->registers.ip, &instruction);
+  if (status != W86_STATUS_SUCCESS) return status;
+
+  status = instruction->handler(state, instruction);
+  if (status == W86_STATUS_SUCCESS || status == W86_STATUS_HALT) state->cycles += instruction->cycles;
+  return status;
+}
+
+// a loop that can only ever end by one of the ports it reads changing
+static bool is_poll(const struct w86_instruction_info* instruction, uint8_t length, uint16_t bytes) {
+  const struct w86_instruction_info* last = &instruction[length - 1];
+  if ((last->opcode & 0b11110000) != 0x70 || (uint16_t) (last->imm + bytes)) return false; // jcc back to the start
+
+  bool in = false;
+  for (uint32_t i = 0; i < length - 1u; i++) {
+    uint8_t opcode = instruction[i].opcode;
+    bool registers = (instruction[i].modrm & 0b11000000) == 0b11000000;
+    if (opcode == 0xe4 || opcode == 0xe5 || opcode == 0xec || opcode == 0xed) {
+      in = true;
+    } else if (!(opcode == 0x3c || opcode == 0x3d // cmp acc, imm
+        || (opcode >= 0x38 && opcode <= 0x3b && registers) // cmp between registers
+        || (opcode >= 0x80 && opcode <= 0x83 && registers && (instruction[i].modrm >> 3 & 0b111) == 0b111))) { // cmp r, imm
+      return false;
+    }
+  }
+
+  return in;
+}
+
+// a device can answer differently every time, so only plain ports count
+static bool reads_plain_ports(const struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    uint8_t opcode = instruction[i].opcode;
+    if (opcode != 0xe4 && opcode != 0xe5 && opcode != 0xec && opcode != 0xed) continue;
+
+    uint16_t port = opcode & 0b00001000 ? state->registers.dx : instruction[i].imm & 0xff;
+    if (state->io_devices.ports[port] || (opcode & 0b00000001 && state->io_devices.ports[(uint16_t) (port + 1)])) return false;
+  }
+
+  return true;
+}
+
+// what the first count instructions of a block cost, for when it didn't get to the end
+static inline uint32_t partial_cycles(const struct w86_instruction_info* instruction, uint32_t count) {
+  uint32_t cycles = 0;
+  for (uint32_t i = 0; i < count; i++) cycles += instruction[i].cycles;
+  return cycles;
+}
+
+static struct w86_block* translate(struct w86_cpu_state* state, struct w86_block* block, uint32_t address) {
+  struct w86_block_cache* cache = &state->block_cache;
+  if (cache->used + W86_BLOCK_MAX_LENGTH > W86_BLOCK_POOL_SIZE) {
+    cache->epoch++;
+    cache->used = 0;
+  }
+
+  uint32_t page = W86_CODE_PAGE(address);
+  uint16_t offset = state->registers.ip;
+  uint8_t length = 0;
+  uint16_t cycles = 0;
+  while (length < W86_BLOCK_MAX_LENGTH) {
+    // a breakpoint has to start a block, that's the only place they're checked
+    if (length && state->debug && w86_debug_bit(state->debug->breakpoints, W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, offset)))) break;
+
+    const struct w86_instruction_info* instruction;
+    if (w86_decode(state, offset, &instruction) != W86_STATUS_SUCCESS) break;
+    if (instruction == &state->decode_cache.scratch) break; // uncacheable, so leave it to the interpreter
+
+    cache->pool[cache->used + length++] = *instruction;
+    cycles += instruction->cycles;
+    offset += instruction->size;
+    if (ends_block(instruction) || (uint32_t) W86_CODE_PAGE(W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, offset))) != page) break;
+  }
+  if (!length) return nullptr;
+
+  w86_jit_release(block);
+  *block = (struct w86_block) {
+    .next = { nullptr, nullptr },
+    .jit = nullptr,
+    .executions = 0,
+    .address = address,
+    .generation = state->decode_cache.generations[page],
+    .epoch = cache->epoch,
+    .start = cache->used,
+    .bytes = offset - state->registers.ip,
+    .cycles = cycles,
+    .length = length,
+    .breakpoint = state->debug && w86_debug_bit(state->debug->breakpoints, address),
+    .poll = is_poll(&cache->pool[cache->used], length, offset - state->registers.ip)
+  };
+  cache->used += length;
+
+  return block;
+}
+
+static struct w86_block* lookup(struct w86_cpu_state* state, uint32_t address) {
+  struct w86_block* block = &state->block_cache.blocks[address % W86_BLOCK_CACHE_SIZE];
+  if (is_valid(state, block, address)) return block;
+  return translate(state, block, address);
+}
+
+// the block at address, translating it if it isn't cached, nullptr if the first instruction can't be
+// cs:ip has to be there already, the block is decoded from it
+struct w86_block* w86_block_lookup(struct w86_cpu_state* state, uint32_t address) {
+  return lookup(state, address);
+}
+
+enum w86_status w86_block_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret) {
+  struct w86_block_cache* cache = &state->block_cache;
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint32_t instructions = 0;
+
+  struct w86_block* block = lookup(state, W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip)));
+  while (instructions < max_instructions) {
+    if (!block) {
+      if (state->debug && w86_debug_break(state)) {
+        status = W86_STATUS_BREAKPOINT;
+        break;
+      }
+      status = step(state);
+      if (status == W86_STATUS_SUCCESS) status = w86_debug_status(state);
+      if (status != W86_STATUS_SUCCESS) {
+        if (status == W86_STATUS_HALT || status == W86_STATUS_WATCHPOINT) instructions++;
+        break;
+      }
+      instructions++;
+      if (w86_schedule_due(state)) break;
+      block = lookup(state, W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip)));
+      continue;
+    }
+
+    if (block->breakpoint && w86_debug_break(state)) {
+      status = W86_STATUS_BREAKPOINT;
+      break;
+    }
+
+    const struct w86_instruction_info* instruction = &cache->pool[block->start];
+    uint32_t page = W86_CODE_PAGE(block->address);
+    uint32_t length = block->length;
+    if (length > max_instructions - instructions) length = max_instructions - instructions;
+
+    // only whole blocks go through compiled code, a partial one near the end of the budget is interpreted
+    if (length == block->length && !block->jit && block->executions++ == W86_JIT_THRESHOLD) w86_jit_compile(state, block);
+    uint32_t i = 0;
+    if (block->jit && length == block->length) i = block->jit(state);
+    while (i < length && block->generation == state->decode_cache.generations[page]) { // the block may have overwritten itself
+      status = instruction[i].handler(state, &instruction[i]);
+      if (status != W86_STATUS_SUCCESS) break;
+      i++;
+    }
+    instructions += i;
+    state->cycles += i == block->length ? block->cycles : partial_cycles(instruction, status == W86_STATUS_HALT ? i + 1 : i);
+    if (status == W86_STATUS_SUCCESS) status = w86_debug_status(state);
+    if (status != W86_STATUS_SUCCESS) {
+      if (status == W86_STATUS_HALT) instructions++;
+      break;
+    }
+    if (w86_schedule_due(state)) break;
+    if (i < block->length) {
+      block = lookup(state, W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip)));
+      continue;
+    }
+
+    // follow the direct links, only going back to the cache lookup if they miss
+    uint32_t address = W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip));
+    if (block->poll && address == block->address && reads_plain_ports(state, instruction, block->length)) {
+      status = W86_STATUS_POLL; // went around once and nothing it looks at can change before the host does something
+      break;
+    }
+    if (is_indirect(&instruction[block->length - 1])) {
+      block = lookup(state, address);
+    } else {
+      uint32_t link = address != block->address + block->bytes;
+      struct w86_block* next = block->next[link];
+      if (!next || !is_valid(state, next, address)) {
+        next = lookup(state, address);
+        if (block->epoch == cache->epoch) block->next[link] = next;
+      }
+      block = next;
+    }
+  }
+
+  *ret = instructions;
+  return status;
+}
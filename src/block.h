@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_BLOCK_H_
+#define W86_BLOCK_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+enum w86_status w86_block_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret);
+struct w86_block* w86_block_lookup(struct w86_cpu_state* state, uint32_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_BLOCK_H_ */
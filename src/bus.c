@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "bus.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "address.h"
+#include "debug.h"
+#include "decode.h"
+#include "history.h"
+#include "snapshot.h"
+#include "w86.h"
+
+#define MIRROR_PAGES (W86_BUS_PAGE_COUNT - W86_BUS_PAGE(W86_MEMORY_SIZE))
+
+// the entry for one page and its mirror above 1 MiB if it has one
+static void set_page(struct w86_cpu_state* state, uint32_t index, struct w86_bus_page page) {
+  state->bus[index] = page;
+  if (state->debug) w86_debug_watch_page(state, index);
+  if (index < MIRROR_PAGES) {
+    state->bus[index + W86_BUS_PAGE(W86_MEMORY_SIZE)] = page;
+    if (state->debug) w86_debug_watch_page(state, index + W86_BUS_PAGE(W86_MEMORY_SIZE));
+  }
+}
+
+static bool map(struct w86_cpu_state* state, uint32_t address, uint32_t size, struct w86_bus_page page) {
+  if (W86_BUS_OFFSET(address) || W86_BUS_OFFSET(size) || address > W86_MEMORY_SIZE || size > W86_MEMORY_SIZE - address) return false;
+
+  for (uint32_t i = W86_BUS_PAGE(address); i < W86_BUS_PAGE(address + size); i++) {
+    set_page(state, i, page);
+    if (page.read) page.read += 1 << W86_BUS_PAGE_SIZE;
+    if (page.write) page.write += 1 << W86_BUS_PAGE_SIZE;
+  }
+
+  w86_decode_invalidate(state); // cached code may come from somewhere else now
+  w86_snapshot_invalidate(state);
+  w86_history_reset(state);
+  return true;
+}
+
+// all of state->memory as ram, has to be called once memory is set
+void w86_bus_reset(struct w86_cpu_state* state) {
+  w86_bus_map_ram(state, 0, W86_MEMORY_SIZE, state->memory);
+}
+
+bool w86_bus_map_ram(struct w86_cpu_state* state, uint32_t address, uint32_t size, uint8_t* host) {
+  return map(state, address, size, (struct w86_bus_page) { .read = host, .write = host });
+}
+
+// writes are dropped
+bool w86_bus_map_rom(struct w86_cpu_state* state, uint32_t address, uint32_t size, const uint8_t* host) {
+  return map(state, address, size, (struct w86_bus_page) { .read = (uint8_t*) host });
+}
+
+// the first write to a shared page copies it over to the same place in state->memory and maps that instead
+// the copy reads just like the image did, so snapshots and the history stay good and only code cached from the page goes
+static void copy_on_write(void* context, uint32_t address, uint8_t value) {
+  struct w86_cpu_state* state = context;
+  uint32_t first = address & ~((1 << W86_BUS_PAGE_SIZE) - 1);
+  memcpy(&state->memory[first], w86_debug_page(state, W86_BUS_PAGE(address))->read, 1 << W86_BUS_PAGE_SIZE);
+  set_page(state, W86_BUS_PAGE(address), (struct w86_bus_page) { .read = &state->memory[first], .write = &state->memory[first] });
+  w86_decode_invalidate_page(state, W86_CODE_PAGE(first));
+  w86_set_byte(state, address & ~0xffff, address & 0xffff, value);
+}
+
+// reads come straight from host, so any number of instances can run off one image, pages only get copied once written
+bool w86_bus_map_shared(struct w86_cpu_state* state, uint32_t address, uint32_t size, const uint8_t* host) {
+  return map(state, address, size, (struct w86_bus_page) { .read = (uint8_t*) host, .device = { .read = nullptr, .write = copy_on_write, .context = state } });
+}
+
+bool w86_bus_map_mmio(struct w86_cpu_state* state, uint32_t address, uint32_t size, struct w86_bus_device device) {
+  if (!device.read) return false;
+  return map(state, address, size, (struct w86_bus_page) { .device = device });
+}
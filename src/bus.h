@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_BUS_H_
+#define W86_BUS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_BUS_PAGE(address) ((address) >> W86_BUS_PAGE_SIZE)
+#define W86_BUS_OFFSET(address) ((address) & ((1 << W86_BUS_PAGE_SIZE) - 1))
+
+// addresses and sizes have to be page aligned, host memory has to cover the whole region
+void w86_bus_reset(struct w86_cpu_state* state);
+bool w86_bus_map_ram(struct w86_cpu_state* state, uint32_t address, uint32_t size, uint8_t* host);
+bool w86_bus_map_rom(struct w86_cpu_state* state, uint32_t address, uint32_t size, const uint8_t* host);
+bool w86_bus_map_shared(struct w86_cpu_state* state, uint32_t address, uint32_t size, const uint8_t* host);
+bool w86_bus_map_mmio(struct w86_cpu_state* state, uint32_t address, uint32_t size, struct w86_bus_device device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_BUS_H_ */
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "debug.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "address.h"
+#include "bus.h"
+#include "decode.h"
+#include "w86.h"
+
+#define PAGE_WORDS ((1 << W86_BUS_PAGE_SIZE) / 32)
+
+static inline uint32_t here(const struct w86_cpu_state* state) {
+  return W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip));
+}
+
+void w86_debug_start(struct w86_cpu_state* state, struct w86_debug* debug) {
+  memset(debug, 0, sizeof(*debug));
+  state->debug = debug;
+}
+
+void w86_debug_stop(struct w86_cpu_state* state) {
+  struct w86_debug* debug = state->debug;
+  for (uint32_t page = 0; page < W86_BUS_PAGE_COUNT; page++) {
+    if (state->bus[page].watch) state->bus[page] = debug->pages[page];
+  }
+  state->debug = nullptr;
+  w86_decode_invalidate(state); // the blocks split around breakpoints can go back together
+}
+
+// after the bitmaps were changed from the outside, blocks get split again and watched pages taken out of the bus
+void w86_debug_refresh(struct w86_cpu_state* state) {
+  for (uint32_t page = 0; page < W86_BUS_PAGE_COUNT; page++) w86_debug_watch_page(state, page);
+  w86_decode_invalidate(state);
+}
+
+void w86_debug_set_breakpoint(struct w86_cpu_state* state, uint32_t address, bool set) {
+  uint32_t* word = &state->debug->breakpoints[address / 32];
+  *word = set ? *word | UINT32_C(1) << address % 32 : *word & ~(UINT32_C(1) << address % 32);
+  w86_decode_invalidate_page(state, W86_CODE_PAGE(address));
+}
+
+void w86_debug_set_watchpoint(struct w86_cpu_state* state, uint32_t address, uint32_t size, uint8_t access, bool set) {
+  struct w86_debug* debug = state->debug;
+  for (uint32_t i = address; i < address + size && i < W86_MEMORY_SIZE; i++) {
+    uint32_t bit = UINT32_C(1) << i % 32;
+    if (access & W86_DEBUG_READ) debug->reads[i / 32] = set ? debug->reads[i / 32] | bit : debug->reads[i / 32] & ~bit;
+    if (access & W86_DEBUG_WRITE) debug->writes[i / 32] = set ? debug->writes[i / 32] | bit : debug->writes[i / 32] & ~bit;
+  }
+  if (!size) return;
+
+  for (uint32_t page = W86_BUS_PAGE(address); page <= W86_BUS_PAGE(address + size - 1) && page < W86_BUS_PAGE(W86_MEMORY_SIZE); page++) {
+    w86_debug_watch_page(state, page);
+    if (page + W86_BUS_PAGE(W86_MEMORY_SIZE) < W86_BUS_PAGE_COUNT) w86_debug_watch_page(state, page + W86_BUS_PAGE(W86_MEMORY_SIZE));
+  }
+}
+
+// whether to stop before the instruction at cs:ip, the one it stopped on gets to run next time
+bool w86_debug_break(struct w86_cpu_state* state) {
+  struct w86_debug* debug = state->debug;
+  if (!debug || debug->resume || debug->muted || !w86_debug_bit(debug->breakpoints, here(state))) return false;
+
+  debug->hit = (struct w86_debug_hit) { .address = here(state), .access = 0 };
+  debug->resume = true;
+  return true;
+}
+
+// puts back what's really mapped, then moves it out again if the page still has watchpoints
+// has to be called whenever the bus page gets mapped again
+void w86_debug_watch_page(struct w86_cpu_state* state, uint32_t page) {
+  struct w86_debug* debug = state->debug;
+  struct w86_bus_page* bus = &state->bus[page];
+  if (bus->watch) *bus = debug->pages[page];
+
+  uint8_t watch = 0;
+  uint32_t first = W86_BOUND_ADDRESS(page << W86_BUS_PAGE_SIZE) / 32;
+  for (uint32_t i = first; i < first + PAGE_WORDS; i++) {
+    if (debug->reads[i]) watch |= W86_DEBUG_READ;
+    if (debug->writes[i]) watch |= W86_DEBUG_WRITE;
+  }
+  if (!watch) return;
+
+  debug->pages[page] = *bus;
+  if (watch & W86_DEBUG_READ) bus->read = nullptr;
+  if (watch & W86_DEBUG_WRITE) bus->write = nullptr;
+  bus->watch = watch;
+}
+
+// an access to a watched page, returns where it really goes
+// the first hit of an instruction gets reported once it's done, invalidating the code it's running is what
+// gets a block to stop right after it, and the ones that end a block get caught by the block runner anyway
+const struct w86_bus_page* w86_debug_access(struct w86_cpu_state* state, uint32_t address, uint8_t access) {
+  struct w86_debug* debug = state->debug;
+  uint32_t bound = W86_BOUND_ADDRESS(address);
+  if (!debug->pending && !debug->muted && w86_debug_bit(access == W86_DEBUG_READ ? debug->reads : debug->writes, bound)) {
+    debug->hit = (struct w86_debug_hit) { .address = bound, .access = access };
+    debug->pending = true;
+    w86_decode_invalidate_page(state, W86_CODE_PAGE(here(state)));
+  }
+
+  return &debug->pages[W86_BUS_PAGE(address)];
+}
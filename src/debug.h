@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_DEBUG_H_
+#define W86_DEBUG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_DEBUG_WORDS (W86_MEMORY_SIZE / 32)
+
+// what a watchpoint hit was
+#define W86_DEBUG_READ 0b01
+#define W86_DEBUG_WRITE 0b10
+
+struct w86_debug_hit {
+  uint32_t address; // linear address of the breakpoint or of the byte accessed
+  uint8_t access; // 0 for a breakpoint
+};
+
+// one bit per linear address for each kind, the ui can set them straight in the heap and call w86_debug_refresh after
+// breakpoints split blocks so they're only ever checked on entering one, watched pages lose their host memory
+// in the bus so only their accesses leave the fast path, instruction fetches don't count as reads
+struct w86_debug {
+  uint32_t breakpoints[W86_DEBUG_WORDS];
+  uint32_t reads[W86_DEBUG_WORDS];
+  uint32_t writes[W86_DEBUG_WORDS];
+  struct w86_bus_page pages[W86_BUS_PAGE_COUNT]; // what's really mapped behind the watched ones
+  struct w86_debug_hit hit; // the last one reported
+  bool pending; // a watchpoint went off during the current instruction
+  bool resume; // the next instruction runs even if there's a breakpoint on it
+  bool muted; // for replays, which have to go exactly like the first time
+};
+
+void w86_debug_start(struct w86_cpu_state* state, struct w86_debug* debug);
+void w86_debug_stop(struct w86_cpu_state* state);
+void w86_debug_refresh(struct w86_cpu_state* state);
+void w86_debug_set_breakpoint(struct w86_cpu_state* state, uint32_t address, bool set);
+void w86_debug_set_watchpoint(struct w86_cpu_state* state, uint32_t address, uint32_t size, uint8_t access, bool set);
+
+// for the run loops
+bool w86_debug_break(struct w86_cpu_state* state);
+
+// for the bus and address.c
+void w86_debug_watch_page(struct w86_cpu_state* state, uint32_t page);
+const struct w86_bus_page* w86_debug_access(struct w86_cpu_state* state, uint32_t address, uint8_t access);
+
+static inline bool w86_debug_bit(const uint32_t* bitmap, uint32_t address) {
+  return bitmap[address / 32] >> address % 32 & 1;
+}
+
+// what's left of a successful instruction once any watchpoint it set off is taken into account
+static inline enum w86_status w86_debug_status(struct w86_cpu_state* state) {
+  struct w86_debug* debug = state->debug;
+  if (!debug || !debug->pending) return W86_STATUS_SUCCESS;
+
+  debug->pending = false;
+  return W86_STATUS_WATCHPOINT;
+}
+
+// the bus page as it's really mapped, whether or not watchpoints took it apart
+static inline const struct w86_bus_page* w86_debug_page(const struct w86_cpu_state* state, uint32_t page) {
+  return state->bus[page].watch ? &state->debug->pages[page] : &state->bus[page];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_DEBUG_H_ */
@@ -6,338 +6,445 @@
 
 #include "address.h"
 #include "instruction.h"
+#include "modrm.h"
 #include "w86.h"
 
-// welcome to switch statement purgatory...
-
-enum w86_status w86_decode(struct w86_cpu_state* state) {
-  uint16_t offset = state->registers.ip;
-  struct w86_instruction_prefixes prefixes = {
-    .segment = W86_SEGMENT_PREFIX_NONE,
-    .repeat = W86_REPEAT_PREFIX_NONE,
-    .lock = false
+enum immediate {
+  IMMEDIATE_NONE,
+  IMMEDIATE_BYTE,
+  IMMEDIATE_SIGNED_BYTE,
+  IMMEDIATE_WORD,
+  IMMEDIATE_POINTER
+};
+
+struct opcode {
+  w86_instruction* handler;
+  const struct opcode* group; // indexed by the reg field of the modrm byte
+  bool modrm;
+  enum immediate immediate;
+  bool unimplemented; // anything without a handler that isn't this is undefined
+  uint8_t cycles; // with register operands or none at all
+  uint8_t memory_cycles; // with a memory operand, the effective address comes on top
+};
+
+#define UNIMPLEMENTED { .unimplemented = true }
+
+// prefixes go on until the segment wraps, leaving room for the longest instruction, opcode, modrm, displacement and immediate
+#define MAX_PREFIXES (UINT16_MAX - 6)
+
+// the immediate instruction groups and instruction group 2
+static const struct opcode group_0x80[8] = {
+  [0b000] = { .handler = w86_instruction_add_0x80, .cycles = 4, .memory_cycles = 17 },
+  [0b001] = UNIMPLEMENTED,
+  [0b010] = UNIMPLEMENTED,
+  [0b011] = UNIMPLEMENTED,
+  [0b100] = UNIMPLEMENTED,
+  [0b101] = { .handler = w86_instruction_sub_0x80, .cycles = 4, .memory_cycles = 17 },
+  [0b110] = UNIMPLEMENTED,
+  [0b111] = { .handler = w86_instruction_cmp_0x80, .cycles = 4, .memory_cycles = 10 },
+};
+
+static const struct opcode group_0x81[8] = {
+  [0b000] = { .handler = w86_instruction_add_0x81, .cycles = 4, .memory_cycles = 17 },
+  [0b001] = UNIMPLEMENTED,
+  [0b010] = UNIMPLEMENTED,
+  [0b011] = UNIMPLEMENTED,
+  [0b100] = UNIMPLEMENTED,
+  [0b101] = { .handler = w86_instruction_sub_0x81, .cycles = 4, .memory_cycles = 17 },
+  [0b110] = UNIMPLEMENTED,
+  [0b111] = { .handler = w86_instruction_cmp_0x81, .cycles = 4, .memory_cycles = 10 },
+};
+
+static const struct opcode group_0x82[8] = {
+  [0b000] = { .handler = w86_instruction_add_0x82, .cycles = 4, .memory_cycles = 17 },
+  [0b001] = UNIMPLEMENTED,
+  [0b010] = UNIMPLEMENTED,
+  [0b011] = UNIMPLEMENTED,
+  [0b100] = UNIMPLEMENTED,
+  [0b101] = { .handler = w86_instruction_sub_0x82, .cycles = 4, .memory_cycles = 17 },
+  [0b110] = UNIMPLEMENTED,
+  [0b111] = { .handler = w86_instruction_cmp_0x82, .cycles = 4, .memory_cycles = 10 },
+};
+
+static const struct opcode group_0x83[8] = {
+  [0b000] = { .handler = w86_instruction_add_0x83, .cycles = 4, .memory_cycles = 17 },
+  [0b001] = UNIMPLEMENTED,
+  [0b010] = UNIMPLEMENTED,
+  [0b011] = UNIMPLEMENTED,
+  [0b100] = UNIMPLEMENTED,
+  [0b101] = { .handler = w86_instruction_sub_0x83, .cycles = 4, .memory_cycles = 17 },
+  [0b110] = UNIMPLEMENTED,
+  [0b111] = { .handler = w86_instruction_cmp_0x83, .cycles = 4, .memory_cycles = 10 },
+};
+
+static const struct opcode group_0xfe[8] = {
+  [0b000] = { .handler = w86_instruction_inc_0xfe, .cycles = 3, .memory_cycles = 15 },
+  [0b001] = { .handler = w86_instruction_dec_0xfe, .cycles = 3, .memory_cycles = 15 },
+};
+
+static const struct opcode group_0xff[8] = {
+  [0b000] = { .handler = w86_instruction_inc_0xff, .cycles = 3, .memory_cycles = 15 },
+  [0b001] = { .handler = w86_instruction_dec_0xff, .cycles = 3, .memory_cycles = 15 },
+  [0b010] = UNIMPLEMENTED,
+  [0b011] = UNIMPLEMENTED,
+  [0b100] = { .handler = w86_instruction_jmp_0xff, .cycles = 11, .memory_cycles = 18 },
+  [0b101] = { .handler = w86_instruction_jmp_0xff, .memory_cycles = 24 },
+  [0b110] = UNIMPLEMENTED,
+};
+
+// one entry per first byte, so decoding is a table lookup instead of a switch
+static const struct opcode opcodes[256] = {
+  [0x00] = { .handler = w86_instruction_add_0x00, .modrm = true, .cycles = 3, .memory_cycles = 16 },
+  [0x01] = { .handler = w86_instruction_add_0x01, .modrm = true, .cycles = 3, .memory_cycles = 16 },
+  [0x02] = { .handler = w86_instruction_add_0x02, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x03] = { .handler = w86_instruction_add_0x03, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x04] = { .handler = w86_instruction_add_0x04, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0x05] = { .handler = w86_instruction_add_0x05, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0x06] = UNIMPLEMENTED,
+  [0x07] = UNIMPLEMENTED,
+  [0x08] = UNIMPLEMENTED,
+  [0x09] = UNIMPLEMENTED,
+  [0x0a] = UNIMPLEMENTED,
+  [0x0b] = UNIMPLEMENTED,
+  [0x0c] = UNIMPLEMENTED,
+  [0x0d] = UNIMPLEMENTED,
+  [0x0e] = UNIMPLEMENTED,
+  [0x10] = UNIMPLEMENTED,
+  [0x11] = UNIMPLEMENTED,
+  [0x12] = UNIMPLEMENTED,
+  [0x13] = UNIMPLEMENTED,
+  [0x14] = UNIMPLEMENTED,
+  [0x15] = UNIMPLEMENTED,
+  [0x16] = UNIMPLEMENTED,
+  [0x17] = UNIMPLEMENTED,
+  [0x18] = UNIMPLEMENTED,
+  [0x19] = UNIMPLEMENTED,
+  [0x1a] = UNIMPLEMENTED,
+  [0x1b] = UNIMPLEMENTED,
+  [0x1c] = UNIMPLEMENTED,
+  [0x1d] = UNIMPLEMENTED,
+  [0x1e] = UNIMPLEMENTED,
+  [0x1f] = UNIMPLEMENTED,
+  [0x20] = UNIMPLEMENTED,
+  [0x21] = UNIMPLEMENTED,
+  [0x22] = UNIMPLEMENTED,
+  [0x23] = UNIMPLEMENTED,
+  [0x24] = UNIMPLEMENTED,
+  [0x25] = UNIMPLEMENTED,
+  [0x26] = UNIMPLEMENTED,
+  [0x27] = UNIMPLEMENTED,
+  [0x28] = { .handler = w86_instruction_sub_0x28, .modrm = true, .cycles = 3, .memory_cycles = 16 },
+  [0x29] = { .handler = w86_instruction_sub_0x29, .modrm = true, .cycles = 3, .memory_cycles = 16 },
+  [0x2a] = { .handler = w86_instruction_sub_0x2a, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x2b] = { .handler = w86_instruction_sub_0x2b, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x2c] = { .handler = w86_instruction_sub_0x2c, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0x2d] = { .handler = w86_instruction_sub_0x2d, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0x2e] = UNIMPLEMENTED,
+  [0x2f] = UNIMPLEMENTED,
+  [0x30] = UNIMPLEMENTED,
+  [0x31] = UNIMPLEMENTED,
+  [0x32] = UNIMPLEMENTED,
+  [0x33] = UNIMPLEMENTED,
+  [0x34] = UNIMPLEMENTED,
+  [0x35] = UNIMPLEMENTED,
+  [0x36] = UNIMPLEMENTED,
+  [0x37] = UNIMPLEMENTED,
+  [0x38] = { .handler = w86_instruction_cmp_0x38, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x39] = { .handler = w86_instruction_cmp_0x39, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x3a] = { .handler = w86_instruction_cmp_0x3a, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x3b] = { .handler = w86_instruction_cmp_0x3b, .modrm = true, .cycles = 3, .memory_cycles = 9 },
+  [0x3c] = { .handler = w86_instruction_cmp_0x3c, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0x3d] = { .handler = w86_instruction_cmp_0x3d, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0x3e] = UNIMPLEMENTED,
+  [0x3f] = UNIMPLEMENTED,
+  [0x40] = { .handler = w86_instruction_inc_0x40, .cycles = 2 },
+  [0x41] = { .handler = w86_instruction_inc_0x41, .cycles = 2 },
+  [0x42] = { .handler = w86_instruction_inc_0x42, .cycles = 2 },
+  [0x43] = { .handler = w86_instruction_inc_0x43, .cycles = 2 },
+  [0x44] = { .handler = w86_instruction_inc_0x44, .cycles = 2 },
+  [0x45] = { .handler = w86_instruction_inc_0x45, .cycles = 2 },
+  [0x46] = { .handler = w86_instruction_inc_0x46, .cycles = 2 },
+  [0x47] = { .handler = w86_instruction_inc_0x47, .cycles = 2 },
+  [0x48] = { .handler = w86_instruction_dec_0x48, .cycles = 2 },
+  [0x49] = { .handler = w86_instruction_dec_0x49, .cycles = 2 },
+  [0x4a] = { .handler = w86_instruction_dec_0x4a, .cycles = 2 },
+  [0x4b] = { .handler = w86_instruction_dec_0x4b, .cycles = 2 },
+  [0x4c] = { .handler = w86_instruction_dec_0x4c, .cycles = 2 },
+  [0x4d] = { .handler = w86_instruction_dec_0x4d, .cycles = 2 },
+  [0x4e] = { .handler = w86_instruction_dec_0x4e, .cycles = 2 },
+  [0x4f] = { .handler = w86_instruction_dec_0x4f, .cycles = 2 },
+  [0x50] = UNIMPLEMENTED,
+  [0x51] = UNIMPLEMENTED,
+  [0x52] = UNIMPLEMENTED,
+  [0x53] = UNIMPLEMENTED,
+  [0x54] = UNIMPLEMENTED,
+  [0x55] = UNIMPLEMENTED,
+  [0x56] = UNIMPLEMENTED,
+  [0x57] = UNIMPLEMENTED,
+  [0x58] = UNIMPLEMENTED,
+  [0x59] = UNIMPLEMENTED,
+  [0x5a] = UNIMPLEMENTED,
+  [0x5b] = UNIMPLEMENTED,
+  [0x5c] = UNIMPLEMENTED,
+  [0x5d] = UNIMPLEMENTED,
+  [0x5e] = UNIMPLEMENTED,
+  [0x5f] = UNIMPLEMENTED,
+  [0x70] = { .handler = w86_instruction_jcc_0x70, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x71] = { .handler = w86_instruction_jcc_0x71, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x72] = { .handler = w86_instruction_jcc_0x72, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x73] = { .handler = w86_instruction_jcc_0x73, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x74] = { .handler = w86_instruction_jcc_0x74, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x75] = { .handler = w86_instruction_jcc_0x75, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x76] = { .handler = w86_instruction_jcc_0x76, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x77] = { .handler = w86_instruction_jcc_0x77, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x78] = { .handler = w86_instruction_jcc_0x78, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x79] = { .handler = w86_instruction_jcc_0x79, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7a] = { .handler = w86_instruction_jcc_0x7a, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7b] = { .handler = w86_instruction_jcc_0x7b, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7c] = { .handler = w86_instruction_jcc_0x7c, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7d] = { .handler = w86_instruction_jcc_0x7d, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7e] = { .handler = w86_instruction_jcc_0x7e, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x7f] = { .handler = w86_instruction_jcc_0x7f, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 4 },
+  [0x80] = { .group = group_0x80, .modrm = true, .immediate = IMMEDIATE_BYTE },
+  [0x81] = { .group = group_0x81, .modrm = true, .immediate = IMMEDIATE_WORD },
+  [0x82] = { .group = group_0x82, .modrm = true, .immediate = IMMEDIATE_BYTE },
+  [0x83] = { .group = group_0x83, .modrm = true, .immediate = IMMEDIATE_SIGNED_BYTE },
+  [0x84] = UNIMPLEMENTED,
+  [0x85] = UNIMPLEMENTED,
+  [0x86] = { .handler = w86_instruction_xchg_0x86, .modrm = true, .cycles = 4, .memory_cycles = 17 },
+  [0x87] = { .handler = w86_instruction_xchg_0x87, .modrm = true, .cycles = 4, .memory_cycles = 17 },
+  [0x88] = { .handler = w86_instruction_mov_0x88, .modrm = true, .cycles = 2, .memory_cycles = 9 },
+  [0x89] = { .handler = w86_instruction_mov_0x89, .modrm = true, .cycles = 2, .memory_cycles = 9 },
+  [0x8a] = { .handler = w86_instruction_mov_0x8a, .modrm = true, .cycles = 2, .memory_cycles = 8 },
+  [0x8b] = { .handler = w86_instruction_mov_0x8b, .modrm = true, .cycles = 2, .memory_cycles = 8 },
+  [0x8c] = { .handler = w86_instruction_mov_0x8c, .modrm = true, .cycles = 2, .memory_cycles = 9 },
+  [0x8d] = UNIMPLEMENTED,
+  [0x8e] = { .handler = w86_instruction_mov_0x8e, .modrm = true, .cycles = 2, .memory_cycles = 8 },
+  [0x8f] = UNIMPLEMENTED,
+  [0x90] = { .handler = w86_instruction_xchg_0x90, .cycles = 3 },
+  [0x91] = { .handler = w86_instruction_xchg_0x91, .cycles = 3 },
+  [0x92] = { .handler = w86_instruction_xchg_0x92, .cycles = 3 },
+  [0x93] = { .handler = w86_instruction_xchg_0x93, .cycles = 3 },
+  [0x94] = { .handler = w86_instruction_xchg_0x94, .cycles = 3 },
+  [0x95] = { .handler = w86_instruction_xchg_0x95, .cycles = 3 },
+  [0x96] = { .handler = w86_instruction_xchg_0x96, .cycles = 3 },
+  [0x97] = { .handler = w86_instruction_xchg_0x97, .cycles = 3 },
+  [0x98] = UNIMPLEMENTED,
+  [0x99] = UNIMPLEMENTED,
+  [0x9a] = { .handler = w86_instruction_call_0x9a, .immediate = IMMEDIATE_POINTER, .cycles = 28 },
+  [0x9b] = UNIMPLEMENTED,
+  [0x9c] = UNIMPLEMENTED,
+  [0x9d] = UNIMPLEMENTED,
+  [0x9e] = UNIMPLEMENTED,
+  [0x9f] = UNIMPLEMENTED,
+  [0xa0] = { .handler = w86_instruction_mov_0xa0, .immediate = IMMEDIATE_WORD, .cycles = 10 },
+  [0xa1] = { .handler = w86_instruction_mov_0xa1, .immediate = IMMEDIATE_WORD, .cycles = 10 },
+  [0xa2] = { .handler = w86_instruction_mov_0xa2, .immediate = IMMEDIATE_WORD, .cycles = 10 },
+  [0xa3] = { .handler = w86_instruction_mov_0xa3, .immediate = IMMEDIATE_WORD, .cycles = 10 },
+  [0xa4] = { .handler = w86_instruction_movs_0xa4, .cycles = 18 },
+  [0xa5] = { .handler = w86_instruction_movs_0xa5, .cycles = 18 },
+  [0xa6] = { .handler = w86_instruction_cmps_0xa6, .cycles = 22 },
+  [0xa7] = { .handler = w86_instruction_cmps_0xa7, .cycles = 22 },
+  [0xa8] = UNIMPLEMENTED,
+  [0xa9] = UNIMPLEMENTED,
+  [0xaa] = { .handler = w86_instruction_stos_0xaa, .cycles = 11 },
+  [0xab] = { .handler = w86_instruction_stos_0xab, .cycles = 11 },
+  [0xac] = { .handler = w86_instruction_lods_0xac, .cycles = 12 },
+  [0xad] = { .handler = w86_instruction_lods_0xad, .cycles = 12 },
+  [0xae] = { .handler = w86_instruction_scas_0xae, .cycles = 15 },
+  [0xaf] = { .handler = w86_instruction_scas_0xaf, .cycles = 15 },
+  [0xb0] = { .handler = w86_instruction_mov_0xb0, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb1] = { .handler = w86_instruction_mov_0xb1, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb2] = { .handler = w86_instruction_mov_0xb2, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb3] = { .handler = w86_instruction_mov_0xb3, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb4] = { .handler = w86_instruction_mov_0xb4, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb5] = { .handler = w86_instruction_mov_0xb5, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb6] = { .handler = w86_instruction_mov_0xb6, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb7] = { .handler = w86_instruction_mov_0xb7, .immediate = IMMEDIATE_BYTE, .cycles = 4 },
+  [0xb8] = { .handler = w86_instruction_mov_0xb8, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xb9] = { .handler = w86_instruction_mov_0xb9, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xba] = { .handler = w86_instruction_mov_0xba, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xbb] = { .handler = w86_instruction_mov_0xbb, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xbc] = { .handler = w86_instruction_mov_0xbc, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xbd] = { .handler = w86_instruction_mov_0xbd, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xbe] = { .handler = w86_instruction_mov_0xbe, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xbf] = { .handler = w86_instruction_mov_0xbf, .immediate = IMMEDIATE_WORD, .cycles = 4 },
+  [0xc2] = { .handler = w86_instruction_ret_0xc2, .immediate = IMMEDIATE_WORD, .cycles = 12 },
+  [0xc3] = { .handler = w86_instruction_ret_0xc3, .cycles = 8 },
+  [0xc4] = UNIMPLEMENTED,
+  [0xc5] = UNIMPLEMENTED,
+  [0xc6] = { .handler = w86_instruction_mov_0xc6, .modrm = true, .immediate = IMMEDIATE_BYTE, .cycles = 4, .memory_cycles = 10 },
+  [0xc7] = { .handler = w86_instruction_mov_0xc7, .modrm = true, .immediate = IMMEDIATE_WORD, .cycles = 4, .memory_cycles = 10 },
+  [0xca] = { .handler = w86_instruction_ret_0xca, .immediate = IMMEDIATE_WORD, .cycles = 17 },
+  [0xcb] = { .handler = w86_instruction_ret_0xcb, .cycles = 18 },
+  [0xcc] = { .handler = w86_instruction_interrupt_0xcc, .cycles = 52 },
+  [0xcd] = { .handler = w86_instruction_interrupt_0xcd, .immediate = IMMEDIATE_BYTE, .cycles = 51 },
+  [0xce] = { .handler = w86_instruction_interrupt_0xce, .cycles = 4 },
+  [0xcf] = { .handler = w86_instruction_iret_0xcf, .cycles = 24 },
+  [0xd0] = UNIMPLEMENTED,
+  [0xd1] = UNIMPLEMENTED,
+  [0xd2] = UNIMPLEMENTED,
+  [0xd3] = UNIMPLEMENTED,
+  [0xd4] = UNIMPLEMENTED,
+  [0xd5] = UNIMPLEMENTED,
+  [0xd7] = UNIMPLEMENTED,
+  [0xd8] = UNIMPLEMENTED,
+  [0xd9] = UNIMPLEMENTED,
+  [0xda] = UNIMPLEMENTED,
+  [0xdb] = UNIMPLEMENTED,
+  [0xdc] = UNIMPLEMENTED,
+  [0xdd] = UNIMPLEMENTED,
+  [0xde] = UNIMPLEMENTED,
+  [0xdf] = UNIMPLEMENTED,
+  [0xe0] = UNIMPLEMENTED,
+  [0xe1] = UNIMPLEMENTED,
+  [0xe2] = UNIMPLEMENTED,
+  [0xe3] = UNIMPLEMENTED,
+  [0xe4] = { .handler = w86_instruction_in_0xe4, .immediate = IMMEDIATE_BYTE, .cycles = 10 },
+  [0xe5] = { .handler = w86_instruction_in_0xe5, .immediate = IMMEDIATE_BYTE, .cycles = 10 },
+  [0xe6] = { .handler = w86_instruction_out_0xe6, .immediate = IMMEDIATE_BYTE, .cycles = 10 },
+  [0xe7] = { .handler = w86_instruction_out_0xe7, .immediate = IMMEDIATE_BYTE, .cycles = 10 },
+  [0xe8] = { .handler = w86_instruction_call_0xe8, .immediate = IMMEDIATE_WORD, .cycles = 19 },
+  [0xe9] = { .handler = w86_instruction_jmp_0xe9, .immediate = IMMEDIATE_WORD, .cycles = 15 },
+  [0xea] = { .handler = w86_instruction_jmp_0xea, .immediate = IMMEDIATE_POINTER, .cycles = 15 },
+  [0xeb] = { .handler = w86_instruction_jmp_0xeb, .immediate = IMMEDIATE_SIGNED_BYTE, .cycles = 15 },
+  [0xec] = { .handler = w86_instruction_in_0xec, .cycles = 8 },
+  [0xed] = { .handler = w86_instruction_in_0xed, .cycles = 8 },
+  [0xee] = { .handler = w86_instruction_out_0xee, .cycles = 8 },
+  [0xef] = { .handler = w86_instruction_out_0xef, .cycles = 8 },
+  [0xf0] = UNIMPLEMENTED,
+  [0xf4] = { .handler = w86_instruction_hlt_0xf4, .cycles = 2 },
+  [0xf5] = { .handler = w86_instruction_cmc_0xf5, .cycles = 2 },
+  [0xf6] = UNIMPLEMENTED,
+  [0xf7] = UNIMPLEMENTED,
+  [0xf8] = { .handler = w86_instruction_clc_0xf8, .cycles = 2 },
+  [0xf9] = { .handler = w86_instruction_stc_0xf9, .cycles = 2 },
+  [0xfa] = { .handler = w86_instruction_cli_0xfa, .cycles = 2 },
+  [0xfb] = { .handler = w86_instruction_sti_0xfb, .cycles = 2 },
+  [0xfc] = { .handler = w86_instruction_cld_0xfc, .cycles = 2 },
+  [0xfd] = { .handler = w86_instruction_std_0xfd, .cycles = 2 },
+  [0xfe] = { .group = group_0xfe, .modrm = true },
+  [0xff] = { .group = group_0xff, .modrm = true },
+};
+
+static enum w86_status decode(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_info* instruction) {
+  uint16_t start = offset;
+  *instruction = (struct w86_instruction_info) {
+    .handler = nullptr,
+    .prefixes = {
+      .segment = W86_SEGMENT_PREFIX_NONE,
+      .repeat = W86_REPEAT_PREFIX_NONE,
+      .lock = false
+    }
   };
 
-  while (true) switch (w86_get_byte(state, state->registers.cs, offset)) {
-  case 0x88: // mov
-  case 0x89:
-  case 0x8a:
-  case 0x8b:
-  case 0x8c:
-  case 0x8e:
-  case 0xa0:
-  case 0xa1:
-  case 0xa2:
-  case 0xa3:
-  case 0xb0:
-  case 0xb1:
-  case 0xb2:
-  case 0xb3:
-  case 0xb4:
-  case 0xb5:
-  case 0xb6:
-  case 0xb7:
-  case 0xb8:
-  case 0xb9:
-  case 0xba:
-  case 0xbb:
-  case 0xbc:
-  case 0xbd:
-  case 0xbe:
-  case 0xbf:
-  case 0xc6:
-  case 0xc7:
-    return w86_instruction_mov(state, offset, prefixes);
-
-  case 0x86: // xchg
-  case 0x87:
-  case 0x90:
-  case 0x91:
-  case 0x92:
-  case 0x93:
-  case 0x94:
-  case 0x95:
-  case 0x96:
-  case 0x97:
-    return w86_instruction_xchg(state, offset, prefixes);
-
-  case 0xe4: // in
-  case 0xe5:
-  case 0xec:
-  case 0xed:
-    return w86_instruction_in(state, offset, prefixes);
-
-  case 0xe6: // out
-  case 0xe7:
-  case 0xee:
-  case 0xef:
-    return w86_instruction_out(state, offset, prefixes);
-
-  case 0x00: // add
-  case 0x01:
-  case 0x02:
-  case 0x03:
-  case 0x04:
-  case 0x05:
-    return w86_instruction_add(state, offset, prefixes);
-
-  case 0x40: // inc
-  case 0x41:
-  case 0x42:
-  case 0x43:
-  case 0x44:
-  case 0x45:
-  case 0x46:
-  case 0x47:
-    return w86_instruction_inc(state, offset, prefixes);
-
-  case 0x28: // sub
-  case 0x29:
-  case 0x2a:
-  case 0x2b:
-  case 0x2c:
-  case 0x2d:
-    return w86_instruction_sub(state, offset, prefixes);
-
-  case 0x48: // dec
-  case 0x49:
-  case 0x4a:
-  case 0x4b:
-  case 0x4c:
-  case 0x4d:
-  case 0x4e:
-  case 0x4f:
-    return w86_instruction_dec(state, offset, prefixes);
-
-  case 0x38: // cmp
-  case 0x39:
-  case 0x3a:
-  case 0x3b:
-  case 0x3c:
-  case 0x3d:
-    return w86_instruction_cmp(state, offset, prefixes);
-
-  case 0x9a: // call
-  case 0xe8:
-    return w86_instruction_call(state, offset, prefixes);
-
-  case 0xc2: // ret
-  case 0xc3:
-  case 0xca:
-  case 0xcb:
-    return w86_instruction_ret(state, offset, prefixes);
-
-  case 0xe9: // jmp
-  case 0xea:
-  case 0xeb:
-    return w86_instruction_jmp(state, offset, prefixes);
-
-  case 0x70: // jo
-  case 0x71: // jno
-  case 0x72: // jb/jnae/jc
-  case 0x73: // jae/jnb/jnc
-  case 0x74: // je/jz
-  case 0x75: // jne/jnz
-  case 0x76: // jbe/jna
-  case 0x77: // ja/jnbe
-  case 0x78: // js
-  case 0x79: // jns
-  case 0x7a: // jp/jpe
-  case 0x7b: // jnp/jpo
-  case 0x7c: // jl/jnge
-  case 0x7d: // jge/jnl
-  case 0x7e: // jle/jng
-  case 0x7f: // jg/jnle
-    return w86_instruction_jcc(state, offset, prefixes);
-
-  case 0xf8: // clc
-    return w86_instruction_clc(state, offset, prefixes);
-
-  case 0xf5: // cmc
-    return w86_instruction_cmc(state, offset, prefixes);
-
-  case 0xf9: // stc
-    return w86_instruction_stc(state, offset, prefixes);
-
-  case 0xfa: // cli
-    return w86_instruction_cli(state, offset, prefixes);
-
-  case 0xfb: // sti
-    return w86_instruction_sti(state, offset, prefixes);
-
-  case 0xfc: // cld
-    return w86_instruction_cld(state, offset, prefixes);
-
-  case 0xfd: // std
-    return w86_instruction_std(state, offset, prefixes);
-
-  case 0xf4: // hlt
-    return w86_instruction_hlt(state, offset, prefixes);
-
-  case 0x80: // immediate instruction group
-  case 0x81:
-  case 0x82:
-  case 0x83:
-    switch (w86_get_byte(state, state->registers.cs, offset + 1) >> 3 & 0b111) {
-    case 0b000: // add
-      return w86_instruction_add(state, offset, prefixes);
-
-    case 0b101: // sub
-      return w86_instruction_sub(state, offset, prefixes);
-
-    case 0b111: // cmp
-      return w86_instruction_cmp(state, offset, prefixes);
-
-    case 0b001:
-    case 0b011:
-    case 0b100:
-    case 0b110:
-      return W86_STATUS_UNIMPLEMENTED_OPCODE;
+  // prefixes are eaten here so they never reach the table, the last repeat prefix wins like on the 8086
+  // a segment full of them has its last one taken for the opcode, which there's none for
+  for (uint8_t byte; (uint16_t) (offset - start) < MAX_PREFIXES && ((byte = w86_fetch_byte(state, state->bases.cs, offset)) == 0xf2 || byte == 0xf3); offset++) {
+    instruction->prefixes.repeat = byte == 0xf2 ? W86_REPEAT_PREFIX_REPNE : W86_REPEAT_PREFIX_REP;
+  }
+
+  instruction->opcode = w86_fetch_byte(state, state->bases.cs, offset);
+  const struct opcode* opcode = &opcodes[instruction->opcode];
+  bool modrm = opcode->modrm;
+  enum immediate immediate = opcode->immediate;
+  if (opcode->group) opcode = &opcode->group[w86_fetch_byte(state, state->bases.cs, offset + 1) >> 3 & 0b111];
+  if (!opcode->handler) return opcode->unimplemented ? W86_STATUS_UNIMPLEMENTED_OPCODE : W86_STATUS_UNDEFINED_OPCODE;
+  instruction->handler = opcode->handler;
+  offset++;
+
+  if (modrm) {
+    instruction->modrm = w86_fetch_byte(state, state->bases.cs, offset++);
+    switch (instruction->modrm >> 6 & 0b11) {
+    case W86_MODRM_MOD_MEM:
+      if ((instruction->modrm & 0b111) != W86_MODRM_MEM_DIRECT) break;
+      [[fallthrough]];
+
+    case W86_MODRM_MOD_MEM_DISP16:
+      instruction->disp = w86_fetch_word(state, state->bases.cs, offset);
+      offset += 2;
+      break;
+
+    case W86_MODRM_MOD_MEM_DISP8:
+      instruction->disp = (int8_t) w86_fetch_byte(state, state->bases.cs, offset);
+      offset += 1;
+      break;
+
+    case W86_MODRM_MOD_REG:
+      break;
     }
+  }
+  bool memory = modrm && (instruction->modrm >> 6 & 0b11) != W86_MODRM_MOD_REG;
+  instruction->cycles = memory ? opcode->memory_cycles + w86_modrm_cycles(instruction) : opcode->cycles;
+
+  switch (immediate) {
+  case IMMEDIATE_NONE:
+    break;
+
+  case IMMEDIATE_BYTE:
+    instruction->imm = w86_fetch_byte(state, state->bases.cs, offset);
+    offset += 1;
+    break;
+
+  case IMMEDIATE_SIGNED_BYTE:
+    instruction->imm = (int8_t) w86_fetch_byte(state, state->bases.cs, offset);
+    offset += 1;
+    break;
+
+  case IMMEDIATE_WORD:
+    instruction->imm = w86_fetch_word(state, state->bases.cs, offset);
+    offset += 2;
+    break;
+
+  case IMMEDIATE_POINTER:
+    instruction->imm = w86_fetch_word(state, state->bases.cs, offset);
+    instruction->imm2 = w86_fetch_word(state, state->bases.cs, offset + 2);
+    offset += 4;
+  }
 
-  case 0xd0: // shift instruction group
-  case 0xd1:
-  case 0xd2:
-  case 0xd3:
-    return W86_STATUS_UNIMPLEMENTED_OPCODE;
+  instruction->size = offset - start;
+  return W86_STATUS_SUCCESS;
+}
 
-  case 0xf6: // instruction group 1
-  case 0xf7:
-    return W86_STATUS_UNIMPLEMENTED_OPCODE;
+enum w86_status w86_decode(struct w86_cpu_state* state, uint16_t offset, const struct w86_instruction_info** ret) {
+  struct w86_decode_cache* cache = &state->decode_cache;
+  uint32_t address = W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, offset));
+  uint32_t page = W86_CODE_PAGE(address);
+  struct w86_decode_cache_entry* entry = &cache->entries[address % W86_DECODE_CACHE_SIZE];
 
-  case 0xfe: // instruction group 2
-  case 0xff:
-    switch (w86_get_byte(state, state->registers.cs, offset + 1) >> 3 & 0b111) {
-    case 0b000: // inc
-      return w86_instruction_inc(state, offset, prefixes);
+  if (entry->instruction.handler && entry->address == address && entry->generation == cache->generations[page]) {
+    *ret = &entry->instruction;
+    return W86_STATUS_SUCCESS;
+  }
 
-    case 0b001: // dec
-      return w86_instruction_dec(state, offset, prefixes);
+  struct w86_instruction_info instruction;
+  enum w86_status status = decode(state, offset, &instruction);
+  if (status != W86_STATUS_SUCCESS) return status;
 
-    case 0b100: // jmp
-    case 0b101:
-      return w86_instruction_jmp(state, offset, prefixes);
+  // instructions that wrap around the segment or straddle a page stay uncached so one page generation covers every entry
+  uint32_t last = W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, offset + instruction.size - 1));
+  if (last != address + instruction.size - 1 || W86_CODE_PAGE(last) != page) {
+    cache->scratch = instruction;
+    *ret = &cache->scratch;
+    return W86_STATUS_SUCCESS;
+  }
 
-    case 0b010:
-    case 0b011:
-    case 0b110:
-      return W86_STATUS_UNIMPLEMENTED_OPCODE;
+  entry->instruction = instruction;
+  entry->address = address;
+  entry->generation = cache->generations[page];
+  cache->pages[page] = true;
 
-    default:
-      return W86_STATUS_UNDEFINED_OPCODE;
-    }
+  *ret = &entry->instruction;
+  return W86_STATUS_SUCCESS;
+}
+
+void w86_decode_invalidate_page(struct w86_cpu_state* state, uint32_t page) {
+  state->decode_cache.generations[page]++;
+  state->decode_cache.pages[page] = false;
+}
 
-  case 0x06:
-  case 0x07:
-  case 0x08:
-  case 0x09:
-  case 0x0a:
-  case 0x0b:
-  case 0x0c:
-  case 0x0d:
-  case 0x0e:
-  case 0x10:
-  case 0x11:
-  case 0x12:
-  case 0x13:
-  case 0x14:
-  case 0x15:
-  case 0x16:
-  case 0x17:
-  case 0x18:
-  case 0x19:
-  case 0x1a:
-  case 0x1b:
-  case 0x1c:
-  case 0x1d:
-  case 0x1e:
-  case 0x1f:
-  case 0x20:
-  case 0x21:
-  case 0x22:
-  case 0x23:
-  case 0x24:
-  case 0x25:
-  case 0x26:
-  case 0x27:
-  case 0x2e:
-  case 0x2f:
-  case 0x30:
-  case 0x31:
-  case 0x32:
-  case 0x33:
-  case 0x34:
-  case 0x35:
-  case 0x36:
-  case 0x37:
-  case 0x3e:
-  case 0x3f:
-  case 0x50:
-  case 0x51:
-  case 0x52:
-  case 0x53:
-  case 0x54:
-  case 0x55:
-  case 0x56:
-  case 0x57:
-  case 0x58:
-  case 0x59:
-  case 0x5a:
-  case 0x5b:
-  case 0x5c:
-  case 0x5d:
-  case 0x5e:
-  case 0x5f:
-  case 0x84:
-  case 0x85:
-  case 0x8d:
-  case 0x8f:
-  case 0x98:
-  case 0x99:
-  case 0x9b:
-  case 0x9c:
-  case 0x9d:
-  case 0x9e:
-  case 0x9f:
-  case 0xa4:
-  case 0xa5:
-  case 0xa6:
-  case 0xa7:
-  case 0xa8:
-  case 0xa9:
-  case 0xaa:
-  case 0xab:
-  case 0xac:
-  case 0xad:
-  case 0xae:
-  case 0xaf:
-  case 0xc4:
-  case 0xc5:
-  case 0xcc:
-  case 0xcd:
-  case 0xce:
-  case 0xcf:
-  case 0xd4:
-  case 0xd5:
-  case 0xd7:
-  case 0xd8:
-  case 0xd9:
-  case 0xda:
-  case 0xdb:
-  case 0xdc:
-  case 0xdd:
-  case 0xde:
-  case 0xdf:
-  case 0xe0:
-  case 0xe1:
-  case 0xe2:
-  case 0xe3:
-  case 0xf0:
-  case 0xf2:
-  case 0xf3:
-    return W86_STATUS_UNIMPLEMENTED_OPCODE;
-
-  default:
-    return W86_STATUS_UNDEFINED_OPCODE;
+void w86_decode_invalidate(struct w86_cpu_state* state) {
+  for (uint32_t page = 0; page < W86_CODE_PAGE_COUNT; page++) {
+    w86_decode_invalidate_page(state, page);
   }
 }
@@ -7,30 +7,15 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 #include "w86.h"
 
-enum w86_segment_prefix {
-  W86_SEGMENT_PREFIX_NONE,
-  W86_SEGMENT_PREFIX_CS,
-  W86_SEGMENT_PREFIX_DS,
-  W86_SEGMENT_PREFIX_ES,
-  W86_SEGMENT_PREFIX_SS
-};
-
-enum w86_repeat_prefix {
-  W86_REPEAT_PREFIX_NONE,
-  W86_REPEAT_PREFIX_REP,
-  W86_REPEAT_PREFIX_REPE = W86_REPEAT_PREFIX_REP,
-  W86_REPEAT_PREFIX_REPNE
-};
-
-struct w86_instruction_prefixes {
-  enum w86_segment_prefix segment;
-  enum w86_repeat_prefix repeat;
-  bool lock;
-};
-
-enum w86_status w86_decode(struct w86_cpu_state* state);
+#define W86_CODE_PAGE(address) ((address) >> W86_CODE_PAGE_SIZE)
+
+enum w86_status w86_decode(struct w86_cpu_state* state, uint16_t offset, const struct w86_instruction_info** ret);
+void w86_decode_invalidate_page(struct w86_cpu_state* state, uint32_t page);
+void w86_decode_invalidate(struct w86_cpu_state* state);
 
 #ifdef __cplusplus
 }
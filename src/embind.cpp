@@ -1,12 +1,151 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
+#include <string>
+
 #include <emscripten/bind.h>
+#include <emscripten/val.h>
 
 #define EMBIND
 #include "w86.h"
+#include "bus.h"
+#include "debug.h"
+#include "history.h"
+#include "io.h"
+#include "pic.h"
+#include "pit.h"
+#include "profile.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "trace.h"
 
 using namespace emscripten;
 
+static w86_register_file get_registers(const w86_cpu_state& state) {
+  return w86_cpu_get_registers(&state);
+}
+
+static void set_registers(w86_cpu_state& state, w86_register_file registers) {
+  w86_cpu_set_registers(&state, registers);
+}
+
+// address of the dirty bitmaps, the ui reads them straight out of the heap
+static intptr_t get_dirty(const w86_cpu_state& state) {
+  return reinterpret_cast<intptr_t>(&state.dirty);
+}
+
+// a double so it doesn't need bigint, it's exact for longer than anything will run
+static double get_cycles(const w86_cpu_state& state) {
+  return state.cycles;
+}
+
+// host memory comes in as heap addresses and device callbacks as table indices from addFunction
+
+static bool bus_map_ram(w86_cpu_state* state, uint32_t address, uint32_t size, intptr_t host) {
+  return w86_bus_map_ram(state, address, size, reinterpret_cast<uint8_t*>(host));
+}
+
+static bool bus_map_rom(w86_cpu_state* state, uint32_t address, uint32_t size, intptr_t host) {
+  return w86_bus_map_rom(state, address, size, reinterpret_cast<const uint8_t*>(host));
+}
+
+static bool bus_map_mmio(w86_cpu_state* state, uint32_t address, uint32_t size, intptr_t read, intptr_t write, intptr_t context) {
+  return w86_bus_map_mmio(state, address, size, {
+    .read = reinterpret_cast<w86_bus_read*>(read),
+    .write = reinterpret_cast<w86_bus_write*>(write),
+    .context = reinterpret_cast<void*>(context)
+  });
+}
+
+// js port handlers should prefer flush, it gets a whole queue of w86_io_write_records per call
+static bool io_map(w86_cpu_state* state, uint16_t first, uint32_t count, intptr_t read, intptr_t write, intptr_t flush, intptr_t context) {
+  return w86_io_map(state, first, count, {
+    .read = reinterpret_cast<w86_io_read*>(read),
+    .write = reinterpret_cast<w86_io_write*>(write),
+    .flush = reinterpret_cast<w86_io_batch*>(flush),
+    .context = reinterpret_cast<void*>(context)
+  });
+}
+
+// snapshots are W86_SNAPSHOT_SIZE bytes of heap the caller allocates
+
+static void snapshot_take(w86_cpu_state* state, intptr_t snapshot) {
+  w86_snapshot_take(state, reinterpret_cast<w86_snapshot*>(snapshot));
+}
+
+static void snapshot_restore(w86_cpu_state* state, intptr_t snapshot) {
+  w86_snapshot_restore(state, reinterpret_cast<const w86_snapshot*>(snapshot));
+}
+
+// the history and its rings are heap the caller allocates too
+static bool history_start(w86_cpu_state* state, intptr_t history, uint32_t interval, intptr_t checkpoints, uint32_t checkpoint_count, intptr_t journal, uint32_t journal_size) {
+  return w86_history_start(state, reinterpret_cast<w86_history*>(history), interval,
+                    reinterpret_cast<w86_history_checkpoint*>(checkpoints), checkpoint_count, reinterpret_cast<uint32_t*>(journal), journal_size);
+}
+
+// output is a table index, it gets the heap address and length of each chunk
+static void trace_start(w86_cpu_state* state, intptr_t trace, intptr_t buffer, uint32_t size, intptr_t output, intptr_t context, bool registers, bool writes) {
+  w86_trace_start(state, reinterpret_cast<w86_trace*>(trace), reinterpret_cast<uint8_t*>(buffer), size,
+                  reinterpret_cast<w86_trace_output*>(output), reinterpret_cast<void*>(context), registers, writes);
+}
+
+// the profile is W86_PROFILE_SIZE bytes of heap, its counters come back as views the ui can keep reading
+static void profile_start(w86_cpu_state* state, intptr_t profile, uint32_t interval) {
+  w86_profile_start(state, reinterpret_cast<w86_profile*>(profile), interval);
+}
+
+static void profile_clear(intptr_t profile) {
+  w86_profile_clear(reinterpret_cast<w86_profile*>(profile));
+}
+
+static val profile_counts(intptr_t profile) {
+  return val(typed_memory_view(W86_MEMORY_SIZE, reinterpret_cast<w86_profile*>(profile)->counts));
+}
+
+static val profile_opcodes(intptr_t profile) {
+  return val(typed_memory_view(256, reinterpret_cast<w86_profile*>(profile)->opcodes));
+}
+
+static std::string profile_folded(intptr_t profile) {
+  const w86_profile* p = reinterpret_cast<const w86_profile*>(profile);
+  std::string folded(w86_profile_folded(p, nullptr, 0), '\0');
+  w86_profile_folded(p, folded.data(), folded.size() + 1);
+  return folded;
+}
+
+// breakpoints and watchpoints are bitmaps in W86_DEBUG_SIZE bytes of heap, the ui sets bits in the views and refreshes
+static void debug_start(w86_cpu_state* state, intptr_t debug) {
+  w86_debug_start(state, reinterpret_cast<w86_debug*>(debug));
+}
+
+static w86_debug_hit debug_hit(intptr_t debug) {
+  return reinterpret_cast<const w86_debug*>(debug)->hit;
+}
+
+static val debug_breakpoints(intptr_t debug) {
+  return val(typed_memory_view(W86_DEBUG_WORDS, reinterpret_cast<w86_debug*>(debug)->breakpoints));
+}
+
+static val debug_reads(intptr_t debug) {
+  return val(typed_memory_view(W86_DEBUG_WORDS, reinterpret_cast<w86_debug*>(debug)->reads));
+}
+
+static val debug_writes(intptr_t debug) {
+  return val(typed_memory_view(W86_DEBUG_WORDS, reinterpret_cast<w86_debug*>(debug)->writes));
+}
+
+// the scheduler and the devices are W86_*_SIZE bytes of heap each, the scheduler goes first
+static void scheduler_start(w86_cpu_state* state, intptr_t scheduler) {
+  w86_scheduler_start(state, reinterpret_cast<w86_scheduler*>(scheduler));
+}
+
+static bool pic_start(w86_cpu_state* state, intptr_t pic) {
+  return w86_pic_start(state, reinterpret_cast<w86_pic*>(pic));
+}
+
+static bool pit_start(w86_cpu_state* state, intptr_t pit) {
+  return w86_pit_start(state, reinterpret_cast<w86_pit*>(pit));
+}
+
 EMSCRIPTEN_BINDINGS(w86) {
   value_object<w86_register_file>("W86RegisterFile")
     .field("ax", &w86_register_file::ax)
@@ -30,9 +169,11 @@ EMSCRIPTEN_BINDINGS(w86) {
 
   class_<w86_cpu_state>("W86CpuState")
     .constructor<>()
-    .property("registers", &w86_cpu_state::registers)
+    .property("registers", &get_registers, &set_registers)
     .property("memory", &w86_cpu_state::memory)
-    .property("io", &w86_cpu_state::io);
+    .property("io", &w86_cpu_state::io)
+    .property("dirty", &get_dirty)
+    .property("cycles", &get_cycles);
 
   enum_<w86_status>("W86Status")
     .value("SUCCESS", W86_STATUS_SUCCESS)
@@ -40,7 +181,69 @@ EMSCRIPTEN_BINDINGS(w86) {
     .value("UNKNOWN_ERROR", W86_STATUS_UNKNOWN_ERROR)
     .value("UNDEFINED_OPCODE", W86_STATUS_UNDEFINED_OPCODE)
     .value("UNIMPLEMENTED_OPCODE", W86_STATUS_UNIMPLEMENTED_OPCODE)
-    .value("INVALID_OPERATION", W86_STATUS_INVALID_OPERATION);
+    .value("INVALID_OPERATION", W86_STATUS_INVALID_OPERATION)
+    .value("BREAKPOINT", W86_STATUS_BREAKPOINT)
+    .value("WATCHPOINT", W86_STATUS_WATCHPOINT)
+    .value("POLL", W86_STATUS_POLL);
+
+  value_object<w86_debug_hit>("W86DebugHit")
+    .field("address", &w86_debug_hit::address)
+    .field("access", &w86_debug_hit::access);
+
+  value_object<w86_run_result>("W86RunResult")
+    .field("status", &w86_run_result::status)
+    .field("instructions", &w86_run_result::instructions);
+
+  constant("W86_MEMORY_SIZE", W86_MEMORY_SIZE);
+  constant("W86_SNAPSHOT_SIZE", sizeof(w86_snapshot));
+  constant("W86_HISTORY_SIZE", sizeof(w86_history));
+  constant("W86_HISTORY_CHECKPOINT_SIZE", sizeof(w86_history_checkpoint));
+  constant("W86_TRACE_SIZE", sizeof(w86_trace));
+  constant("W86_PROFILE_SIZE", sizeof(w86_profile));
+  constant("W86_DEBUG_SIZE", sizeof(w86_debug));
+  constant("W86_DEBUG_READ", W86_DEBUG_READ);
+  constant("W86_DEBUG_WRITE", W86_DEBUG_WRITE);
+  constant("W86_SCHEDULER_SIZE", sizeof(w86_scheduler));
+  constant("W86_PIC_SIZE", sizeof(w86_pic));
+  constant("W86_PIT_SIZE", sizeof(w86_pit));
 
   function("w86CpuStep", &w86_cpu_step, allow_raw_pointers());
+  function("w86CpuRun", &w86_cpu_run, allow_raw_pointers());
+  function("w86CpuRunCycles", &w86_cpu_run_cycles, allow_raw_pointers());
+  function("w86CpuInvalidate", &w86_cpu_invalidate, allow_raw_pointers());
+  function("w86BusReset", &w86_bus_reset, allow_raw_pointers());
+  function("w86BusMapRam", &bus_map_ram, allow_raw_pointers());
+  function("w86BusMapRom", &bus_map_rom, allow_raw_pointers());
+  function("w86BusMapMmio", &bus_map_mmio, allow_raw_pointers());
+  function("w86IoMap", &io_map, allow_raw_pointers());
+  function("w86IoReset", &w86_io_reset, allow_raw_pointers());
+  function("w86IoFlush", &w86_io_flush, allow_raw_pointers());
+  function("w86SnapshotTake", &snapshot_take, allow_raw_pointers());
+  function("w86SnapshotRestore", &snapshot_restore, allow_raw_pointers());
+  function("w86HistoryStart", &history_start, allow_raw_pointers());
+  function("w86HistoryStop", &w86_history_stop, allow_raw_pointers());
+  function("w86HistoryStepBack", &w86_history_step_back, allow_raw_pointers());
+  function("w86HistoryReverseContinue", &w86_history_reverse_continue, allow_raw_pointers());
+  function("w86TraceStart", &trace_start, allow_raw_pointers());
+  function("w86TraceStop", &w86_trace_stop, allow_raw_pointers());
+  function("w86TraceFlush", &w86_trace_flush, allow_raw_pointers());
+  function("w86ProfileStart", &profile_start, allow_raw_pointers());
+  function("w86ProfileStop", &w86_profile_stop, allow_raw_pointers());
+  function("w86ProfileClear", &profile_clear);
+  function("w86ProfileCounts", &profile_counts);
+  function("w86ProfileOpcodes", &profile_opcodes);
+  function("w86ProfileFolded", &profile_folded);
+  function("w86DebugStart", &debug_start, allow_raw_pointers());
+  function("w86DebugStop", &w86_debug_stop, allow_raw_pointers());
+  function("w86DebugRefresh", &w86_debug_refresh, allow_raw_pointers());
+  function("w86DebugSetBreakpoint", &w86_debug_set_breakpoint, allow_raw_pointers());
+  function("w86DebugSetWatchpoint", &w86_debug_set_watchpoint, allow_raw_pointers());
+  function("w86DebugHit", &debug_hit);
+  function("w86DebugBreakpoints", &debug_breakpoints);
+  function("w86DebugReads", &debug_reads);
+  function("w86DebugWrites", &debug_writes);
+  function("w86SchedulerStart", &scheduler_start, allow_raw_pointers());
+  function("w86SchedulerStop", &w86_scheduler_stop, allow_raw_pointers());
+  function("w86PicStart", &pic_start, allow_raw_pointers());
+  function("w86PitStart", &pit_start, allow_raw_pointers());
 }
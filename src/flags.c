@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "flags.h"
+
+#include <stdint.h>
+
+#include "w86.h"
+
+static inline uint16_t get_flags_result(uint16_t value, uint16_t sign) {
+  uint16_t flags = (value == 0) * W86_FLAGS_ZF | (value & sign ? W86_FLAGS_SF : 0);
+
+  // parity
+  uint8_t parity = value;
+  parity ^= parity >> 4;
+  parity ^= parity >> 2;
+  parity ^= parity >> 1;
+  flags |= !(parity & 1) * W86_FLAGS_PF;
+
+  return flags;
+}
+
+// full flags register, computing the arithmetic bits from the last operation if they're stale
+uint16_t w86_flags_get(const struct w86_cpu_state* state) {
+  const struct w86_lazy_flags* lazy = &state->lazy_flags;
+  uint16_t sign = lazy->word ? 0x8000 : 0x80;
+  uint16_t a = lazy->a, b = lazy->b, result = lazy->result;
+
+  uint16_t flags = 0;
+  switch (lazy->op) {
+  case W86_FLAGS_OP_NONE:
+    return state->registers.flags;
+
+  case W86_FLAGS_OP_ADD:
+  case W86_FLAGS_OP_INC:
+    flags = (result < a) * W86_FLAGS_CF
+          | ((a ^ b ^ result) & 0x10 ? W86_FLAGS_AF : 0)
+          | ((a ^ result) & (b ^ result) & sign ? W86_FLAGS_OF : 0);
+    break;
+
+  case W86_FLAGS_OP_SUB:
+  case W86_FLAGS_OP_DEC:
+    flags = (a < b) * W86_FLAGS_CF
+          | ((a ^ b ^ result) & 0x10 ? W86_FLAGS_AF : 0)
+          | ((a ^ b) & (a ^ result) & sign ? W86_FLAGS_OF : 0);
+    break;
+  }
+  flags |= get_flags_result(result, sign);
+
+  if (lazy->op == W86_FLAGS_OP_INC || lazy->op == W86_FLAGS_OP_DEC) {
+    return (state->registers.flags & (W86_FLAGS_CONTROL | W86_FLAGS_CF)) | (flags & ~W86_FLAGS_CF);
+  }
+  return (state->registers.flags & W86_FLAGS_CONTROL) | flags;
+}
+
+// for anything that touches flags directly
+void w86_flags_materialize(struct w86_cpu_state* state) {
+  state->registers.flags = w86_flags_get(state);
+  state->lazy_flags.op = W86_FLAGS_OP_NONE;
+}
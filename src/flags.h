@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_FLAGS_H_
+#define W86_FLAGS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_FLAGS_CF 0b00000000'00000001
+#define W86_FLAGS_PF 0b00000000'00000100
+#define W86_FLAGS_AF 0b00000000'00010000
+#define W86_FLAGS_ZF 0b00000000'01000000
+#define W86_FLAGS_SF 0b00000000'10000000
+#define W86_FLAGS_TF 0b00000001'00000000
+#define W86_FLAGS_IF 0b00000010'00000000
+#define W86_FLAGS_DF 0b00000100'00000000
+#define W86_FLAGS_OF 0b00001000'00000000
+#define W86_FLAGS_CONTROL 0b00000111'00000000 // tf, if and df survive arithmetic
+
+uint16_t w86_flags_get(const struct w86_cpu_state* state);
+void w86_flags_materialize(struct w86_cpu_state* state);
+
+static inline void w86_flags_record(struct w86_cpu_state* state, enum w86_flags_op op, bool word, uint16_t a, uint16_t b, uint16_t result) {
+  // inc and dec need the carry of whatever came before them
+  if ((op == W86_FLAGS_OP_INC || op == W86_FLAGS_OP_DEC) && state->lazy_flags.op != W86_FLAGS_OP_NONE) {
+    state->registers.flags = (state->registers.flags & ~W86_FLAGS_CF) | (w86_flags_get(state) & W86_FLAGS_CF);
+  }
+  state->lazy_flags = (struct w86_lazy_flags) { .op = op, .word = word, .a = a, .b = b, .result = result };
+}
+
+// the flags a jcc condition looks at, condition is the low nibble of its opcode and unsigned so ~condition can be shifted
+static inline uint16_t w86_flags_condition_mask(uint32_t condition) {
+  return (~condition >> 3 &                    condition >> 1  & 0b00000000'00000001) // cf
+       | ( condition >> 1 & ~condition      &  condition << 1  & 0b00000000'00000100) // pf
+       | (~condition << 3 &  condition << 4                    & 0b00000000'01000000) // zf
+       | (                   condition << 4 &  condition << 5  & 0b00000000'01000000)
+       | ( condition << 4 & (condition << 5 | ~condition << 6) & 0b00000000'10000000) // sf
+       | (~condition << 8 & ~condition << 9 & ~condition << 10 & 0b00001000'00000000) // of
+       | ( condition << 8 &  condition << 9                    & 0b00001000'00000000);
+}
+
+// condition is the low nibble of a jcc opcode, inline so that it folds away in each jcc handler
+static inline bool w86_flags_condition(const struct w86_cpu_state* state, uint8_t condition) {
+  const struct w86_lazy_flags* lazy = &state->lazy_flags;
+
+  // cmp and sub are what almost every branch follows, so compare their operands directly
+  if (lazy->op == W86_FLAGS_OP_SUB) {
+    int16_t a = lazy->word ? (int16_t) lazy->a : (int8_t) lazy->a;
+    int16_t b = lazy->word ? (int16_t) lazy->b : (int8_t) lazy->b;
+    switch (condition >> 1) {
+    case 0b001: // b, ae
+      return (lazy->a < lazy->b) ^ (condition & 1);
+
+    case 0b010: // e, ne
+      return (lazy->a == lazy->b) ^ (condition & 1);
+
+    case 0b011: // be, a
+      return (lazy->a <= lazy->b) ^ (condition & 1);
+
+    case 0b110: // l, ge
+      return (a < b) ^ (condition & 1);
+
+    case 0b111: // le, g
+      return (a <= b) ^ (condition & 1);
+    }
+  }
+
+  uint16_t cond = w86_flags_condition_mask(condition) & w86_flags_get(state);
+
+  return (((cond >> 11 ^ cond >> 7) | cond >> 6 | cond >> 2 | cond) ^ condition) & 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_FLAGS_H_ */
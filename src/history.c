@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "history.h"
+
+#include <stdint.h>
+
+#include "address.h"
+#include "block.h"
+#include "debug.h"
+#include "profile.h"
+#include "schedule.h"
+#include "trace.h"
+#include "w86.h"
+
+static inline void checkpoint(struct w86_cpu_state* state) {
+  struct w86_history* history = state->history;
+  history->checkpoints[history->taken++ % history->checkpoint_count] = (struct w86_history_checkpoint) {
+    .registers = state->registers,
+    .lazy_flags = state->lazy_flags,
+    .cycles = state->cycles,
+    .instructions = history->instructions,
+    .journal = history->journal.head
+  };
+}
+
+// older checkpoints fall out of their ring, or out of reach once the journal since them got overwritten
+static inline bool reachable(const struct w86_history* history, uint64_t index) {
+  if (index >= history->taken || history->taken - index > history->checkpoint_count) return false;
+  return history->journal.head - history->checkpoints[index % history->checkpoint_count].journal <= history->journal.size;
+}
+
+// the interval and the buffers have to be set, everything else starts over from the current state
+bool w86_history_start(struct w86_cpu_state* state, struct w86_history* history, uint32_t interval,
+                       struct w86_history_checkpoint* checkpoints, uint32_t checkpoint_count, uint32_t* journal, uint32_t journal_size) {
+  if (!interval || !checkpoint_count || !journal_size || journal_size & (journal_size - 1)) return false;
+
+  *history = (struct w86_history) {
+    .checkpoints = checkpoints,
+    .journal = { .entries = journal, .size = journal_size },
+    .checkpoint_count = checkpoint_count,
+    .interval = interval
+  };
+  state->history = history;
+  state->journal = &history->journal;
+  checkpoint(state);
+  return true;
+}
+
+void w86_history_stop(struct w86_cpu_state* state) {
+  state->history = nullptr;
+  state->journal = nullptr;
+}
+
+// forgets everything before now, for when the state was changed in a way the journal didn't see
+void w86_history_reset(struct w86_cpu_state* state) {
+  struct w86_history* history = state->history;
+  if (!history) return;
+
+  history->instructions = 0;
+  history->taken = 0;
+  history->journal.head = 0;
+  history->devices = false;
+  checkpoint(state);
+}
+
+// breakpoints and watchpoints stay quiet while undoing and replaying, returns whether they were before
+static bool mute(struct w86_cpu_state* state, bool muted) {
+  if (!state->debug) return false;
+
+  bool was = state->debug->muted;
+  state->debug->muted = muted;
+  return was;
+}
+
+// runs in slices that end on checkpoints, a replay goes on through hlt and polls since it's just retracing what already ran
+static struct w86_run_result advance(struct w86_cpu_state* state, uint32_t max_instructions, bool replay) {
+  struct w86_history* history = state->history;
+  struct w86_run_result result = { .status = W86_STATUS_SUCCESS, .instructions = 0 };
+  struct w86_profile* profile = state->profile;
+  struct w86_trace* trace = state->trace;
+  if (replay) state->profile = nullptr; // it was all counted the first time, and the call stack is still where it left off
+  if (replay) state->trace = nullptr; // and recorded, a seek leaves a rewind record instead
+  bool muted = mute(state, replay);
+  while (result.instructions < max_instructions) {
+    uint64_t next = history->taken * history->interval;
+    uint32_t budget = max_instructions - result.instructions;
+    if (budget > next - history->instructions) budget = next - history->instructions;
+
+    uint32_t instructions;
+    if (state->trace) {
+      result.status = w86_trace_run(state, budget, &instructions);
+    } else if (state->profile) {
+      result.status = w86_profile_run(state, budget, &instructions);
+    } else {
+      result.status = w86_block_run(state, budget, &instructions);
+    }
+    history->instructions += instructions;
+    result.instructions += instructions;
+    if (history->devices) {
+      w86_history_reset(state); // past a device port there's no going back, the device moved on
+    } else if (history->instructions == next) {
+      checkpoint(state);
+    }
+    if (result.status != W86_STATUS_SUCCESS && !(replay && (result.status == W86_STATUS_HALT || result.status == W86_STATUS_POLL))) break;
+    if (!replay && w86_schedule_due(state)) break;
+  }
+  state->profile = profile;
+  state->trace = trace;
+  mute(state, muted);
+
+  return result;
+}
+
+struct w86_run_result w86_history_run(struct w86_cpu_state* state, uint32_t max_instructions) {
+  return advance(state, max_instructions, false);
+}
+
+// undoes the journal back to the nearest checkpoint and replays from there
+// false and left alone if instruction is in the future or no longer reachable
+bool w86_history_seek(struct w86_cpu_state* state, uint64_t instruction) {
+  struct w86_history* history = state->history;
+  if (!history || instruction > history->instructions) return false;
+
+  uint64_t index = instruction / history->interval;
+  if (!reachable(history, index)) return false;
+
+  const struct w86_history_checkpoint* checkpoint = &history->checkpoints[index % history->checkpoint_count];
+  uint64_t first = checkpoint->journal, last = history->journal.head;
+  state->journal = nullptr; // the undo writes mustn't be journaled themselves
+  bool muted = mute(state, true);
+  while (history->journal.head > checkpoint->journal) {
+    uint32_t entry = history->journal.entries[--history->journal.head & (history->journal.size - 1)];
+    if (entry & W86_JOURNAL_IO) {
+      uint16_t port = entry;
+      uint32_t line = port >> W86_DIRTY_LINE_SIZE;
+      state->io.writes[port] = entry >> 24;
+      state->dirty.io[line / 32] |= UINT32_C(1) << line % 32;
+    } else {
+      w86_set_byte(state, entry & ((1 << 20) - 1), 0, entry >> 24); // a base with a zero pointer is just the address
+    }
+  }
+  state->journal = &history->journal;
+  mute(state, muted);
+
+  state->registers = checkpoint->registers;
+  state->lazy_flags = checkpoint->lazy_flags;
+  state->cycles = checkpoint->cycles;
+  w86_segments_update(state);
+  history->instructions = checkpoint->instructions;
+  history->taken = index + 1;
+
+  bool ok = advance(state, instruction - history->instructions, true).instructions == instruction - checkpoint->instructions;
+  if (state->trace) w86_trace_rewind(state, first, last);
+  return ok;
+}
+
+bool w86_history_step_back(struct w86_cpu_state* state) {
+  return state->history && state->history->instructions && w86_history_seek(state, state->history->instructions - 1);
+}
+
+// back to the last time cs:ip was at the linear address, false and left where it was if that's out of reach
+// goes one checkpoint interval at a time, replaying each to find the latest hit in it
+bool w86_history_reverse_continue(struct w86_cpu_state* state, uint32_t address) {
+  struct w86_history* history = state->history;
+  if (!history || !history->instructions) return false;
+
+  uint64_t present = history->instructions;
+  uint64_t end = present;
+  for (uint64_t index = (present - 1) / history->interval + 1; index-- > 0 && reachable(history, index);) {
+    if (!w86_history_seek(state, index * history->interval)) break;
+
+    uint64_t hit = end;
+    while (history->instructions < end) {
+      if (W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip)) == address) hit = history->instructions;
+      if (!advance(state, 1, true).instructions) break; // only if something changed that the replay depends on
+    }
+    if (hit != end) return w86_history_seek(state, hit);
+    end = index * history->interval;
+  }
+
+  w86_history_seek(state, present);
+  return false;
+}
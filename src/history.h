@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_HISTORY_H_
+#define W86_HISTORY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+// the journal has to hold at least interval instructions' worth of writes, or stepping back stops working
+// false if the interval or the checkpoint count is 0 or the journal size isn't a power of two
+bool w86_history_start(struct w86_cpu_state* state, struct w86_history* history, uint32_t interval,
+                       struct w86_history_checkpoint* checkpoints, uint32_t checkpoint_count, uint32_t* journal, uint32_t journal_size);
+void w86_history_stop(struct w86_cpu_state* state);
+void w86_history_reset(struct w86_cpu_state* state);
+struct w86_run_result w86_history_run(struct w86_cpu_state* state, uint32_t max_instructions);
+
+bool w86_history_seek(struct w86_cpu_state* state, uint64_t instruction);
+bool w86_history_step_back(struct w86_cpu_state* state);
+bool w86_history_reverse_continue(struct w86_cpu_state* state, uint32_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_HISTORY_H_ */
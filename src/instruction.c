@@ -4,253 +4,233 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "address.h"
 #include "decode.h"
+#include "flags.h"
+#include "interrupt.h"
 #include "modrm.h"
+#include "profile.h"
 #include "w86.h"
 
 // welcome to switch statement hell...
 
-static inline uint16_t sbw(uint8_t value) {
-  return (int8_t) value;
-}
-
-static inline uint16_t get_segment(struct w86_cpu_state* state, enum w86_segment_prefix segment) {
+static inline uint32_t get_segment_base(struct w86_cpu_state* state, enum w86_segment_prefix segment) {
   switch (segment) {
   case W86_SEGMENT_PREFIX_CS:
-    return state->registers.cs;
+    return state->bases.cs;
 
   case W86_SEGMENT_PREFIX_NONE:
   case W86_SEGMENT_PREFIX_DS:
-    return state->registers.ds;
+    return state->bases.ds;
 
   case W86_SEGMENT_PREFIX_ES:
-    return state->registers.es;
+    return state->bases.es;
 
   case W86_SEGMENT_PREFIX_SS:
-    return state->registers.ss;
+    return state->bases.ss;
   }
 }
 
-static uint16_t get_flags_byte(uint8_t value) {
-  uint16_t flags = (value == 0) << 6 | (value < 0) << 7;
-
-  // parity
-  uint8_t parity = value;
-  parity ^= parity >> 4;
-  parity ^= parity >> 2;
-  parity ^= parity >> 1;
-  flags |= !(parity & 1) << 2;
-
-  return flags;
-}
+// these do the arithmetic and leave the flags for later
 
-static uint16_t get_flags_add_byte(uint8_t a, uint8_t b, uint8_t* ret) {
+static inline uint8_t add_byte(struct w86_cpu_state* state, uint8_t a, uint8_t b) {
   uint8_t value = a + b;
-  if (ret) *ret = value;
-  return (a > 0xff - b)
-       | ((a & 0b1111) > 0xf - (b & 0b1111)) << 4
-       | (((int8_t) b > 0 && (int8_t) a > 0x7f - (int8_t) b) || ((int8_t) b < 0 && (int8_t) a < -0x7f - 1 - (int8_t) b)) << 11
-       | get_flags_byte(value);
+  w86_flags_record(state, W86_FLAGS_OP_ADD, false, a, b, value);
+  return value;
 }
 
-static uint16_t get_flags_sub_byte(uint8_t a, uint8_t b, uint8_t* ret) {
+static inline uint8_t sub_byte(struct w86_cpu_state* state, uint8_t a, uint8_t b) {
   uint8_t value = a - b;
-  if (ret) *ret = value;
-  return (a < b)
-       | ((a & 0b1111) < (b & 0b1111)) << 4
-       | (((int8_t) b < 0 && (int8_t) a > 0x7f + (int8_t) b) || ((int8_t) b > 0 && (int8_t) a < -0x7f - 1 + (int8_t) b)) << 11
-       | get_flags_byte(value);
+  w86_flags_record(state, W86_FLAGS_OP_SUB, false, a, b, value);
+  return value;
 }
 
-static uint16_t get_flags_word(uint16_t value) {
-  uint16_t flags = (value == 0) << 6 | (value < 0) << 7;
+static inline uint16_t add_word(struct w86_cpu_state* state, uint16_t a, uint16_t b) {
+  uint16_t value = a + b;
+  w86_flags_record(state, W86_FLAGS_OP_ADD, true, a, b, value);
+  return value;
+}
 
-  // parity
-  uint8_t parity = value;
-  parity ^= parity >> 4;
-  parity ^= parity >> 2;
-  parity ^= parity >> 1;
-  flags |= !(parity & 1) << 2;
+static inline uint16_t sub_word(struct w86_cpu_state* state, uint16_t a, uint16_t b) {
+  uint16_t value = a - b;
+  w86_flags_record(state, W86_FLAGS_OP_SUB, true, a, b, value);
+  return value;
+}
 
-  return flags;
+static inline uint8_t inc_byte(struct w86_cpu_state* state, uint8_t a) {
+  uint8_t value = a + 1;
+  w86_flags_record(state, W86_FLAGS_OP_INC, false, a, 1, value);
+  return value;
 }
 
-static uint16_t get_flags_add_word(uint16_t a, uint16_t b, uint16_t* ret) {
-  uint16_t value = a + b;
-  if (ret) *ret = value;
-  return (a > 0xffff - b)
-       | ((a & 0b1111) > 0xf - (b & 0b1111)) << 4
-       | (((int16_t) b > 0 && (int16_t) a > 0x7fff - (int16_t) b) || ((int16_t) b < 0 && (int16_t) a < -0x7fff - 1 - (int16_t) b)) << 11
-       | get_flags_word(value);
+static inline uint8_t dec_byte(struct w86_cpu_state* state, uint8_t a) {
+  uint8_t value = a - 1;
+  w86_flags_record(state, W86_FLAGS_OP_DEC, false, a, 1, value);
+  return value;
 }
 
-static uint16_t get_flags_sub_word(uint16_t a, uint16_t b, uint16_t* ret) {
-  uint16_t value = a - b;
-  if (ret) *ret = value;
-  return (a < b)
-       | ((a & 0b1111) < (b & 0b1111)) << 4
-       | (((int16_t) b < 0 && (int16_t) a > 0x7fff + (int16_t) b) || ((int16_t) b > 0 && (int16_t) a < -0x7fff - 1 + (int16_t) b)) << 11
-       | get_flags_word(value);
+static inline uint16_t inc_word(struct w86_cpu_state* state, uint16_t a) {
+  uint16_t value = a + 1;
+  w86_flags_record(state, W86_FLAGS_OP_INC, true, a, 1, value);
+  return value;
 }
 
-enum w86_status w86_instruction_mov(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
-  uint8_t segment = get_segment(state, prefixes.segment);
+static inline uint16_t dec_word(struct w86_cpu_state* state, uint16_t a) {
+  uint16_t value = a - 1;
+  w86_flags_record(state, W86_FLAGS_OP_DEC, true, a, 1, value);
+  return value;
+}
+
+static inline enum w86_status mov(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  uint32_t base = get_segment_base(state, instruction->prefixes.segment);
   struct w86_modrm_info info = {};
 
   switch (first_byte) {
   case 0x88: // reg8 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_byte_store(state, info, nullptr);
     break;
 
   case 0x89: // reg16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_word_store(state, info, nullptr);
     break;
 
   case 0x8a: // r/m8 -> reg8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_byte_load(state, info, nullptr);
     break;
 
   case 0x8b: // r/m16 -> reg16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_word_load(state, info, nullptr);
     break;
 
   case 0x8c: // seg -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg & 0b100) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_segment_store(state, info, nullptr);
     break;
   
   case 0x8e: // r/m16 -> seg
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg & 0b100 || info.reg == W86_MODRM_REG_CS) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_segment_load(state, info, nullptr);
     break;
 
   case 0xa0: // mem8 -> al
     state->registers.ax &= 0xff00;
-    state->registers.ax |= w86_get_byte(state, segment, w86_get_word(state, state->registers.cs, offset + 1));
+    state->registers.ax |= w86_get_byte(state, base, instruction->imm);
     break;
 
   case 0xa1: // mem16 -> ax
-    state->registers.ax = w86_get_word(state, segment, w86_get_word(state, state->registers.cs, offset + 1));
+    state->registers.ax = w86_get_word(state, base, instruction->imm);
     break;
 
   case 0xa2: // al -> mem8
-    w86_set_byte(state, segment, w86_get_word(state, state->registers.cs, offset + 1), state->registers.ax);
+    w86_set_byte(state, base, instruction->imm, state->registers.ax);
     break;
 
   case 0xa3: // ax -> mem16
-    w86_set_word(state, segment, w86_get_word(state, state->registers.cs, offset + 1), state->registers.ax);
+    w86_set_word(state, base, instruction->imm, state->registers.ax);
     break;
 
   case 0xb0 | W86_MODRM_REG_AL: // imm8 -> reg8
     state->registers.ax &= 0xff00;
-    state->registers.ax |= w86_get_byte(state, state->registers.cs, offset + 1);
+    state->registers.ax |= instruction->imm;
     break;
 
   case 0xb0 | W86_MODRM_REG_CL:
     state->registers.cx &= 0xff00;
-    state->registers.cx |= w86_get_byte(state, state->registers.cs, offset + 1);
+    state->registers.cx |= instruction->imm;
     break;
 
   case 0xb0 | W86_MODRM_REG_DL:
     state->registers.dx &= 0xff00;
-    state->registers.dx |= w86_get_byte(state, state->registers.cs, offset + 1);
+    state->registers.dx |= instruction->imm;
     break;
   
   case 0xb0 | W86_MODRM_REG_BL:
     state->registers.bx &= 0xff00;
-    state->registers.bx |= w86_get_byte(state, state->registers.cs, offset + 1);
+    state->registers.bx |= instruction->imm;
     break;
   
   case 0xb0 | W86_MODRM_REG_AH:
     state->registers.ax &= 0x00ff;
-    state->registers.ax |= w86_get_byte(state, state->registers.cs, offset + 1) << 8;
+    state->registers.ax |= instruction->imm << 8;
     break;
 
   case 0xb0 | W86_MODRM_REG_CH:
     state->registers.cx &= 0x00ff;
-    state->registers.cx |= w86_get_byte(state, state->registers.cs, offset + 1) << 8;
+    state->registers.cx |= instruction->imm << 8;
     break;
 
   case 0xb0 | W86_MODRM_REG_DH:
     state->registers.dx &= 0x00ff;
-    state->registers.dx |= w86_get_byte(state, state->registers.cs, offset + 1) << 8;
+    state->registers.dx |= instruction->imm << 8;
     break;
 
   case 0xb0 | W86_MODRM_REG_BH:
     state->registers.bx &= 0x00ff;
-    state->registers.bx |= w86_get_byte(state, state->registers.cs, offset + 1) << 8;
+    state->registers.bx |= instruction->imm << 8;
     break;
   
   case 0xb8 | W86_MODRM_REG_AX: // imm16 -> reg16
-    state->registers.ax = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.ax = instruction->imm;
     break;
 
   case 0xb8 | W86_MODRM_REG_CX:
-    state->registers.cx = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.cx = instruction->imm;
     break;
 
   case 0xb8 | W86_MODRM_REG_DX:
-    state->registers.dx = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.dx = instruction->imm;
     break;
   
   case 0xb8 | W86_MODRM_REG_BX:
-    state->registers.bx = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.bx = instruction->imm;
     break;
   
   case 0xb8 | W86_MODRM_REG_SP:
-    state->registers.sp = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.sp = instruction->imm;
     break;
 
   case 0xb8 | W86_MODRM_REG_BP:
-    state->registers.bp = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.bp = instruction->imm;
     break;
 
   case 0xb8 | W86_MODRM_REG_SI:
-    state->registers.si = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.si = instruction->imm;
     break;
 
   case 0xb8 | W86_MODRM_REG_DI:
-    state->registers.di = w86_get_word(state, state->registers.cs, offset + 1);
+    state->registers.di = instruction->imm;
     break;
 
   case 0xc6: // imm8 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
-    w86_modrm_set_rm_byte(state, info, w86_get_byte(state, state->registers.cs, offset + 2 + info.size));
+    w86_modrm_set_rm_byte(state, info, instruction->imm);
     break;
 
   case 0xc7: // imm16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
-    w86_modrm_set_rm_word(state, info, w86_get_word(state, state->registers.cs, offset + 2 + info.size));
+    w86_modrm_set_rm_word(state, info, instruction->imm);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
 
-  if ((first_byte & 0b11111100) == 0xa0
-   || (first_byte & 0b11111000) == 0xb8) {
-    state->registers.ip = offset + 3;
-  } else {
-    state->registers.ip = offset + 2;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_xchg(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status xchg(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
   switch (first_byte) {
@@ -260,14 +240,14 @@ enum w86_status w86_instruction_xchg(struct w86_cpu_state* state, uint16_t offse
     } temp;
 
   case 0x86: // reg8 <-> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_byte(state, info, &temp.u8);
     w86_modrm_byte_store(state, info, nullptr);
     w86_modrm_set_reg_byte(state, info, temp.u8);
     break;
 
   case 0x87: // reg16 <-> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_word(state, info, &temp.u16);
     w86_modrm_word_store(state, info, nullptr);
     w86_modrm_set_reg_word(state, info, temp.u16);
@@ -322,28 +302,21 @@ enum w86_status w86_instruction_xchg(struct w86_cpu_state* state, uint16_t offse
     return W86_STATUS_INVALID_OPERATION;
   }
 
-  if (first_byte == 0x86
-   || first_byte == 0x87) {
-    state->registers.ip = offset + 2;
-  } else {
-    state->registers.ip = offset + 1;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_in(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status in(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
 
   switch (first_byte) {
   case 0xe4: // io8(imm8) -> al
     state->registers.ax &= 0xff00;
-    state->registers.ax |= w86_in_byte(state, w86_get_byte(state, state->registers.cs, offset + 1));
+    state->registers.ax |= w86_in_byte(state, instruction->imm);
     break;
 
   case 0xe5: // io16(imm8) -> ax
-    state->registers.ax = w86_in_word(state, w86_get_byte(state, state->registers.cs, offset + 1));
+    state->registers.ax = w86_in_word(state, instruction->imm);
     break;
 
   case 0xec: // io8(dx) -> al
@@ -358,26 +331,20 @@ enum w86_status w86_instruction_in(struct w86_cpu_state* state, uint16_t offset,
     return W86_STATUS_INVALID_OPERATION;
   }
 
-  if (first_byte == 0xe4
-   || first_byte == 0xe5) {
-    state->registers.ip = offset + 2;
-  } else {
-    state->registers.ip = offset + 1;
-  }
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_out(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status out(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
 
   switch (first_byte) {
   case 0xe6: // al -> io8(imm8)
-    w86_out_byte(state, w86_get_byte(state, state->registers.cs, offset + 1), state->registers.ax);
+    w86_out_byte(state, instruction->imm, state->registers.ax);
     break;
 
   case 0xe7: // ax -> io16(imm8)
-    w86_out_word(state, w86_get_byte(state, state->registers.cs, offset + 1), state->registers.ax);
+    w86_out_word(state, instruction->imm, state->registers.ax);
     break;
 
   case 0xee: // al -> io8(dx)
@@ -392,23 +359,16 @@ enum w86_status w86_instruction_out(struct w86_cpu_state* state, uint16_t offset
     return W86_STATUS_INVALID_OPERATION;
   }
 
-  if (first_byte == 0xe6
-   || first_byte == 0xe7) {
-    state->registers.ip = offset + 2;
-  } else {
-    state->registers.ip = offset + 1;
-  }
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
 // arithmetic functions should probably be combined into one, but i don't feel like doing that
 
-enum w86_status w86_instruction_add(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status add(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
-  uint16_t flags;
   switch (first_byte) {
     union {
       uint8_t u8;
@@ -416,97 +376,82 @@ enum w86_status w86_instruction_add(struct w86_cpu_state* state, uint16_t offset
     } a, b, c;
 
   case 0x00: // r/m8 + reg8 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_byte(state, info, &a.u8);
     w86_modrm_get_reg_byte(state, info, &b.u8);
-    flags = get_flags_add_byte(a.u8, b.u8, &c.u8);
+    c.u8 = add_byte(state, a.u8, b.u8);
     w86_modrm_set_rm_byte(state, info, c.u8);
     break;
 
   case 0x01: // r/m16 + reg16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_word(state, info, &a.u16);
     w86_modrm_get_reg_word(state, info, &b.u16);
-    flags = get_flags_add_word(a.u16, b.u16, &c.u16);
+    c.u16 = add_word(state, a.u16, b.u16);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   case 0x02: // reg8 + r/m8 -> reg8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_byte(state, info, &a.u8);
     w86_modrm_get_rm_byte(state, info, &b.u8);
-    flags = get_flags_add_byte(a.u8, b.u8, &c.u8);
+    c.u8 = add_byte(state, a.u8, b.u8);
     w86_modrm_set_reg_byte(state, info, c.u8);
     break;
 
   case 0x03: // reg16 + r/m16 -> reg16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_word(state, info, &a.u16);
     w86_modrm_get_rm_word(state, info, &b.u16);
-    flags = get_flags_add_word(a.u16, b.u16, &c.u16);
+    c.u16 = add_word(state, a.u16, b.u16);
     w86_modrm_set_reg_word(state, info, c.u16);
     break;
 
   case 0x04: // al + imm8 -> al
-    flags = get_flags_add_byte(state->registers.ax, w86_get_byte(state, state->registers.cs, offset + 1), &c.u8);
+    c.u8 = add_byte(state, state->registers.ax, instruction->imm);
     state->registers.ax = c.u8;
     break;
 
   case 0x05: // ax + imm16 -> ax
-    flags = get_flags_add_word(state->registers.ax, w86_get_word(state, state->registers.cs, offset + 1), &state->registers.ax);
+    state->registers.ax = add_word(state, state->registers.ax, instruction->imm);
     break;
 
   case 0x80: // r/m8 + imm8 -> r/m8
   case 0x82:
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_byte(state, info, &a.u8);
-    flags = get_flags_add_byte(a.u8, w86_get_byte(state, state->registers.cs, offset + 2 + info.size), &c.u8);
+    c.u8 = add_byte(state, a.u8, instruction->imm);
     w86_modrm_set_rm_byte(state, info, c.u8);
     break;
 
   case 0x81: // r/m16 + imm16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_add_word(a.u16, w86_get_word(state, state->registers.cs, offset + 2 + info.size), &c.u16);
+    c.u16 = add_word(state, a.u16, instruction->imm);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   case 0x83: // r/m16 + imm16sbw -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_add_word(a.u16, sbw(w86_get_byte(state, state->registers.cs, offset + 2 + info.size)), &c.u16);
+    c.u16 = add_word(state, a.u16, instruction->imm);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
-  state->registers.flags &= 0b00000111'00000000;
-  state->registers.flags |= flags & 0b11111000'11111111;
-
-  if (first_byte == 0x81) {
-    state->registers.ip = offset + 4;
-  } else if (first_byte == 0x05
-          || first_byte == 0x80
-          || first_byte == 0x82
-          || first_byte == 0x83) {
-    state->registers.ip = offset + 3;
-  } else {
-    state->registers.ip = offset + 2;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_inc(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status inc(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
-  uint16_t flags;
   switch (first_byte) {
     union {
       uint8_t u8;
@@ -514,75 +459,64 @@ enum w86_status w86_instruction_inc(struct w86_cpu_state* state, uint16_t offset
     } a;
 
   case 0x40 | W86_MODRM_REG_AX: // reg16 + 1 -> reg16
-    flags = get_flags_add_word(state->registers.ax, 1, &state->registers.ax);
+    state->registers.ax = inc_word(state, state->registers.ax);
     break;
 
   case 0x40 | W86_MODRM_REG_CX:
-    flags = get_flags_add_word(state->registers.cx, 1, &state->registers.cx);
+    state->registers.cx = inc_word(state, state->registers.cx);
     break;
 
   case 0x40 | W86_MODRM_REG_DX:
-    flags = get_flags_add_word(state->registers.dx, 1, &state->registers.dx);
+    state->registers.dx = inc_word(state, state->registers.dx);
     break;
 
   case 0x40 | W86_MODRM_REG_BX:
-    flags = get_flags_add_word(state->registers.bx, 1, &state->registers.bx);
+    state->registers.bx = inc_word(state, state->registers.bx);
     break;
 
   case 0x40 | W86_MODRM_REG_SP:
-    flags = get_flags_add_word(state->registers.sp, 1, &state->registers.sp);
+    state->registers.sp = inc_word(state, state->registers.sp);
     break;
 
   case 0x40 | W86_MODRM_REG_BP:
-    flags = get_flags_add_word(state->registers.bp, 1, &state->registers.bp);
+    state->registers.bp = inc_word(state, state->registers.bp);
     break;
 
   case 0x40 | W86_MODRM_REG_SI:
-    flags = get_flags_add_word(state->registers.si, 1, &state->registers.si);
+    state->registers.si = inc_word(state, state->registers.si);
     break;
 
   case 0x40 | W86_MODRM_REG_DI:
-    flags = get_flags_add_word(state->registers.di, 1, &state->registers.di);
+    state->registers.di = inc_word(state, state->registers.di);
     break;
 
   case 0xfe: // r/m8 + 1 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_byte(state, info, &a.u8);
-    flags = get_flags_add_byte(a.u8, 1, &a.u8);
+    a.u8 = inc_byte(state, a.u8);
     w86_modrm_set_rm_byte(state, info, a.u8);
     break;
 
   case 0xff: // r/m16 + 1 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b000) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_add_word(a.u16, 1, &a.u16);
+    a.u16 = inc_word(state, a.u16);
     w86_modrm_set_rm_word(state, info, a.u16);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
-  state->registers.flags &= 0b00000111'00000001;
-  state->registers.flags |= flags & 0b11111000'11111110;
-
-  if (first_byte == 0xfe
-   || first_byte == 0xff) {
-    state->registers.ip = offset + 2;
-  } else {
-    state->registers.ip = offset + 1;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_sub(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status sub(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
-  uint16_t flags;
   switch (first_byte) {
     union {
       uint8_t u8;
@@ -590,97 +524,82 @@ enum w86_status w86_instruction_sub(struct w86_cpu_state* state, uint16_t offset
     } a, b, c;
 
   case 0x28: // r/m8 - reg8 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_byte(state, info, &a.u8);
     w86_modrm_get_reg_byte(state, info, &b.u8);
-    flags = get_flags_sub_byte(a.u8, b.u8, &c.u8);
+    c.u8 = sub_byte(state, a.u8, b.u8);
     w86_modrm_set_rm_byte(state, info, c.u8);
     break;
 
   case 0x29: // r/m16 - reg16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_word(state, info, &a.u16);
     w86_modrm_get_reg_word(state, info, &b.u16);
-    flags = get_flags_sub_word(a.u16, b.u16, &c.u16);
+    c.u16 = sub_word(state, a.u16, b.u16);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   case 0x2a: // reg8 - r/m8 -> reg8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_byte(state, info, &a.u8);
     w86_modrm_get_rm_byte(state, info, &b.u8);
-    flags = get_flags_sub_byte(a.u8, b.u8, &c.u8);
+    c.u8 = sub_byte(state, a.u8, b.u8);
     w86_modrm_set_reg_byte(state, info, c.u8);
     break;
 
   case 0x2b: // reg16 - r/m16 -> reg16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_word(state, info, &a.u16);
     w86_modrm_get_rm_word(state, info, &b.u16);
-    flags = get_flags_sub_word(a.u16, b.u16, &c.u16);
+    c.u16 = sub_word(state, a.u16, b.u16);
     w86_modrm_set_reg_word(state, info, c.u16);
     break;
 
   case 0x2c: // al - imm8 -> al
-    flags = get_flags_sub_byte(state->registers.ax, w86_get_byte(state, state->registers.cs, offset + 1), &c.u8);
+    c.u8 = sub_byte(state, state->registers.ax, instruction->imm);
     state->registers.ax = c.u8;
     break;
 
   case 0x2d: // ax - imm16 -> ax
-    flags = get_flags_sub_word(state->registers.ax, w86_get_word(state, state->registers.cs, offset + 1), &state->registers.ax);
+    state->registers.ax = sub_word(state, state->registers.ax, instruction->imm);
     break;
 
   case 0x80: // r/m8 - imm8 -> r/m8
   case 0x82:
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b101) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_byte(state, info, &a.u8);
-    flags = get_flags_sub_byte(a.u8, w86_get_byte(state, state->registers.cs, offset + 2 + info.size), &c.u8);
+    c.u8 = sub_byte(state, a.u8, instruction->imm);
     w86_modrm_set_rm_byte(state, info, c.u8);
     break;
 
   case 0x81: // r/m16 - imm16 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b101) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_sub_word(a.u16, w86_get_word(state, state->registers.cs, offset + 2 + info.size), &c.u16);
+    c.u16 = sub_word(state, a.u16, instruction->imm);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   case 0x83: // r/m16 - imm16sbw -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b101) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_sub_word(a.u16, sbw(w86_get_byte(state, state->registers.cs, offset + 2 + info.size)), &c.u16);
+    c.u16 = sub_word(state, a.u16, instruction->imm);
     w86_modrm_set_rm_word(state, info, c.u16);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
-  state->registers.flags &= 0b00000111'00000000;
-  state->registers.flags |= flags & 0b11111000'11111111;
-
-  if (first_byte == 0x81) {
-    state->registers.ip = offset + 4;
-  } else if (first_byte == 0x2d
-          || first_byte == 0x80
-          || first_byte == 0x82
-          || first_byte == 0x83) {
-    state->registers.ip = offset + 3;
-  } else {
-    state->registers.ip = offset + 2;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_dec(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status dec(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
-  uint16_t flags;
   switch (first_byte) {
     union {
       uint8_t u8;
@@ -688,75 +607,64 @@ enum w86_status w86_instruction_dec(struct w86_cpu_state* state, uint16_t offset
     } a;
 
   case 0x48 | W86_MODRM_REG_AX: // reg16 - 1 -> reg16
-    flags = get_flags_sub_word(state->registers.ax, 1, &state->registers.ax);
+    state->registers.ax = dec_word(state, state->registers.ax);
     break;
 
   case 0x48 | W86_MODRM_REG_CX:
-    flags = get_flags_sub_word(state->registers.cx, 1, &state->registers.cx);
+    state->registers.cx = dec_word(state, state->registers.cx);
     break;
 
   case 0x48 | W86_MODRM_REG_DX:
-    flags = get_flags_sub_word(state->registers.dx, 1, &state->registers.dx);
+    state->registers.dx = dec_word(state, state->registers.dx);
     break;
 
   case 0x48 | W86_MODRM_REG_BX:
-    flags = get_flags_sub_word(state->registers.bx, 1, &state->registers.bx);
+    state->registers.bx = dec_word(state, state->registers.bx);
     break;
 
   case 0x48 | W86_MODRM_REG_SP:
-    flags = get_flags_sub_word(state->registers.sp, 1, &state->registers.sp);
+    state->registers.sp = dec_word(state, state->registers.sp);
     break;
 
   case 0x48 | W86_MODRM_REG_BP:
-    flags = get_flags_sub_word(state->registers.bp, 1, &state->registers.bp);
+    state->registers.bp = dec_word(state, state->registers.bp);
     break;
 
   case 0x48 | W86_MODRM_REG_SI:
-    flags = get_flags_sub_word(state->registers.si, 1, &state->registers.si);
+    state->registers.si = dec_word(state, state->registers.si);
     break;
 
   case 0x48 | W86_MODRM_REG_DI:
-    flags = get_flags_sub_word(state->registers.di, 1, &state->registers.di);
+    state->registers.di = dec_word(state, state->registers.di);
     break;
 
   case 0xfe: // r/m8 - 1 -> r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b001) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_byte(state, info, &a.u8);
-    flags = get_flags_sub_byte(a.u8, 1, &a.u8);
+    a.u8 = dec_byte(state, a.u8);
     w86_modrm_set_rm_byte(state, info, a.u8);
     break;
 
   case 0xff: // r/m16 - 1 -> r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b001) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_sub_word(a.u16, 1, &a.u16);
+    a.u16 = dec_word(state, a.u16);
     w86_modrm_set_rm_word(state, info, a.u16);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
-  state->registers.flags &= 0b00000111'00000001;
-  state->registers.flags |= flags & 0b11111000'11111110;
-
-  if (first_byte == 0xfe
-   || first_byte == 0xff) {
-    state->registers.ip = offset + 2;
-  } else {
-    state->registers.ip = offset + 1;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_cmp(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status cmp(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   struct w86_modrm_info info = {};
 
-  uint16_t flags;
   switch (first_byte) {
     union {
       uint8_t u8;
@@ -764,98 +672,86 @@ enum w86_status w86_instruction_cmp(struct w86_cpu_state* state, uint16_t offset
     } a, b;
 
   case 0x38: // r/m8 - reg8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_byte(state, info, &a.u8);
     w86_modrm_get_reg_byte(state, info, &b.u8);
-    flags = get_flags_sub_byte(a.u8, b.u8, nullptr);
+    sub_byte(state, a.u8, b.u8);
     break;
 
   case 0x39: // r/m16 - reg16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_rm_word(state, info, &a.u16);
     w86_modrm_get_reg_word(state, info, &b.u16);
-    flags = get_flags_sub_word(a.u16, b.u16, nullptr);
+    sub_word(state, a.u16, b.u16);
     break;
 
   case 0x3a: // reg8 - r/m8
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_byte(state, info, &a.u8);
     w86_modrm_get_rm_byte(state, info, &b.u8);
-    flags = get_flags_sub_byte(a.u8, b.u8, nullptr);
+    sub_byte(state, a.u8, b.u8);
     break;
 
   case 0x3b: // reg16 - r/m16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     w86_modrm_get_reg_word(state, info, &a.u16);
     w86_modrm_get_rm_word(state, info, &b.u16);
-    flags = get_flags_sub_word(a.u16, b.u16, nullptr);
+    sub_word(state, a.u16, b.u16);
     break;
 
   case 0x3c: // al - imm8
-    flags = get_flags_sub_byte(state->registers.ax, w86_get_byte(state, state->registers.cs, offset + 1), nullptr);
+    sub_byte(state, state->registers.ax, instruction->imm);
     break;
 
   case 0x3d: // ax - imm16
-    flags = get_flags_sub_word(state->registers.ax, w86_get_word(state, state->registers.cs, offset + 1), nullptr);
+    sub_word(state, state->registers.ax, instruction->imm);
     break;
 
   case 0x80: // r/m8 - imm8
   case 0x82:
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b111) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_byte(state, info, &a.u8);
-    flags = get_flags_sub_byte(a.u8, w86_get_byte(state, state->registers.cs, offset + 2 + info.size), nullptr);
+    sub_byte(state, a.u8, instruction->imm);
     break;
 
   case 0x81: // r/m16 - imm16
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b111) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_sub_word(a.u16, w86_get_word(state, state->registers.cs, offset + 2 + info.size), nullptr);
+    sub_word(state, a.u16, instruction->imm);
     break;
 
   case 0x83: // r/m16 - imm16sbw
-    info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    info = w86_modrm_parse(state, instruction);
     if (info.reg != 0b111) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &a.u16);
-    flags = get_flags_sub_word(a.u16, sbw(w86_get_byte(state, state->registers.cs, offset + 2 + info.size)), nullptr);
+    sub_word(state, a.u16, instruction->imm);
     break;
 
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
-  state->registers.flags &= 0b00000111'00000000;
-  state->registers.flags |= flags & 0b11111000'11111111;
-
-  if (first_byte == 0x81) {
-    state->registers.ip = offset + 4;
-  } else if (first_byte == 0x3d
-          || first_byte == 0x80
-          || first_byte == 0x82
-          || first_byte == 0x83) {
-    state->registers.ip = offset + 3;
-  } else {
-    state->registers.ip = offset + 2;
-  }
-  state->registers.ip += info.size;
+  state->registers.ip += instruction->size;
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_call(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  switch (w86_get_byte(state, state->registers.cs, offset)) {
+static inline enum w86_status call(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  switch (first_byte) {
   case 0x9a: // far call
     state->registers.sp -= 4;
-    w86_set_word(state, state->registers.ss, state->registers.sp, offset + 5);
-    state->registers.ip = w86_get_word(state, state->registers.cs, offset + 1);
-    w86_set_word(state, state->registers.ss, state->registers.sp + 2, state->registers.cs);
-    state->registers.cs = w86_get_word(state, state->registers.cs, offset + 3);
+    w86_set_word(state, state->bases.ss, state->registers.sp, state->registers.ip + instruction->size);
+    state->registers.ip = instruction->imm;
+    w86_set_word(state, state->bases.ss, state->registers.sp + 2, state->registers.cs);
+    state->registers.cs = instruction->imm2;
+    w86_segments_update(state);
     break;
 
   case 0xe8: // near call
     state->registers.sp -= 2;
-    w86_set_word(state, state->registers.ss, state->registers.sp, offset + 3);
-    state->registers.ip += (int16_t) w86_get_word(state, state->registers.cs, offset + 1) + 3;
+    w86_set_word(state, state->bases.ss, state->registers.sp, state->registers.ip + instruction->size);
+    state->registers.ip += instruction->size + instruction->imm;
     break;
   
   case 0xff: // indirect call
@@ -864,23 +760,24 @@ enum w86_status w86_instruction_call(struct w86_cpu_state* state, uint16_t offse
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
+  if (state->profile) w86_profile_call(state);
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_ret(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status ret(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   switch (first_byte) {
   case 0xc2: // near return with imm16
   case 0xc3: // near return
   case 0xca: // far return with imm16
   case 0xcb: // far return
-    uint16_t pop = !(first_byte & 0b00000001) ? w86_get_word(state, state->registers.cs, offset + 1) : 0;
-    state->registers.ip = w86_get_word(state, state->registers.ss, state->registers.sp);
+    uint16_t pop = !(first_byte & 0b00000001) ? instruction->imm : 0;
+    state->registers.ip = w86_get_word(state, state->bases.ss, state->registers.sp);
     state->registers.sp += 2;
     if (first_byte & 0b00001000) {
-      state->registers.cs = w86_get_word(state, state->registers.ss, state->registers.sp);
+      state->registers.cs = w86_get_word(state, state->bases.ss, state->registers.sp);
       state->registers.sp += 2;
+      w86_segments_update(state);
     }
     state->registers.sp += pop;
     break;
@@ -888,32 +785,32 @@ enum w86_status w86_instruction_ret(struct w86_cpu_state* state, uint16_t offset
   default:
     return W86_STATUS_INVALID_OPERATION;
   }
+  if (state->profile) w86_profile_ret(state);
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_jmp(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes) {
-  switch (w86_get_byte(state, state->registers.cs, offset)) {
+static inline enum w86_status jmp(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  switch (first_byte) {
   case 0xe9: // near jump
-    state->registers.ip += (int16_t) w86_get_word(state, state->registers.cs, offset + 1) + 3;
+  case 0xeb: // short jump
+    state->registers.ip += instruction->size + instruction->imm;
     break;
 
   case 0xea: // far jump
-    state->registers.ip = w86_get_word(state, state->registers.cs, offset + 1);
-    state->registers.cs = w86_get_word(state, state->registers.cs, offset + 3);
-    break;
-
-  case 0xeb: // short jump
-    state->registers.ip += (int8_t) w86_get_byte(state, state->registers.cs, offset + 1) + 2;
+    state->registers.ip = instruction->imm;
+    state->registers.cs = instruction->imm2;
+    w86_segments_update(state);
     break;
 
   case 0xff: // indirect jump
-    struct w86_modrm_info info = w86_modrm_parse(state, offset + 1, prefixes.segment);
+    struct w86_modrm_info info = w86_modrm_parse(state, instruction);
     if ((info.reg != 0b100 && info.reg != 0b101) || (info.reg == 0b101 && info.rm_is_reg)) return W86_STATUS_INVALID_OPERATION;
     w86_modrm_get_rm_word(state, info, &state->registers.ip);
     if (info.reg == 0b101) {
       info.address += 2;
       w86_modrm_get_rm_word(state, info, &state->registers.cs);
+      w86_segments_update(state);
     }
     break;
 
@@ -924,79 +821,353 @@ enum w86_status w86_instruction_jmp(struct w86_cpu_state* state, uint16_t offset
   return W86_STATUS_SUCCESS;
 }
 
-// look ma, no switch statements!
-enum w86_status w86_instruction_jcc(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  uint8_t first_byte = w86_get_byte(state, state->registers.cs, offset);
+static inline enum w86_status jcc(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
   if ((first_byte & 0b11110000) != 0x70) return W86_STATUS_INVALID_OPERATION;
 
-  // create flags bitmask
-  uint16_t cond = (~first_byte >> 3 &                     first_byte >> 1  & 0b00000000'00000001) // cf
-                | ( first_byte >> 1 & ~first_byte      &  first_byte << 1  & 0b00000000'00000100) // pf
-                | (~first_byte << 3 &  first_byte << 4                     & 0b00000000'01000000) // zf
-                | (                    first_byte << 4 &  first_byte << 5  & 0b00000000'01000000)
-                | ( first_byte << 4 &  first_byte << 5                     & 0b00000000'10000000) // sf
-                | (~first_byte << 8 & ~first_byte << 9 & ~first_byte << 10 & 0b00001000'00000000) // of
-                | ( first_byte << 8 &  first_byte << 9                     & 0b00001000'00000000);
-  cond &= state->registers.flags;
-  state->registers.ip = offset + 2;
-  if ((((cond >> 11 ^ cond >> 7) | cond >> 6 | cond >> 2 | cond) ^ first_byte) & 1) {
-    state->registers.ip += (int8_t) w86_get_byte(state, state->registers.cs, offset + 1);
+  state->registers.ip += instruction->size;
+  if (w86_flags_condition(state, first_byte & 0b00001111)) {
+    state->registers.ip += instruction->imm;
+    state->cycles += 12; // 16 taken, the table has the 4 for falling through
+  }
+
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status interrupt(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  switch (first_byte) {
+  case 0xcc: // int3
+    state->registers.ip += instruction->size;
+    w86_interrupt(state, 3);
+    break;
+
+  case 0xcd: // int imm8
+    state->registers.ip += instruction->size;
+    w86_interrupt(state, instruction->imm);
+    break;
+
+  case 0xce: // into
+    state->registers.ip += instruction->size;
+    if (!(w86_flags_get(state) & W86_FLAGS_OF)) break;
+    state->cycles += 49; // 53 taken, the table has the 4 for falling through
+    w86_interrupt(state, 4);
+    break;
+
+  default:
+    return W86_STATUS_INVALID_OPERATION;
   }
 
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_clc(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xf8) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status iret(struct w86_cpu_state* state, [[maybe_unused]] const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xcf) return W86_STATUS_INVALID_OPERATION;
+  state->registers.ip = w86_get_word(state, state->bases.ss, state->registers.sp);
+  state->registers.cs = w86_get_word(state, state->bases.ss, state->registers.sp + 2);
+  state->registers.flags = w86_get_word(state, state->bases.ss, state->registers.sp + 4);
+  state->registers.sp += 6;
+  state->lazy_flags.op = W86_FLAGS_OP_NONE;
+  w86_segments_update(state);
+  if (state->profile) w86_profile_ret(state);
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status clc(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xf8) return W86_STATUS_INVALID_OPERATION;
+  w86_flags_materialize(state);
   state->registers.flags &= 0b11111111'11111110;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_cmc(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xf5) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status cmc(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xf5) return W86_STATUS_INVALID_OPERATION;
+  w86_flags_materialize(state);
   state->registers.flags ^= 0b00000000'00000001;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_stc(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xf9) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status stc(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xf9) return W86_STATUS_INVALID_OPERATION;
+  w86_flags_materialize(state);
   state->registers.flags |= 0b00000000'00000001;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_cli(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xfa) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status cli(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xfa) return W86_STATUS_INVALID_OPERATION;
   state->registers.flags &= 0b11111101'11111111;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_sti(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xfb) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status sti(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xfb) return W86_STATUS_INVALID_OPERATION;
   state->registers.flags |= 0b00000010'00000000;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_cld(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xfc) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status cld(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xfc) return W86_STATUS_INVALID_OPERATION;
   state->registers.flags &= 0b11111011'11111111;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_std(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xfd) return W86_STATUS_INVALID_OPERATION;
+static inline enum w86_status std(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xfd) return W86_STATUS_INVALID_OPERATION;
   state->registers.flags |= 0b00000100'00000000;
-  state->registers.ip = offset + 1;
+  state->registers.ip += instruction->size;
   return W86_STATUS_SUCCESS;
 }
 
-enum w86_status w86_instruction_hlt(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes) {
-  if (w86_get_byte(state, state->registers.cs, offset) != 0xf4) return W86_STATUS_INVALID_OPERATION;
-  state->registers.ip = offset + 1;
+// string instructions, with a rep prefix they run cx times in one go
+// a rep over a range that stays inside its segment and in plain memory is done in bulk, anything else an element at a time
+
+// the table has what a single one costs, with rep it's 9 to start and then so much per element instead
+static inline void repeat_cycles(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint32_t per_element, uint32_t elements) {
+  if (instruction->prefixes.repeat) state->cycles = state->cycles - instruction->cycles + 9 + (uint64_t) per_element * elements;
+}
+
+static inline uint16_t string_load(struct w86_cpu_state* state, bool word, uint32_t base, uint16_t pointer) {
+  return word ? w86_get_word(state, base, pointer) : w86_get_byte(state, base, pointer);
+}
+
+static inline void string_store(struct w86_cpu_state* state, bool word, uint32_t base, uint16_t pointer, uint16_t value) {
+  if (word) {
+    w86_set_word(state, base, pointer, value);
+  } else {
+    w86_set_byte(state, base, pointer, value);
+  }
+}
+
+static inline uint16_t host_element(const uint8_t* host, bool word) {
+  return word ? host[0] | host[1] << 8 : host[0];
+}
+
+// lowest offset of the elements walked from pointer, negative if they wrap around the segment
+static inline int32_t string_low(uint16_t pointer, uint32_t bytes, uint16_t size, bool down) {
+  int32_t low = down ? pointer + size - (int32_t) bytes : pointer;
+  return low + bytes > 1 << W86_REAL_POINTER_SIZE ? -1 : low;
+}
+
+// where the i-th element walked sits in a span starting at the lowest offset
+static inline uint32_t string_offset(uint32_t i, uint32_t bytes, uint16_t size, bool down) {
+  return down ? bytes - size - i * size : i * size;
+}
+
+static inline enum w86_status movs(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if ((first_byte & 0b11111110) != 0xa4) return W86_STATUS_INVALID_OPERATION;
+
+  bool word = first_byte & 0b00000001;
+  bool down = state->registers.flags & W86_FLAGS_DF;
+  uint16_t size = word ? 2 : 1;
+  uint16_t step = down ? -size : size;
+  uint32_t source = get_segment_base(state, instruction->prefixes.segment);
+  uint32_t count = instruction->prefixes.repeat ? state->registers.cx : 1;
+  uint32_t bytes = count * size;
+
+  int32_t from_low = string_low(state->registers.si, bytes, size, down);
+  int32_t to_low = string_low(state->registers.di, bytes, size, down);
+  // memmove matches the 8086 unless the destination runs into source bytes that haven't been read yet
+  uint32_t from_address = W86_LINEAR_ADDRESS(source, from_low);
+  uint32_t to_address = W86_LINEAR_ADDRESS(state->bases.es, to_low);
+  bool overlap = down ? to_address < from_address && to_address + bytes > from_address
+                      : to_address > from_address && to_address < from_address + bytes;
+  if (count > 1 && from_low >= 0 && to_low >= 0 && !overlap) {
+    const uint8_t* from = w86_span_read(state, source, from_low, bytes);
+    uint8_t* to = from ? w86_span_write(state, state->bases.es, to_low, bytes) : nullptr;
+    if (to) {
+      memmove(to, from, bytes);
+      w86_span_written(state, state->bases.es, to_low, bytes);
+      state->registers.si += step * count;
+      state->registers.di += step * count;
+      state->registers.cx = 0;
+      state->registers.ip += instruction->size;
+      repeat_cycles(state, instruction, 17, count);
+      return W86_STATUS_SUCCESS;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    string_store(state, word, state->bases.es, state->registers.di, string_load(state, word, source, state->registers.si));
+    state->registers.si += step;
+    state->registers.di += step;
+  }
+  if (instruction->prefixes.repeat) state->registers.cx = 0;
+  repeat_cycles(state, instruction, 17, count);
+
+  state->registers.ip += instruction->size;
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status stos(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if ((first_byte & 0b11111110) != 0xaa) return W86_STATUS_INVALID_OPERATION;
+
+  bool word = first_byte & 0b00000001;
+  bool down = state->registers.flags & W86_FLAGS_DF;
+  uint16_t size = word ? 2 : 1;
+  uint16_t step = down ? -size : size;
+  uint32_t count = instruction->prefixes.repeat ? state->registers.cx : 1;
+  uint32_t bytes = count * size;
+
+  int32_t to_low = string_low(state->registers.di, bytes, size, down);
+  uint8_t* to = count > 1 && to_low >= 0 ? w86_span_write(state, state->bases.es, to_low, bytes) : nullptr;
+  if (to) {
+    if (word) {
+      for (uint32_t i = 0; i < bytes; i += 2) {
+        to[i] = state->registers.ax;
+        to[i + 1] = state->registers.ax >> 8;
+      }
+    } else {
+      memset(to, state->registers.ax & 0xff, bytes);
+    }
+    w86_span_written(state, state->bases.es, to_low, bytes);
+    state->registers.di += step * count;
+  } else {
+    for (uint32_t i = 0; i < count; i++) {
+      string_store(state, word, state->bases.es, state->registers.di, state->registers.ax);
+      state->registers.di += step;
+    }
+  }
+  if (instruction->prefixes.repeat) state->registers.cx = 0;
+  repeat_cycles(state, instruction, 10, count);
+
+  state->registers.ip += instruction->size;
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status lods(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if ((first_byte & 0b11111110) != 0xac) return W86_STATUS_INVALID_OPERATION;
+
+  bool word = first_byte & 0b00000001;
+  bool down = state->registers.flags & W86_FLAGS_DF;
+  uint16_t size = word ? 2 : 1;
+  uint16_t step = down ? -size : size;
+  uint32_t source = get_segment_base(state, instruction->prefixes.segment);
+  uint32_t count = instruction->prefixes.repeat ? state->registers.cx : 1;
+  uint32_t bytes = count * size;
+
+  // reading plain memory has no side effects, so only the last element matters
+  int32_t from_low = string_low(state->registers.si, bytes, size, down);
+  repeat_cycles(state, instruction, 13, count);
+  if (count > 1 && from_low >= 0 && w86_span_read(state, source, from_low, bytes)) {
+    state->registers.si += step * (count - 1);
+    count = 1;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint16_t value = string_load(state, word, source, state->registers.si);
+    state->registers.ax = word ? value : (state->registers.ax & 0xff00) | value;
+    state->registers.si += step;
+  }
+  if (instruction->prefixes.repeat) state->registers.cx = 0;
+
+  state->registers.ip += instruction->size;
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status cmps(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if ((first_byte & 0b11111110) != 0xa6) return W86_STATUS_INVALID_OPERATION;
+
+  bool word = first_byte & 0b00000001;
+  bool down = state->registers.flags & W86_FLAGS_DF;
+  uint16_t size = word ? 2 : 1;
+  uint16_t step = down ? -size : size;
+  uint32_t source = get_segment_base(state, instruction->prefixes.segment);
+  uint32_t count = instruction->prefixes.repeat ? state->registers.cx : 1;
+  uint32_t bytes = count * size;
+  bool until_equal = instruction->prefixes.repeat == W86_REPEAT_PREFIX_REPNE; // repe stops at the first difference instead
+
+  int32_t from_low = string_low(state->registers.si, bytes, size, down);
+  int32_t to_low = string_low(state->registers.di, bytes, size, down);
+  const uint8_t* from = count > 1 && from_low >= 0 ? w86_span_read(state, source, from_low, bytes) : nullptr;
+  const uint8_t* to = count > 1 && to_low >= 0 ? w86_span_read(state, state->bases.es, to_low, bytes) : nullptr;
+  uint32_t done = 0;
+  if (from && to) {
+    uint32_t i = 0;
+    for (; i < count - 1; i++) {
+      uint32_t offset = string_offset(i, bytes, size, down);
+      if ((host_element(from + offset, word) == host_element(to + offset, word)) == until_equal) break;
+    }
+    uint32_t offset = string_offset(i, bytes, size, down);
+    uint16_t a = host_element(from + offset, word), b = host_element(to + offset, word);
+    if (word) sub_word(state, a, b); else sub_byte(state, a, b);
+    done = i + 1;
+  } else {
+    while (done < count) {
+      uint16_t a = string_load(state, word, source, state->registers.si + step * done);
+      uint16_t b = string_load(state, word, state->bases.es, state->registers.di + step * done);
+      if (word) sub_word(state, a, b); else sub_byte(state, a, b);
+      done++;
+      if (instruction->prefixes.repeat && (a == b) == until_equal) break;
+    }
+  }
+  state->registers.si += step * done;
+  state->registers.di += step * done;
+  if (instruction->prefixes.repeat) state->registers.cx -= done;
+  repeat_cycles(state, instruction, 22, done);
+
+  state->registers.ip += instruction->size;
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status scas(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if ((first_byte & 0b11111110) != 0xae) return W86_STATUS_INVALID_OPERATION;
+
+  bool word = first_byte & 0b00000001;
+  bool down = state->registers.flags & W86_FLAGS_DF;
+  uint16_t size = word ? 2 : 1;
+  uint16_t step = down ? -size : size;
+  uint32_t count = instruction->prefixes.repeat ? state->registers.cx : 1;
+  uint32_t bytes = count * size;
+  bool until_equal = instruction->prefixes.repeat == W86_REPEAT_PREFIX_REPNE;
+  uint16_t a = word ? state->registers.ax : state->registers.ax & 0xff;
+
+  int32_t to_low = string_low(state->registers.di, bytes, size, down);
+  const uint8_t* to = count > 1 && to_low >= 0 ? w86_span_read(state, state->bases.es, to_low, bytes) : nullptr;
+  uint32_t done = 0;
+  if (to) {
+    uint32_t i = 0;
+    if (until_equal && !word && !down) { // repne scasb, the classic strlen
+      const uint8_t* hit = memchr(to, a, count - 1);
+      i = hit ? hit - to : count - 1;
+    } else {
+      for (; i < count - 1; i++) {
+        if ((host_element(to + string_offset(i, bytes, size, down), word) == a) == until_equal) break;
+      }
+    }
+    uint16_t b = host_element(to + string_offset(i, bytes, size, down), word);
+    if (word) sub_word(state, a, b); else sub_byte(state, a, b);
+    done = i + 1;
+  } else {
+    while (done < count) {
+      uint16_t b = string_load(state, word, state->bases.es, state->registers.di + step * done);
+      if (word) sub_word(state, a, b); else sub_byte(state, a, b);
+      done++;
+      if (instruction->prefixes.repeat && (a == b) == until_equal) break;
+    }
+  }
+  state->registers.di += step * done;
+  if (instruction->prefixes.repeat) state->registers.cx -= done;
+  repeat_cycles(state, instruction, 15, done);
+
+  state->registers.ip += instruction->size;
+  return W86_STATUS_SUCCESS;
+}
+
+static inline enum w86_status hlt(struct w86_cpu_state* state, const struct w86_instruction_info* instruction, uint8_t first_byte) {
+  if (first_byte != 0xf4) return W86_STATUS_INVALID_OPERATION;
+  state->registers.ip += instruction->size;
   return W86_STATUS_HALT;
 }
+
+// every opcode gets its own copy of its family's handler with the opcode baked in, so the switch on it folds away
+#define W86_INSTRUCTION_DEFINE(family, opcode) \
+  enum w86_status w86_instruction_##family##_##opcode(struct w86_cpu_state* state, const struct w86_instruction_info* instruction) { \
+    return family(state, instruction, opcode); \
+  }
+
+W86_INSTRUCTION_OPCODES(W86_INSTRUCTION_DEFINE)
@@ -12,34 +12,50 @@ extern "C" {
 #include "decode.h"
 #include "w86.h"
 
-typedef enum w86_status w86_instruction(struct w86_cpu_state* state, uint16_t offset, struct w86_instruction_prefixes prefixes);
-
-// these are functions
-w86_instruction w86_instruction_mov;
-w86_instruction w86_instruction_xchg;
-w86_instruction w86_instruction_in;
-w86_instruction w86_instruction_out;
-
-w86_instruction w86_instruction_add;
-w86_instruction w86_instruction_inc;
-w86_instruction w86_instruction_sub;
-w86_instruction w86_instruction_dec;
-w86_instruction w86_instruction_cmp;
-
-w86_instruction w86_instruction_call;
-w86_instruction w86_instruction_ret;
-w86_instruction w86_instruction_jmp;
-w86_instruction w86_instruction_jcc;
-
-w86_instruction w86_instruction_clc;
-w86_instruction w86_instruction_cmc;
-w86_instruction w86_instruction_stc;
-w86_instruction w86_instruction_cli;
-w86_instruction w86_instruction_sti;
-w86_instruction w86_instruction_cld;
-w86_instruction w86_instruction_std;
-
-w86_instruction w86_instruction_hlt;
+// every implemented opcode along with the family that handles it, group opcodes show up once per family
+#define W86_INSTRUCTION_OPCODES(X) \
+  X(mov, 0x88) X(mov, 0x89) X(mov, 0x8a) X(mov, 0x8b) X(mov, 0x8c) X(mov, 0x8e) X(mov, 0xa0) X(mov, 0xa1) \
+  X(mov, 0xa2) X(mov, 0xa3) X(mov, 0xb0) X(mov, 0xb1) X(mov, 0xb2) X(mov, 0xb3) X(mov, 0xb4) X(mov, 0xb5) \
+  X(mov, 0xb6) X(mov, 0xb7) X(mov, 0xb8) X(mov, 0xb9) X(mov, 0xba) X(mov, 0xbb) X(mov, 0xbc) X(mov, 0xbd) \
+  X(mov, 0xbe) X(mov, 0xbf) X(mov, 0xc6) X(mov, 0xc7) \
+  X(xchg, 0x86) X(xchg, 0x87) X(xchg, 0x90) X(xchg, 0x91) X(xchg, 0x92) X(xchg, 0x93) X(xchg, 0x94) X(xchg, 0x95) \
+  X(xchg, 0x96) X(xchg, 0x97) \
+  X(in, 0xe4) X(in, 0xe5) X(in, 0xec) X(in, 0xed) \
+  X(out, 0xe6) X(out, 0xe7) X(out, 0xee) X(out, 0xef) \
+  X(add, 0x00) X(add, 0x01) X(add, 0x02) X(add, 0x03) X(add, 0x04) X(add, 0x05) X(add, 0x80) X(add, 0x81) \
+  X(add, 0x82) X(add, 0x83) \
+  X(inc, 0x40) X(inc, 0x41) X(inc, 0x42) X(inc, 0x43) X(inc, 0x44) X(inc, 0x45) X(inc, 0x46) X(inc, 0x47) \
+  X(inc, 0xfe) X(inc, 0xff) \
+  X(sub, 0x28) X(sub, 0x29) X(sub, 0x2a) X(sub, 0x2b) X(sub, 0x2c) X(sub, 0x2d) X(sub, 0x80) X(sub, 0x81) \
+  X(sub, 0x82) X(sub, 0x83) \
+  X(dec, 0x48) X(dec, 0x49) X(dec, 0x4a) X(dec, 0x4b) X(dec, 0x4c) X(dec, 0x4d) X(dec, 0x4e) X(dec, 0x4f) \
+  X(dec, 0xfe) X(dec, 0xff) \
+  X(cmp, 0x38) X(cmp, 0x39) X(cmp, 0x3a) X(cmp, 0x3b) X(cmp, 0x3c) X(cmp, 0x3d) X(cmp, 0x80) X(cmp, 0x81) \
+  X(cmp, 0x82) X(cmp, 0x83) \
+  X(call, 0x9a) X(call, 0xe8) \
+  X(ret, 0xc2) X(ret, 0xc3) X(ret, 0xca) X(ret, 0xcb) \
+  X(jmp, 0xe9) X(jmp, 0xea) X(jmp, 0xeb) X(jmp, 0xff) \
+  X(jcc, 0x70) X(jcc, 0x71) X(jcc, 0x72) X(jcc, 0x73) X(jcc, 0x74) X(jcc, 0x75) X(jcc, 0x76) X(jcc, 0x77) \
+  X(jcc, 0x78) X(jcc, 0x79) X(jcc, 0x7a) X(jcc, 0x7b) X(jcc, 0x7c) X(jcc, 0x7d) X(jcc, 0x7e) X(jcc, 0x7f) \
+  X(interrupt, 0xcc) X(interrupt, 0xcd) X(interrupt, 0xce) \
+  X(iret, 0xcf) \
+  X(clc, 0xf8) \
+  X(cmc, 0xf5) \
+  X(stc, 0xf9) \
+  X(cli, 0xfa) \
+  X(sti, 0xfb) \
+  X(cld, 0xfc) \
+  X(std, 0xfd) \
+  X(movs, 0xa4) X(movs, 0xa5) \
+  X(cmps, 0xa6) X(cmps, 0xa7) \
+  X(stos, 0xaa) X(stos, 0xab) \
+  X(lods, 0xac) X(lods, 0xad) \
+  X(scas, 0xae) X(scas, 0xaf) \
+  X(hlt, 0xf4)
+
+// these are functions, named like w86_instruction_mov_0x88
+#define W86_INSTRUCTION_DECLARE(family, opcode) w86_instruction w86_instruction_##family##_##opcode;
+W86_INSTRUCTION_OPCODES(W86_INSTRUCTION_DECLARE)
 
 #ifdef __cplusplus
 }
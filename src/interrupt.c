@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "interrupt.h"
+
+#include <stdint.h>
+
+#include "address.h"
+#include "flags.h"
+#include "profile.h"
+#include "w86.h"
+
+// pushes flags, cs and ip, clears if and tf and goes through the vector table at 0000:0000
+// ip has to be past the instruction already, hardware interrupts only ever come in between them
+void w86_interrupt(struct w86_cpu_state* state, uint8_t vector) {
+  w86_flags_materialize(state);
+  state->registers.sp -= 6;
+  w86_set_word(state, state->bases.ss, state->registers.sp + 4, state->registers.flags);
+  w86_set_word(state, state->bases.ss, state->registers.sp + 2, state->registers.cs);
+  w86_set_word(state, state->bases.ss, state->registers.sp, state->registers.ip);
+  state->registers.flags &= ~(W86_FLAGS_IF | W86_FLAGS_TF);
+
+  state->registers.ip = w86_get_word(state, 0, vector * 4);
+  state->registers.cs = w86_get_word(state, 0, vector * 4 + 2);
+  w86_segments_update(state);
+  if (state->profile) w86_profile_call(state);
+}
@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_INTERRUPT_H_
+#define W86_INTERRUPT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+void w86_interrupt(struct w86_cpu_state* state, uint8_t vector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_INTERRUPT_H_ */
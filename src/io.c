@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "io.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "w86.h"
+
+static void flush_device(struct w86_cpu_state* state, uint8_t index) {
+  struct w86_io_queue* queue = &state->io_devices.queues[index];
+  if (!queue->count) return;
+
+  const struct w86_io_device* device = &state->io_devices.devices[index];
+  device->flush(device->context, queue->writes, queue->count);
+  queue->count = 0;
+}
+
+// ports first to first + count - 1 go to the device from now on, false once every slot or the room for state is taken
+bool w86_io_map(struct w86_cpu_state* state, uint16_t first, uint32_t count, struct w86_io_device device) {
+  struct w86_io_devices* devices = &state->io_devices;
+  if (devices->count == W86_IO_DEVICE_COUNT || count > (uint32_t) (1 << 16) - first) return false;
+  if (device.size > W86_IO_STATE_SIZE - devices->size) return false;
+
+  devices->devices[devices->count] = device;
+  devices->queues[devices->count].count = 0;
+  devices->count++;
+  devices->size += device.size;
+  memset(&devices->ports[first], devices->count, count);
+
+  return true;
+}
+
+// back to plain arrays, whatever is still queued gets delivered first
+void w86_io_reset(struct w86_cpu_state* state) {
+  w86_io_flush(state);
+  memset(state->io_devices.ports, 0, sizeof(state->io_devices.ports));
+  state->io_devices.count = 0;
+  state->io_devices.size = 0;
+}
+
+void w86_io_flush(struct w86_cpu_state* state) {
+  for (uint8_t i = 0; i < state->io_devices.count; i++) flush_device(state, i);
+}
+
+// a history can't replay what a device did, it starts over once the slice that used one is done
+static inline void touch(struct w86_cpu_state* state) {
+  if (state->history) state->history->devices = true;
+}
+
+// a device sees its own queued writes before it has to answer a read
+uint8_t w86_io_device_read(struct w86_cpu_state* state, uint8_t index, uint16_t port) {
+  const struct w86_io_device* device = &state->io_devices.devices[index];
+  if (!device->read) return state->io.reads[port];
+
+  touch(state);
+  if (device->flush) flush_device(state, index);
+  return device->read(device->context, port);
+}
+
+// false if the device doesn't take writes and the port's array should
+bool w86_io_device_write(struct w86_cpu_state* state, uint8_t index, uint16_t port, uint8_t value) {
+  const struct w86_io_device* device = &state->io_devices.devices[index];
+  if (!device->flush && !device->write) return false;
+
+  touch(state);
+  if (device->flush) {
+    struct w86_io_queue* queue = &state->io_devices.queues[index];
+    queue->writes[queue->count++] = (struct w86_io_write_record) { .port = port, .value = value };
+    if (queue->count == W86_IO_QUEUE_SIZE) flush_device(state, index);
+    return true;
+  }
+
+  device->write(device->context, port, value);
+  return true;
+}
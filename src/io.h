@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_IO_H_
+#define W86_IO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+bool w86_io_map(struct w86_cpu_state* state, uint16_t first, uint32_t count, struct w86_io_device device);
+void w86_io_reset(struct w86_cpu_state* state);
+void w86_io_flush(struct w86_cpu_state* state);
+
+uint8_t w86_io_device_read(struct w86_cpu_state* state, uint8_t index, uint16_t port);
+bool w86_io_device_write(struct w86_cpu_state* state, uint8_t index, uint16_t port, uint8_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_IO_H_ */
@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "jit.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decode.h"
+#include "modrm.h"
+#include "w86.h"
+
+#ifdef __EMSCRIPTEN__
+
+#include <emscripten.h>
+
+// hot blocks get compiled into tiny wasm modules that share our memory and function table
+// simple register moves are emitted inline, everything else calls the interpreter's handler through the table
+// the generated function returns how many of the block's instructions it retired
+
+EM_JS(w86_jit_function*, w86_jit_instantiate, (const uint8_t* code, size_t size), {
+  if (!Module["w86JitInstantiate"]) return 0;
+  return Module["w86JitInstantiate"](HEAPU8.slice(code, code + size), wasmMemory, wasmTable);
+});
+
+EM_JS(void, w86_jit_free, (w86_jit_function* function), {
+  if (Module["w86JitRelease"]) Module["w86JitRelease"](function);
+});
+
+enum wasm_opcode {
+  WASM_IF = 0x04,
+  WASM_END = 0x0b,
+  WASM_RETURN = 0x0f,
+  WASM_CALL_INDIRECT = 0x11,
+  WASM_LOCAL_GET = 0x20,
+  WASM_I32_LOAD = 0x28,
+  WASM_I32_LOAD8_U = 0x2d,
+  WASM_I32_LOAD16_U = 0x2f,
+  WASM_I32_STORE8 = 0x3a,
+  WASM_I32_STORE16 = 0x3b,
+  WASM_I32_CONST = 0x41,
+  WASM_I32_NE = 0x47,
+  WASM_I32_ADD = 0x6a
+};
+
+struct buffer {
+  uint8_t data[W86_JIT_BUFFER_SIZE];
+  size_t size;
+};
+
+static void emit_byte(struct buffer* buffer, uint8_t value) {
+  if (buffer->size < W86_JIT_BUFFER_SIZE) buffer->data[buffer->size] = value;
+  buffer->size++; // an overflow is caught once we're done
+}
+
+static void emit_bytes(struct buffer* buffer, const uint8_t* values, size_t size) {
+  for (size_t i = 0; i < size; i++) emit_byte(buffer, values[i]);
+}
+
+static void emit_uleb(struct buffer* buffer, uint32_t value) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    emit_byte(buffer, byte | (value ? 0x80 : 0x00));
+  } while (value);
+}
+
+static void emit_sleb(struct buffer* buffer, int32_t value) {
+  while (true) {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if ((value == 0 && !(byte & 0x40)) || (value == -1 && byte & 0x40)) {
+      emit_byte(buffer, byte);
+      return;
+    }
+    emit_byte(buffer, byte | 0x80);
+  }
+}
+
+static void emit_section(struct buffer* module, uint8_t id, const struct buffer* section) {
+  emit_byte(module, id);
+  emit_uleb(module, section->size);
+  emit_bytes(module, section->data, section->size);
+}
+
+static void emit_memory_access(struct buffer* body, enum wasm_opcode opcode, uint32_t align, uint32_t offset) {
+  emit_byte(body, opcode);
+  emit_uleb(body, align);
+  emit_uleb(body, offset);
+}
+
+static const uint32_t word_registers[8] = {
+  offsetof(struct w86_cpu_state, registers.ax),
+  offsetof(struct w86_cpu_state, registers.cx),
+  offsetof(struct w86_cpu_state, registers.dx),
+  offsetof(struct w86_cpu_state, registers.bx),
+  offsetof(struct w86_cpu_state, registers.sp),
+  offsetof(struct w86_cpu_state, registers.bp),
+  offsetof(struct w86_cpu_state, registers.si),
+  offsetof(struct w86_cpu_state, registers.di)
+};
+
+static inline uint32_t byte_register(uint8_t reg) {
+  return word_registers[reg & 0b011] + (reg >> 2); // ah, ch, dh and bh are the high halves
+}
+
+// inline code for the instructions that only shuffle registers around, returns false for everything else
+static bool emit_inline(struct buffer* body, const struct w86_instruction_info* instruction) {
+  uint8_t opcode = instruction->opcode;
+  uint8_t mod = instruction->modrm >> 6 & 0b11;
+  uint8_t reg = instruction->modrm >> 3 & 0b111;
+  uint8_t rm = instruction->modrm & 0b111;
+
+  if ((opcode & 0b11111000) == 0xb0) { // imm8 -> reg8
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_byte(body, WASM_I32_CONST);
+    emit_sleb(body, instruction->imm & 0xff);
+    emit_memory_access(body, WASM_I32_STORE8, 0, byte_register(opcode & 0b111));
+    return true;
+  }
+
+  if ((opcode & 0b11111000) == 0xb8) { // imm16 -> reg16
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_byte(body, WASM_I32_CONST);
+    emit_sleb(body, instruction->imm);
+    emit_memory_access(body, WASM_I32_STORE16, 1, word_registers[opcode & 0b111]);
+    return true;
+  }
+
+  if (opcode >= 0x88 && opcode <= 0x8b && mod == W86_MODRM_MOD_REG) { // reg -> reg
+    bool word = opcode & 0b01;
+    bool to_reg = opcode & 0b10;
+    uint8_t from = to_reg ? rm : reg;
+    uint8_t to = to_reg ? reg : rm;
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    if (word) {
+      emit_memory_access(body, WASM_I32_LOAD16_U, 1, word_registers[from]);
+      emit_memory_access(body, WASM_I32_STORE16, 1, word_registers[to]);
+    } else {
+      emit_memory_access(body, WASM_I32_LOAD8_U, 0, byte_register(from));
+      emit_memory_access(body, WASM_I32_STORE8, 0, byte_register(to));
+    }
+    return true;
+  }
+
+  if (opcode > 0x90 && opcode <= 0x97) { // ax <-> reg16
+    uint32_t other = word_registers[opcode & 0b111];
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_memory_access(body, WASM_I32_LOAD16_U, 1, other);
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_byte(body, WASM_LOCAL_GET);
+    emit_uleb(body, 0);
+    emit_memory_access(body, WASM_I32_LOAD16_U, 1, word_registers[W86_MODRM_REG_AX]);
+    emit_memory_access(body, WASM_I32_STORE16, 1, other);
+    emit_memory_access(body, WASM_I32_STORE16, 1, word_registers[W86_MODRM_REG_AX]);
+    return true;
+  }
+
+  return opcode == 0x90; // nop
+}
+
+static void emit_ip_update(struct buffer* body, uint16_t delta) {
+  if (!delta) return;
+  emit_byte(body, WASM_LOCAL_GET);
+  emit_uleb(body, 0);
+  emit_byte(body, WASM_LOCAL_GET);
+  emit_uleb(body, 0);
+  emit_memory_access(body, WASM_I32_LOAD16_U, 1, offsetof(struct w86_cpu_state, registers.ip));
+  emit_byte(body, WASM_I32_CONST);
+  emit_sleb(body, delta);
+  emit_byte(body, WASM_I32_ADD);
+  emit_memory_access(body, WASM_I32_STORE16, 1, offsetof(struct w86_cpu_state, registers.ip));
+}
+
+static void emit_return_if(struct buffer* body, uint32_t retired) {
+  emit_byte(body, WASM_IF);
+  emit_byte(body, 0x40); // no result
+  emit_byte(body, WASM_I32_CONST);
+  emit_sleb(body, retired);
+  emit_byte(body, WASM_RETURN);
+  emit_byte(body, WASM_END);
+}
+
+bool w86_jit_compile(struct w86_cpu_state* state, struct w86_block* block) {
+  static struct buffer body, section, module;
+  const struct w86_instruction_info* instructions = &state->block_cache.pool[block->start];
+  uint32_t page = W86_CODE_PAGE(block->address);
+  uint32_t length = block->length;
+  if (instructions[length - 1].opcode == 0xf4) length--; // hlt's status has to come from the interpreter
+  if (!length) return false;
+
+  body.size = 0;
+  emit_uleb(&body, 0); // no locals
+  uint16_t ip = 0; // ip updates of inline instructions are folded together
+  for (uint32_t i = 0; i < length; i++) {
+    if (emit_inline(&body, &instructions[i])) {
+      ip += instructions[i].size;
+      continue;
+    }
+
+    emit_ip_update(&body, ip);
+    ip = 0;
+
+    // status = handler(state, instruction), the interpreter redoes a failing instruction to pick up its status
+    emit_byte(&body, WASM_LOCAL_GET);
+    emit_uleb(&body, 0);
+    emit_byte(&body, WASM_I32_CONST);
+    emit_sleb(&body, (int32_t) (uintptr_t) &instructions[i]);
+    emit_byte(&body, WASM_I32_CONST);
+    emit_sleb(&body, (int32_t) (uintptr_t) instructions[i].handler);
+    emit_byte(&body, WASM_CALL_INDIRECT);
+    emit_uleb(&body, 1);
+    emit_uleb(&body, 0);
+    emit_return_if(&body, i);
+
+    // the handler may have written to this block's code
+    emit_byte(&body, WASM_LOCAL_GET);
+    emit_uleb(&body, 0);
+    emit_memory_access(&body, WASM_I32_LOAD, 2, offsetof(struct w86_cpu_state, decode_cache.generations) + page * sizeof(uint32_t));
+    emit_byte(&body, WASM_I32_CONST);
+    emit_sleb(&body, block->generation);
+    emit_byte(&body, WASM_I32_NE);
+    emit_return_if(&body, i + 1);
+  }
+  emit_ip_update(&body, ip);
+  emit_byte(&body, WASM_I32_CONST);
+  emit_sleb(&body, length);
+  emit_byte(&body, WASM_END);
+
+  module.size = 0;
+  emit_bytes(&module, (const uint8_t[]) { 0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00 }, 8);
+
+  // (func (param i32) (result i32)) for us, (func (param i32 i32) (result i32)) for the handlers
+  section.size = 0;
+  emit_bytes(&section, (const uint8_t[]) { 0x02, 0x60, 0x01, 0x7f, 0x01, 0x7f, 0x60, 0x02, 0x7f, 0x7f, 0x01, 0x7f }, 12);
+  emit_section(&module, 1, &section);
+
+  // env.memory and env.table, a shared memory has to be imported as shared and needs a maximum
+  section.size = 0;
+#ifdef __EMSCRIPTEN_SHARED_MEMORY__
+  emit_bytes(&section, (const uint8_t[]) { 0x02, 0x03, 'e', 'n', 'v', 0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x03, 0x00, 0x80, 0x80, 0x04 }, 18);
+#else
+  emit_bytes(&section, (const uint8_t[]) { 0x02, 0x03, 'e', 'n', 'v', 0x06, 'm', 'e', 'm', 'o', 'r', 'y', 0x02, 0x00, 0x00 }, 15);
+#endif
+  emit_bytes(&section, (const uint8_t[]) { 0x03, 'e', 'n', 'v', 0x05, 't', 'a', 'b', 'l', 'e', 0x01, 0x70, 0x00, 0x00 }, 14);
+  emit_section(&module, 2, &section);
+
+  section.size = 0;
+  emit_bytes(&section, (const uint8_t[]) { 0x01, 0x00 }, 2);
+  emit_section(&module, 3, &section);
+
+  section.size = 0;
+  emit_bytes(&section, (const uint8_t[]) { 0x01, 0x03, 'r', 'u', 'n', 0x00, 0x00 }, 7);
+  emit_section(&module, 7, &section);
+
+  section.size = 0;
+  emit_uleb(&section, 1);
+  emit_uleb(&section, body.size);
+  emit_bytes(&section, body.data, body.size);
+  emit_section(&module, 10, &section);
+
+  if (body.size > W86_JIT_BUFFER_SIZE || section.size > W86_JIT_BUFFER_SIZE || module.size > W86_JIT_BUFFER_SIZE) return false;
+
+  block->jit = w86_jit_instantiate(module.data, module.size);
+  return block->jit;
+}
+
+void w86_jit_release(struct w86_block* block) {
+  if (block->jit) w86_jit_free(block->jit);
+  block->jit = nullptr;
+}
+
+#else
+
+// only the wasm build can load code at runtime, natively the interpreter does all the work
+
+bool w86_jit_compile(struct w86_cpu_state*, struct w86_block*) {
+  return false;
+}
+
+void w86_jit_release(struct w86_block* block) {
+  block->jit = nullptr;
+}
+
+#endif
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_JIT_H_
+#define W86_JIT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "w86.h"
+
+#define W86_JIT_THRESHOLD 256
+#define W86_JIT_BUFFER_SIZE 8192
+
+bool w86_jit_compile(struct w86_cpu_state* state, struct w86_block* block);
+void w86_jit_release(struct w86_block* block);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_JIT_H_ */
@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "lockstep.h"
+
+#include <stdint.h>
+
+#include "address.h"
+#include "block.h"
+#include "bus.h"
+#include "flags.h"
+#include "pic.h"
+#include "schedule.h"
+#include "w86.h"
+
+// how far a lane goes on its own through code that can't run in the vectors anyway, lanes that take the same path
+// through it stay together, short blocks of calls and memory accesses would cost more to stop at than they take to run
+#define ALONE_INSTRUCTIONS 1024
+
+// vector compares give all ones or all zeros in each lane, just signed
+#define MASK(condition) ((w86_lanes) (condition))
+
+static inline w86_lanes splat(uint16_t value) {
+  return (w86_lanes) {} + value;
+}
+
+// value in the lanes of mask, old in the rest
+static inline w86_lanes blend(w86_lanes mask, w86_lanes value, w86_lanes old) {
+  return (value & mask) | (old & ~mask);
+}
+
+static inline uint32_t here(const struct w86_lockstep* lockstep, uint32_t lane) {
+  return W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(lockstep->lanes[lane].state->bases.cs, lockstep->ip[lane]));
+}
+
+// w86_flags_get for every lane at once
+static w86_lanes get_flags(const struct w86_lockstep* lockstep) {
+  w86_lanes a = lockstep->a, b = lockstep->b, result = lockstep->result;
+  w86_lanes sign = (lockstep->word & 0x8000) | (~lockstep->word & 0x80);
+  w86_lanes add = MASK(lockstep->op == W86_FLAGS_OP_ADD) | MASK(lockstep->op == W86_FLAGS_OP_INC);
+  w86_lanes carry_kept = (MASK(lockstep->op == W86_FLAGS_OP_INC) | MASK(lockstep->op == W86_FLAGS_OP_DEC)) & W86_FLAGS_CF;
+
+  w86_lanes parity = result & 0xff;
+  parity ^= parity >> 4;
+  parity ^= parity >> 2;
+  parity ^= parity >> 1;
+
+  w86_lanes flags = (blend(add, MASK(result < a), MASK(a < b)) & W86_FLAGS_CF)
+                  | ((a ^ b ^ result) & W86_FLAGS_AF)
+                  | (MASK((blend(add, (a ^ result) & (b ^ result), (a ^ b) & (a ^ result)) & sign) != 0) & W86_FLAGS_OF)
+                  | (MASK(result == 0) & W86_FLAGS_ZF)
+                  | (MASK((result & sign) != 0) & W86_FLAGS_SF)
+                  | (MASK((parity & 1) == 0) & W86_FLAGS_PF);
+  flags = (lockstep->flags & (W86_FLAGS_CONTROL | carry_kept)) | (flags & ~carry_kept);
+
+  return blend(MASK(lockstep->op == W86_FLAGS_OP_NONE), lockstep->flags, flags);
+}
+
+// w86_flags_record for the lanes in mask
+static inline void record(struct w86_lockstep* lockstep, w86_lanes mask, enum w86_flags_op op, bool word, w86_lanes a, w86_lanes b, w86_lanes result) {
+  if (op == W86_FLAGS_OP_INC || op == W86_FLAGS_OP_DEC) {
+    w86_lanes carried = (lockstep->flags & ~W86_FLAGS_CF) | (get_flags(lockstep) & W86_FLAGS_CF);
+    lockstep->flags = blend(mask & ~MASK(lockstep->op == W86_FLAGS_OP_NONE), carried, lockstep->flags);
+  }
+  lockstep->op = blend(mask, splat(op), lockstep->op);
+  lockstep->word = word ? lockstep->word | mask : lockstep->word & ~mask;
+  lockstep->a = blend(mask, a, lockstep->a);
+  lockstep->b = blend(mask, b, lockstep->b);
+  lockstep->result = blend(mask, result, lockstep->result);
+}
+
+// byte operands and results are zero extended, the same as the interpreter records them
+static inline w86_lanes arithmetic(struct w86_lockstep* lockstep, w86_lanes mask, enum w86_flags_op op, bool word, w86_lanes a, w86_lanes b) {
+  w86_lanes size = splat(word ? 0xffff : 0xff);
+  a &= size;
+  b &= size;
+  w86_lanes result = (op == W86_FLAGS_OP_SUB || op == W86_FLAGS_OP_DEC ? a - b : a + b) & size;
+  record(lockstep, mask, op, word, a, b, result);
+
+  return result;
+}
+
+// reg is a modrm register field
+static inline w86_lanes get(const struct w86_lockstep* lockstep, bool word, uint8_t reg) {
+  if (word) return lockstep->registers[reg];
+  return reg & 0b100 ? lockstep->registers[reg & 0b011] >> 8 : lockstep->registers[reg] & 0xff;
+}
+
+static inline void set(struct w86_lockstep* lockstep, w86_lanes mask, bool word, uint8_t reg, w86_lanes value) {
+  w86_lanes* registers = lockstep->registers;
+  if (word) {
+    registers[reg] = blend(mask, value, registers[reg]);
+  } else if (reg & 0b100) {
+    registers[reg & 0b011] = blend(mask, (registers[reg & 0b011] & 0x00ff) | value << 8, registers[reg & 0b011]);
+  } else {
+    registers[reg] = blend(mask, (registers[reg] & 0xff00) | (value & 0x00ff), registers[reg]);
+  }
+}
+
+static inline bool is_branch(const struct w86_instruction_info* instruction) {
+  return (instruction->opcode & 0b11110000) == 0x70 || instruction->opcode == 0xe9 || instruction->opcode == 0xeb;
+}
+
+// what execute and branch know how to do, nothing that touches memory, ports or segments
+static bool is_supported(const struct w86_instruction_info* instruction) {
+  uint8_t opcode = instruction->opcode;
+  uint8_t reg = instruction->modrm >> 3 & 0b111;
+  bool registers = (instruction->modrm & 0b11000000) == 0b11000000;
+  return (opcode <= 0x05 && (opcode >= 0x04 || registers)) // add
+      || (opcode >= 0x28 && opcode <= 0x2d && (opcode >= 0x2c || registers)) // sub
+      || (opcode >= 0x38 && opcode <= 0x3d && (opcode >= 0x3c || registers)) // cmp
+      || (opcode >= 0x40 && opcode <= 0x4f) // inc and dec
+      || (opcode >= 0x80 && opcode <= 0x83 && registers && (reg == 0b000 || reg == 0b101 || reg == 0b111)) // add, sub and cmp r, imm
+      || (opcode >= 0x86 && opcode <= 0x8b && registers) // xchg and mov between registers
+      || (opcode >= 0x90 && opcode <= 0x97) // xchg ax, reg16
+      || (opcode >= 0xb0 && opcode <= 0xbf) // mov reg, imm
+      || is_branch(instruction);
+}
+
+// anything but a branch, ip is moved for the whole block at once
+static void execute(struct w86_lockstep* lockstep, w86_lanes mask, const struct w86_instruction_info* instruction) {
+  w86_lanes* registers = lockstep->registers;
+  uint8_t opcode = instruction->opcode;
+  uint8_t reg = instruction->modrm >> 3 & 0b111;
+  uint8_t rm = instruction->modrm & 0b111;
+  bool word = opcode & 0b00000001;
+  w86_lanes imm = splat(instruction->imm);
+
+  if (opcode < 0x40) { // add, sub and cmp
+    enum w86_flags_op op = opcode < 0x28 ? W86_FLAGS_OP_ADD : W86_FLAGS_OP_SUB;
+    bool store = opcode < 0x38;
+    w86_lanes result;
+    switch (opcode & 0b111) {
+    case 0b000: // r/m, reg
+    case 0b001:
+      result = arithmetic(lockstep, mask, op, word, get(lockstep, word, rm), get(lockstep, word, reg));
+      if (store) set(lockstep, mask, word, rm, result);
+      break;
+
+    case 0b010: // reg, r/m
+    case 0b011:
+      result = arithmetic(lockstep, mask, op, word, get(lockstep, word, reg), get(lockstep, word, rm));
+      if (store) set(lockstep, mask, word, reg, result);
+      break;
+
+    default: // al or ax, imm, the byte ones clear ah the same as the interpreter does
+      result = arithmetic(lockstep, mask, op, word, registers[0], imm);
+      if (store) registers[0] = blend(mask, result, registers[0]);
+    }
+    return;
+  }
+
+  if (opcode < 0x50) { // inc and dec
+    enum w86_flags_op op = opcode & 0b00001000 ? W86_FLAGS_OP_DEC : W86_FLAGS_OP_INC;
+    w86_lanes* target = &registers[opcode & 0b111];
+    *target = blend(mask, arithmetic(lockstep, mask, op, true, *target, splat(1)), *target);
+    return;
+  }
+
+  switch (opcode) {
+  case 0x80: // add, sub and cmp r/m, imm
+  case 0x81:
+  case 0x82:
+  case 0x83:
+    w86_lanes result = arithmetic(lockstep, mask, reg == 0b000 ? W86_FLAGS_OP_ADD : W86_FLAGS_OP_SUB, word, get(lockstep, word, rm), imm);
+    if (reg != 0b111) set(lockstep, mask, word, rm, result);
+    break;
+
+  case 0x86: // reg <-> r/m
+  case 0x87:
+    w86_lanes temp = get(lockstep, word, rm);
+    set(lockstep, mask, word, rm, get(lockstep, word, reg));
+    set(lockstep, mask, word, reg, temp);
+    break;
+
+  case 0x88: // reg -> r/m
+  case 0x89:
+    set(lockstep, mask, word, rm, get(lockstep, word, reg));
+    break;
+
+  case 0x8a: // r/m -> reg
+  case 0x8b:
+    set(lockstep, mask, word, reg, get(lockstep, word, rm));
+    break;
+
+  default:
+    if (opcode >= 0xb8) { // imm16 -> reg16
+      registers[opcode & 0b111] = blend(mask, imm, registers[opcode & 0b111]);
+    } else if (opcode >= 0xb0) { // imm8 -> reg8
+      set(lockstep, mask, false, opcode & 0b111, imm);
+    } else { // ax <-> reg16
+      w86_lanes other = registers[opcode & 0b111];
+      registers[opcode & 0b111] = blend(mask, registers[0], other);
+      registers[0] = blend(mask, other, registers[0]);
+    }
+  }
+}
+
+// moves ip past the block, taking the branch at its end in the lanes where it goes, and returns the cycles that adds
+static w86_lanes branch(struct w86_lockstep* lockstep, w86_lanes mask, const struct w86_instruction_info* last, uint16_t next) {
+  w86_lanes ip = splat(next);
+  w86_lanes cycles = {};
+  if ((last->opcode & 0b11110000) == 0x70) {
+    uint8_t condition = last->opcode & 0b00001111;
+    w86_lanes cond = get_flags(lockstep) & w86_flags_condition_mask(condition);
+    w86_lanes taken = mask & -((((cond >> 11 ^ cond >> 7) | cond >> 6 | cond >> 2 | cond) ^ condition) & 1);
+    ip += taken & last->imm;
+    cycles = taken & 12; // 16 taken, the table has the 4 for falling through
+  } else if (last->opcode == 0xe9 || last->opcode == 0xeb) {
+    ip += last->imm;
+  }
+  lockstep->ip = blend(mask, ip, lockstep->ip);
+
+  return cycles;
+}
+
+static void load_lane(struct w86_lockstep* lockstep, uint32_t lane) {
+  const struct w86_cpu_state* state = lockstep->lanes[lane].state;
+  const struct w86_register_file* registers = &state->registers;
+  const uint16_t words[8] = { registers->ax, registers->cx, registers->dx, registers->bx, registers->sp, registers->bp, registers->si, registers->di };
+  for (uint32_t i = 0; i < 8; i++) lockstep->registers[i][lane] = words[i];
+  lockstep->ip[lane] = registers->ip;
+  lockstep->flags[lane] = registers->flags;
+  lockstep->op[lane] = state->lazy_flags.op;
+  lockstep->word[lane] = state->lazy_flags.word ? 0xffff : 0;
+  lockstep->a[lane] = state->lazy_flags.a;
+  lockstep->b[lane] = state->lazy_flags.b;
+  lockstep->result[lane] = state->lazy_flags.result;
+}
+
+static void store_lane(const struct w86_lockstep* lockstep, uint32_t lane) {
+  struct w86_cpu_state* state = lockstep->lanes[lane].state;
+  struct w86_register_file* registers = &state->registers;
+  registers->ax = lockstep->registers[0][lane];
+  registers->cx = lockstep->registers[1][lane];
+  registers->dx = lockstep->registers[2][lane];
+  registers->bx = lockstep->registers[3][lane];
+  registers->sp = lockstep->registers[4][lane];
+  registers->bp = lockstep->registers[5][lane];
+  registers->si = lockstep->registers[6][lane];
+  registers->di = lockstep->registers[7][lane];
+  registers->ip = lockstep->ip[lane];
+  registers->flags = lockstep->flags[lane];
+  state->lazy_flags = (struct w86_lazy_flags) {
+    .op = lockstep->op[lane],
+    .word = lockstep->word[lane],
+    .a = lockstep->a[lane],
+    .b = lockstep->b[lane],
+    .result = lockstep->result[lane]
+  };
+}
+
+// a lane only goes along with the others while nothing needs to see its instructions one by one
+static bool is_ready(const struct w86_lockstep_lane* lane) {
+  const struct w86_cpu_state* state = lane->state;
+  return !state->history && !state->trace && !state->profile && !state->debug
+      && !w86_schedule_due(state) && !(state->pic && w86_pic_waiting(state->pic));
+}
+
+// the same bytes behind the block as the leader has, which they are for as long as neither wrote over its shared pages
+static bool same_code(const struct w86_cpu_state* state, const struct w86_cpu_state* leader, uint32_t address, uint16_t bytes) {
+  for (uint32_t page = W86_BUS_PAGE(address); page <= W86_BUS_PAGE(address + bytes - 1); page++) {
+    if (!leader->bus[page].read || state->bus[page].read != leader->bus[page].read) return false;
+  }
+
+  return true;
+}
+
+// through the interpreter like any other instance, at most max instructions so it can't get far ahead of the others
+static void run_alone(struct w86_lockstep* lockstep, uint32_t lane, uint32_t max_instructions) {
+  struct w86_lockstep_lane* self = &lockstep->lanes[lane];
+  if (self->max_instructions - self->instructions < max_instructions) max_instructions = self->max_instructions - self->instructions;
+
+  store_lane(lockstep, lane);
+  struct w86_run_result result = w86_cpu_run(self->state, max_instructions);
+  load_lane(lockstep, lane);
+
+  self->instructions += result.instructions;
+  lockstep->scalar += result.instructions;
+  self->status = result.status;
+  self->done = result.status != W86_STATUS_SUCCESS || self->instructions == self->max_instructions;
+}
+
+void w86_lockstep_start(struct w86_lockstep* lockstep) {
+  lockstep->count = 0;
+  lockstep->vector = 0;
+  lockstep->scalar = 0;
+}
+
+// false once every lane is taken, state must not be touched until w86_lockstep_run returns
+bool w86_lockstep_add(struct w86_lockstep* lockstep, struct w86_cpu_state* state, uint64_t max_instructions) {
+  if (lockstep->count == W86_LOCKSTEP_LANES) return false;
+
+  lockstep->lanes[lockstep->count++] = (struct w86_lockstep_lane) {
+    .state = state,
+    .max_instructions = max_instructions,
+    .instructions = 0,
+    .status = W86_STATUS_SUCCESS,
+    .done = !max_instructions
+  };
+  return true;
+}
+
+// runs every lane until it stops or runs out of instructions, each one ends up exactly where w86_cpu_run would have left it
+// except that an interrupt the pic couldn't get through gets tried on every block instead of every few instructions
+void w86_lockstep_run(struct w86_lockstep* lockstep) {
+  for (uint32_t i = 0; i < lockstep->count; i++) load_lane(lockstep, i);
+
+  while (true) {
+    // the lanes furthest behind go first, so the ones that took the other side of a branch wait for the rest there
+    uint32_t address = UINT32_MAX;
+    for (uint32_t i = 0; i < lockstep->count; i++) {
+      if (!lockstep->lanes[i].done && here(lockstep, i) < address) address = here(lockstep, i);
+    }
+    if (address == UINT32_MAX) break;
+
+    uint32_t group = 0;
+    uint32_t leader = lockstep->count;
+    for (uint32_t i = 0; i < lockstep->count; i++) {
+      if (lockstep->lanes[i].done || here(lockstep, i) != address) continue;
+      group |= 1u << i;
+      if (leader == lockstep->count && is_ready(&lockstep->lanes[i])) leader = i;
+    }
+
+    // decoded once by the leader, the others run it off the leader's block cache
+    const struct w86_block* block = nullptr;
+    if (leader < lockstep->count) {
+      struct w86_cpu_state* state = lockstep->lanes[leader].state;
+      state->registers.ip = lockstep->ip[leader];
+      block = w86_block_lookup(state, address);
+    }
+    uint32_t length = block ? block->length : 1;
+
+    const struct w86_instruction_info* instruction = block ? &lockstep->lanes[leader].state->block_cache.pool[block->start] : nullptr;
+    bool supported = block;
+    for (uint32_t i = 0; supported && i < length; i++) supported = is_supported(&instruction[i]);
+
+    w86_lanes mask = {};
+    uint32_t together = 0;
+    uint32_t lanes = 0;
+    for (uint32_t i = 0; supported && i < lockstep->count; i++) {
+      const struct w86_lockstep_lane* lane = &lockstep->lanes[i];
+      const struct w86_cpu_state* state = lane->state;
+      const struct w86_cpu_state* first = lockstep->lanes[leader].state;
+      if (!(group >> i & 1) || !is_ready(lane) || lane->max_instructions - lane->instructions < length) continue;
+      if (state->registers.cs != first->registers.cs || !same_code(state, first, address, block->bytes)) continue;
+      mask[i] = 0xffff;
+      together |= 1u << i;
+      lanes++;
+    }
+
+    if (lanes >= 2) {
+      for (uint32_t i = 0; i < length; i++) {
+        if (!is_branch(&instruction[i])) execute(lockstep, mask, &instruction[i]);
+      }
+      w86_lanes cycles = branch(lockstep, mask, &instruction[length - 1], lockstep->ip[leader] + block->bytes);
+
+      for (uint32_t i = 0; i < lockstep->count; i++) {
+        if (!(together >> i & 1)) continue;
+        struct w86_lockstep_lane* lane = &lockstep->lanes[i];
+        lane->state->cycles += block->cycles + cycles[i];
+        lane->instructions += length;
+        lane->done = lane->instructions == lane->max_instructions;
+      }
+      lockstep->vector += (uint64_t) lanes * length;
+      group &= ~together;
+    }
+
+    for (uint32_t i = 0; i < lockstep->count; i++) {
+      if (group >> i & 1) run_alone(lockstep, i, supported ? length : ALONE_INSTRUCTIONS);
+    }
+  }
+
+  for (uint32_t i = 0; i < lockstep->count; i++) store_lane(lockstep, i);
+}
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_LOCKSTEP_H_
+#define W86_LOCKSTEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_LOCKSTEP_LANES 8 // a word per lane fills a 128 bit vector, sse2, neon and wasm simd all have those
+
+// one 16 bit value per lane, the compiler picks whichever vector instructions the target has
+typedef uint16_t w86_lanes [[gnu::vector_size(W86_LOCKSTEP_LANES * sizeof(uint16_t))]];
+
+struct w86_lockstep_lane {
+  struct w86_cpu_state* state;
+  uint64_t max_instructions;
+  uint64_t instructions;
+  enum w86_status status; // what stopped it, success if it ran out of instructions
+  bool done;
+};
+
+// instances of the same program run side by side, each in its own cpu state and memory
+// while they're in w86_lockstep_run their registers and lazy flags live here instead, a vector per register,
+// so a block that only works on registers runs once for every lane that's at it
+// anything else, and a lane that went its own way, runs through w86_cpu_run a block at a time
+struct w86_lockstep {
+  struct w86_lockstep_lane lanes[W86_LOCKSTEP_LANES];
+  uint32_t count;
+  w86_lanes registers[8]; // in modrm order, ax cx dx bx sp bp si di
+  w86_lanes ip;
+  w86_lanes flags;
+  w86_lanes op; // the lazy flags, word is all ones for a word operation
+  w86_lanes word;
+  w86_lanes a;
+  w86_lanes b;
+  w86_lanes result;
+  uint64_t vector; // lane instructions that ran together
+  uint64_t scalar; // ones that ran on their own
+};
+
+void w86_lockstep_start(struct w86_lockstep* lockstep);
+bool w86_lockstep_add(struct w86_lockstep* lockstep, struct w86_cpu_state* state, uint64_t max_instructions);
+void w86_lockstep_run(struct w86_lockstep* lockstep);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_LOCKSTEP_H_ */
@@ -8,42 +8,22 @@
 #include "decode.h"
 #include "w86.h"
 
-struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, uint16_t offset, enum w86_segment_prefix segment) {
-  uint8_t modrm = w86_get_byte(state, state->registers.cs, offset);
+struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, const struct w86_instruction_info* instruction) {
+  uint8_t modrm = instruction->modrm;
   struct w86_modrm_info info = {
     .mod = modrm >> 6 & 0b11,
     .reg = modrm >> 3 & 0b111,
-    .segment = segment
+    .disp = instruction->disp,
+    .segment = instruction->prefixes.segment
   };
 
-  switch (info.mod) {
-  case W86_MODRM_MOD_MEM:
-    info.rm.mem = modrm & 0b111;
-    info.disp = 0;
-    info.rm_is_reg = false;
-    info.size = info.rm.mem == W86_MODRM_MEM_DIRECT ? 2 : 0;
-    break;
-
-  case W86_MODRM_MOD_MEM_DISP8:
-    info.rm.mem = modrm & 0b111;
-    info.disp = (int8_t) w86_get_byte(state, state->registers.cs, offset + 1);
-    info.rm_is_reg = false;
-    info.size = 1;
-    break;
-
-  case W86_MODRM_MOD_MEM_DISP16:
-    info.rm.mem = modrm & 0b111;
-    info.disp = (int16_t) w86_get_word(state, state->registers.cs, offset + 1);
-    info.rm_is_reg = false;
-    info.size = 2;
-    break;
-
-  case W86_MODRM_MOD_REG:
+  if (info.mod == W86_MODRM_MOD_REG) {
     info.rm.reg = modrm & 0b111;
-    info.disp = 0;
     info.rm_is_reg = true;
     info.address = 0x0000;
-    info.size = 0;
+  } else {
+    info.rm.mem = modrm & 0b111;
+    info.rm_is_reg = false;
   }
 
   if (info.mod != W86_MODRM_MOD_REG) switch (info.rm.mem) {
@@ -72,7 +52,7 @@ struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, uint16_t offs
     break;
 
   case W86_MODRM_MEM_BP:
-    info.address = info.mod == W86_MODRM_MOD_MEM ? w86_get_word(state, state->registers.cs, offset + 1) : state->registers.bp + info.disp;
+    info.address = info.mod == W86_MODRM_MOD_MEM ? (uint16_t) info.disp : state->registers.bp + info.disp;
     break;
 
   case W86_MODRM_MEM_BX:
@@ -82,6 +62,26 @@ struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, uint16_t offs
   return info;
 }
 
+// 8086 clocks to work out the effective address, by rm for mod 00, a displacement costs 4 more
+static const uint8_t ea_cycles[8] = {
+  [W86_MODRM_MEM_BX_SI] = 7,
+  [W86_MODRM_MEM_BX_DI] = 8,
+  [W86_MODRM_MEM_BP_SI] = 8,
+  [W86_MODRM_MEM_BP_DI] = 7,
+  [W86_MODRM_MEM_SI] = 5,
+  [W86_MODRM_MEM_DI] = 5,
+  [W86_MODRM_MEM_DIRECT] = 6,
+  [W86_MODRM_MEM_BX] = 5
+};
+
+// for the same operand w86_modrm_parse works out, so only meaningful with a memory operand
+uint8_t w86_modrm_cycles(const struct w86_instruction_info* instruction) {
+  uint8_t mod = instruction->modrm >> 6 & 0b11;
+  uint8_t rm = instruction->modrm & 0b111;
+  uint8_t cycles = mod == W86_MODRM_MOD_MEM ? ea_cycles[rm] : (rm == W86_MODRM_MEM_BP ? 5 : ea_cycles[rm]) + 4;
+  return instruction->prefixes.segment == W86_SEGMENT_PREFIX_NONE ? cycles : cycles + 2;
+}
+
 bool w86_modrm_get_reg_byte(struct w86_cpu_state* state, struct w86_modrm_info info, uint8_t* ret) {
   uint8_t value;
   switch (info.reg) {
@@ -164,20 +164,20 @@ bool w86_modrm_get_rm_byte(struct w86_cpu_state* state, struct w86_modrm_info in
     return false;
   } else switch (info.segment) {
   case W86_SEGMENT_PREFIX_CS:
-    value = w86_get_byte(state, state->registers.cs, info.address);
+    value = w86_get_byte(state, state->bases.cs, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_NONE:
   case W86_SEGMENT_PREFIX_DS:
-    value = w86_get_byte(state, state->registers.ds, info.address);
+    value = w86_get_byte(state, state->bases.ds, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_ES:
-    value = w86_get_byte(state, state->registers.es, info.address);
+    value = w86_get_byte(state, state->bases.es, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_SS:
-    value = w86_get_byte(state, state->registers.ss, info.address);
+    value = w86_get_byte(state, state->bases.ss, info.address);
     break;
 
   default:
@@ -281,20 +281,20 @@ bool w86_modrm_set_rm_byte(struct w86_cpu_state* state, struct w86_modrm_info in
     return false;
   } else switch (info.segment) {
   case W86_SEGMENT_PREFIX_CS:
-    w86_set_byte(state, state->registers.cs, info.address, value);
+    w86_set_byte(state, state->bases.cs, info.address, value);
     return true;
 
   case W86_SEGMENT_PREFIX_NONE:
   case W86_SEGMENT_PREFIX_DS:
-    w86_set_byte(state, state->registers.ds, info.address, value);
+    w86_set_byte(state, state->bases.ds, info.address, value);
     return true;
 
   case W86_SEGMENT_PREFIX_ES:
-    w86_set_byte(state, state->registers.es, info.address, value);
+    w86_set_byte(state, state->bases.es, info.address, value);
     return true;
     
   case W86_SEGMENT_PREFIX_SS:
-    w86_set_byte(state, state->registers.ss, info.address, value);
+    w86_set_byte(state, state->bases.ss, info.address, value);
     return true;
 
   default:
@@ -384,20 +384,20 @@ bool w86_modrm_get_rm_word(struct w86_cpu_state* state, struct w86_modrm_info in
     return false;
   } else switch (info.segment) {
   case W86_SEGMENT_PREFIX_CS:
-    value = w86_get_word(state, state->registers.cs, info.address);
+    value = w86_get_word(state, state->bases.cs, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_NONE:
   case W86_SEGMENT_PREFIX_DS:
-    value = w86_get_word(state, state->registers.ds, info.address);
+    value = w86_get_word(state, state->bases.ds, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_ES:
-    value = w86_get_word(state, state->registers.es, info.address);
+    value = w86_get_word(state, state->bases.es, info.address);
     break;
 
   case W86_SEGMENT_PREFIX_SS:
-    value = w86_get_word(state, state->registers.ss, info.address);
+    value = w86_get_word(state, state->bases.ss, info.address);
     break;
 
   default:
@@ -485,20 +485,20 @@ bool w86_modrm_set_rm_word(struct w86_cpu_state* state, struct w86_modrm_info in
     return false;
   } else switch (info.segment) {
   case W86_SEGMENT_PREFIX_CS:
-    w86_set_word(state, state->registers.cs, info.address, value);
+    w86_set_word(state, state->bases.cs, info.address, value);
     return true;
 
   case W86_SEGMENT_PREFIX_NONE:
   case W86_SEGMENT_PREFIX_DS:
-    w86_set_word(state, state->registers.ds, info.address, value);
+    w86_set_word(state, state->bases.ds, info.address, value);
     return true;
 
   case W86_SEGMENT_PREFIX_ES:
-    w86_set_word(state, state->registers.es, info.address, value);
+    w86_set_word(state, state->bases.es, info.address, value);
     return true;
 
   case W86_SEGMENT_PREFIX_SS:
-    w86_set_word(state, state->registers.ss, info.address, value);
+    w86_set_word(state, state->bases.ss, info.address, value);
     return true;
 
   default:
@@ -562,6 +562,7 @@ bool w86_modrm_segment_load(struct w86_cpu_state* state, struct w86_modrm_info i
   default:
     return false;
   }
+  w86_segments_update(state);
 
   if (ret) *ret = value;
   return true;
@@ -70,10 +70,10 @@ struct w86_modrm_info {
   bool rm_is_reg;
   enum w86_segment_prefix segment;
   uint16_t address;
-  size_t size;
 };
 
-struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, uint16_t offset, enum w86_segment_prefix segment);
+struct w86_modrm_info w86_modrm_parse(struct w86_cpu_state* state, const struct w86_instruction_info* instruction);
+uint8_t w86_modrm_cycles(const struct w86_instruction_info* instruction);
 
 bool w86_modrm_get_reg_byte(struct w86_cpu_state* state, struct w86_modrm_info info, uint8_t* ret);
 bool w86_modrm_get_rm_byte(struct w86_cpu_state* state, struct w86_modrm_info info, uint8_t* ret);
@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "pic.h"
+
+#include <stdint.h>
+
+#include "flags.h"
+#include "history.h"
+#include "interrupt.h"
+#include "io.h"
+#include "w86.h"
+
+#define ACKNOWLEDGE_CYCLES 61 // the two inta cycles and everything int n does
+
+// lowest set bit, 8 for none
+static inline uint8_t highest_priority(uint8_t bits) {
+  uint8_t level = 0;
+  while (level < 8 && !(bits >> level & 1)) level++;
+  return level;
+}
+
+static uint8_t read_port(void* context, uint16_t port) {
+  struct w86_pic* pic = context;
+  if (port == W86_PIC_PORT + 1) return pic->imr;
+  return pic->read_isr ? pic->isr : pic->irr;
+}
+
+static void command(struct w86_pic* pic, uint8_t value) {
+  if (value & 0b00010000) { // icw1
+    *pic = (struct w86_pic) { .base = pic->base, .init = value & 0b10 ? 1 : 2, .icw4 = value & 0b1 };
+    return;
+  }
+
+  if (value & 0b00001000) { // ocw3
+    if (value & 0b10) pic->read_isr = value & 0b1;
+    return;
+  }
+
+  // ocw2, nonspecific eois end the highest priority one in service and specific ones the level they name
+  if (!(value & 0b00100000)) return;
+  uint8_t level = value & 0b01000000 ? value & 0b111 : highest_priority(pic->isr);
+  if (level < 8) pic->isr &= ~(1 << level);
+}
+
+static void write_port(void* context, uint16_t port, uint8_t value) {
+  struct w86_pic* pic = context;
+  if (port == W86_PIC_PORT) {
+    command(pic, value);
+    return;
+  }
+
+  switch (pic->init) {
+  case 0: // ocw1
+    pic->imr = value;
+    break;
+
+  case 1: // icw2 without an icw3, the pc has a single one
+  case 2: // icw2 with an icw3 to follow
+    pic->base = value & 0b11111000;
+    pic->init = pic->init == 2 ? 3 : pic->icw4 ? 4 : 0;
+    break;
+
+  case 3: // icw3, nothing is cascaded
+    pic->init = pic->icw4 ? 4 : 0;
+    break;
+
+  case 4:
+    pic->auto_eoi = value & 0b10;
+    pic->init = 0;
+  }
+}
+
+// starts out the way the pc bios leaves it, on vectors 8 to 15 with nothing masked
+bool w86_pic_start(struct w86_cpu_state* state, struct w86_pic* pic) {
+  *pic = (struct w86_pic) { .base = 0x08 };
+  if (!w86_io_map(state, W86_PIC_PORT, 2, (struct w86_io_device) { .read = read_port, .write = write_port, .context = pic, .size = sizeof(*pic) })) return false;
+
+  state->pic = pic;
+  return true;
+}
+
+// an edge on the irq line
+void w86_pic_request(struct w86_pic* pic, uint8_t irq) {
+  pic->irr |= 1 << irq;
+}
+
+// takes the highest priority request if if is set and nothing as important is in service, returns whether it did
+// with a history running it starts over, replays can't bring an interrupt back in at the right place
+bool w86_pic_interrupt(struct w86_cpu_state* state) {
+  struct w86_pic* pic = state->pic;
+  if (!(state->registers.flags & W86_FLAGS_IF) || pic->init) return false;
+
+  uint8_t level = highest_priority(pic->irr & ~pic->imr);
+  if (level >= highest_priority(pic->isr)) return false;
+
+  pic->irr &= ~(1 << level);
+  if (!pic->auto_eoi) pic->isr |= 1 << level;
+  w86_interrupt(state, pic->base + level);
+  state->cycles += ACKNOWLEDGE_CYCLES;
+  w86_history_reset(state);
+
+  return true;
+}
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_PIC_H_
+#define W86_PIC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_PIC_PORT 0x20 // command, data is the one after
+
+// a single 8259 the way the pc has it, edge triggered and with fixed priorities, irq 0 first
+// rotation, special mask mode and polling aren't there, the rotating eois just end the interrupt
+struct w86_pic {
+  uint8_t irr; // requested
+  uint8_t isr; // in service
+  uint8_t imr; // masked
+  uint8_t base; // vector of irq 0
+  uint8_t init; // initialization words still to come on the data port, 0 once it's running
+  bool icw4; // the initialization has a fourth word
+  bool auto_eoi;
+  bool read_isr; // ocw3 picked the in-service register for reads of the command port
+};
+
+bool w86_pic_start(struct w86_cpu_state* state, struct w86_pic* pic);
+void w86_pic_request(struct w86_pic* pic, uint8_t irq);
+bool w86_pic_interrupt(struct w86_cpu_state* state);
+
+// a request that isn't masked, whether or not it can go through yet
+static inline bool w86_pic_waiting(const struct w86_pic* pic) {
+  return pic->irr & ~pic->imr;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_PIC_H_ */
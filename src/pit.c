@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "pit.h"
+
+#include <stdint.h>
+
+#include "io.h"
+#include "pic.h"
+#include "schedule.h"
+#include "w86.h"
+
+static inline uint32_t period(const struct w86_pit_counter* counter) {
+  return counter->reload ? counter->reload : 1 << 16;
+}
+
+// modes 2 and 3 start over on their own, 0 and 4 count past 0 without firing again
+static inline bool periodic(const struct w86_pit_counter* counter) {
+  return counter->mode == 2 || counter->mode == 3;
+}
+
+static uint16_t count(const struct w86_pit* pit, const struct w86_pit_counter* counter) {
+  if (!counter->counting || pit->state->cycles < counter->start) return counter->reload; // cycles were set back past the load
+
+  uint64_t elapsed = (pit->state->cycles - counter->start) / W86_PIT_CYCLES;
+  return periodic(counter) ? period(counter) - elapsed % period(counter) : period(counter) - elapsed;
+}
+
+// counter 0 reaching the end of a period, its output going up is the edge on irq 0
+static void expire(struct w86_cpu_state* state, void* context) {
+  struct w86_pit* pit = context;
+  struct w86_pit_counter* counter = &pit->counters[0];
+  if (state->pic) w86_pic_request(state->pic, 0);
+  if (periodic(counter)) w86_schedule(state, &counter->event, counter->event.deadline + (uint64_t) period(counter) * W86_PIT_CYCLES);
+}
+
+static void load(struct w86_pit* pit, struct w86_pit_counter* counter) {
+  counter->start = pit->state->cycles;
+  counter->counting = true;
+  if (pit->state->scheduler && counter == &pit->counters[0] && counter->mode != 1 && counter->mode != 5) { // those wait for a gate that never comes
+    w86_schedule(pit->state, &counter->event, counter->start + (uint64_t) period(counter) * W86_PIT_CYCLES);
+  }
+}
+
+static uint8_t read_port(void* context, uint16_t port) {
+  struct w86_pit* pit = context;
+  if (port == W86_PIT_PORT + 3) return 0xff; // the control word can't be read back
+
+  struct w86_pit_counter* counter = &pit->counters[port - W86_PIT_PORT];
+  uint16_t value = counter->latched ? counter->latch : count(pit, counter);
+  bool high = counter->access == 2 || (counter->access == 3 && counter->read_high);
+  if (counter->access == 3) counter->read_high = !counter->read_high;
+  if (counter->access != 3 || !counter->read_high) counter->latched = false; // the whole latch was read
+  return high ? value >> 8 : value;
+}
+
+static void control(struct w86_pit* pit, uint8_t value) {
+  uint8_t select = value >> 6;
+  if (select == 3) return; // the 8254's read back command
+
+  struct w86_pit_counter* counter = &pit->counters[select];
+  uint8_t access = value >> 4 & 0b11;
+  if (!access) {
+    if (!counter->latched) counter->latch = count(pit, counter);
+    counter->latched = true;
+    return;
+  }
+
+  counter->access = access;
+  counter->mode = value >> 1 & 0b111;
+  if (counter->mode >= 6) counter->mode -= 4; // 6 and 7 are 2 and 3
+  counter->counting = false;
+  counter->latched = false;
+  counter->read_high = false;
+  counter->write_high = false;
+  if (pit->state->scheduler) w86_unschedule(pit->state, &counter->event);
+}
+
+static void write_port(void* context, uint16_t port, uint8_t value) {
+  struct w86_pit* pit = context;
+  if (port == W86_PIT_PORT + 3) {
+    control(pit, value);
+    return;
+  }
+
+  struct w86_pit_counter* counter = &pit->counters[port - W86_PIT_PORT];
+  switch (counter->access) {
+  case 1:
+    counter->reload = value;
+    load(pit, counter);
+    break;
+
+  case 2:
+    counter->reload = value << 8;
+    load(pit, counter);
+    break;
+
+  case 3:
+    if (counter->write_high) {
+      counter->reload = (counter->reload & 0x00ff) | value << 8;
+      load(pit, counter);
+    } else {
+      counter->reload = (counter->reload & 0xff00) | value;
+    }
+    counter->write_high = !counter->write_high;
+  }
+}
+
+// nothing counts until a mode and a count are written, like after power on
+bool w86_pit_start(struct w86_cpu_state* state, struct w86_pit* pit) {
+  *pit = (struct w86_pit) { .state = state };
+  for (uint32_t i = 0; i < 3; i++) pit->counters[i].event = (struct w86_event) { .callback = expire, .context = pit };
+  return w86_io_map(state, W86_PIT_PORT, 4, (struct w86_io_device) { .read = read_port, .write = write_port, .context = pit, .size = sizeof(*pit) });
+}
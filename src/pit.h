@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_PIT_H_
+#define W86_PIT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "schedule.h"
+#include "w86.h"
+
+#define W86_PIT_PORT 0x40 // the three counters and then the control word
+#define W86_PIT_CYCLES 4 // cpu cycles per count, 4.77 MHz against 1.19 MHz on the pc
+
+struct w86_pit_counter {
+  struct w86_event event; // counter 0 is wired to irq 0, the others are never scheduled
+  uint64_t start; // cycles when the count was loaded
+  uint16_t reload; // 0 counts 65536
+  uint16_t latch;
+  uint8_t mode;
+  uint8_t access; // 1 for the low byte, 2 for the high one, 3 for both in turn
+  bool counting; // a count was loaded since the mode was set
+  bool latched;
+  bool read_high; // the next read of a two byte access gets the high byte
+  bool write_high; // and the same for writes
+};
+
+// an 8253 counting off the cycle counter, so nothing happens between the interrupts it raises
+// counters are only read back when asked, their gates are always high and mode 3 counts down one at a time
+struct w86_pit {
+  struct w86_pit_counter counters[3];
+  struct w86_cpu_state* state;
+};
+
+// needs a scheduler, and a pic for its interrupts to go anywhere
+bool w86_pit_start(struct w86_cpu_state* state, struct w86_pit* pit);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_PIT_H_ */
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "profile.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "address.h"
+#include "block.h"
+#include "debug.h"
+#include "decode.h"
+#include "schedule.h"
+#include "w86.h"
+
+static inline uint32_t here(const struct w86_cpu_state* state) {
+  return W86_BOUND_ADDRESS(W86_LINEAR_ADDRESS(state->bases.cs, state->registers.ip));
+}
+
+static inline uint32_t bucket(uint32_t parent, uint32_t address) {
+  return (parent * 0x9e3779b1 ^ address * 0x85ebca6b) >> 20 & (W86_PROFILE_NODE_COUNT - 1);
+}
+
+void w86_profile_start(struct w86_cpu_state* state, struct w86_profile* profile, uint32_t interval) {
+  profile->interval = interval;
+  w86_profile_clear(profile);
+  state->profile = profile;
+}
+
+void w86_profile_stop(struct w86_cpu_state* state) {
+  state->profile = nullptr;
+}
+
+// back to nothing counted and an empty call stack
+void w86_profile_clear(struct w86_profile* profile) {
+  profile->countdown = profile->interval;
+  profile->total = 0;
+  profile->node = 0;
+  profile->lost = 0;
+  profile->used = 1;
+  profile->nodes[0] = (struct w86_profile_node) { .address = 0, .parent = 0, .next = 0, .count = 0 };
+  memset(profile->opcodes, 0, sizeof(profile->opcodes));
+  memset(profile->buckets, 0, sizeof(profile->buckets));
+  memset(profile->counts, 0, sizeof(profile->counts));
+}
+
+// cs:ip is already the callee
+void w86_profile_call(struct w86_cpu_state* state) {
+  struct w86_profile* profile = state->profile;
+  uint32_t address = here(state);
+  uint32_t* link = &profile->buckets[bucket(profile->node, address)];
+  for (uint32_t i = *link; i; i = profile->nodes[i].next) {
+    if (profile->nodes[i].parent == profile->node && profile->nodes[i].address == address) {
+      profile->node = i;
+      return;
+    }
+  }
+
+  if (profile->used == W86_PROFILE_NODE_COUNT) {
+    profile->lost++; // the rest gets blamed on the caller
+    return;
+  }
+  profile->nodes[profile->used] = (struct w86_profile_node) { .address = address, .parent = profile->node, .next = *link, .count = 0 };
+  *link = profile->node = profile->used++;
+}
+
+// unmatched rets leave it at the root
+void w86_profile_ret(struct w86_cpu_state* state) {
+  struct w86_profile* profile = state->profile;
+  if (profile->lost) {
+    profile->lost--;
+  } else {
+    profile->node = profile->nodes[profile->node].parent;
+  }
+}
+
+// the instruction about to run stands for the whole interval
+static inline void take_sample(struct w86_cpu_state* state, struct w86_profile* profile) {
+  const struct w86_instruction_info* instruction;
+  profile->counts[here(state)]++;
+  if (w86_decode(state, state->registers.ip, &instruction) == W86_STATUS_SUCCESS) profile->opcodes[instruction->opcode]++;
+  profile->nodes[profile->node].count++;
+  profile->total++;
+}
+
+static enum w86_status sample(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret) {
+  struct w86_profile* profile = state->profile;
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint32_t instructions = 0;
+  while (instructions < max_instructions) {
+    uint32_t budget = max_instructions - instructions < profile->countdown ? max_instructions - instructions : profile->countdown;
+    uint32_t ran;
+    status = w86_block_run(state, budget, &ran);
+    instructions += ran;
+    profile->countdown -= ran;
+    if (!profile->countdown) {
+      take_sample(state, profile);
+      profile->countdown = profile->interval;
+    }
+    if (status != W86_STATUS_SUCCESS || w86_schedule_due(state)) break;
+  }
+
+  *ret = instructions;
+  return status;
+}
+
+// exactly like w86_block_run from the outside, but an instruction at a time when every one gets counted
+enum w86_status w86_profile_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret) {
+  struct w86_profile* profile = state->profile;
+  if (profile->interval) return sample(state, max_instructions, ret);
+
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint32_t instructions = 0;
+  while (instructions < max_instructions) {
+    if (state->debug && w86_debug_break(state)) {
+      status = W86_STATUS_BREAKPOINT;
+      break;
+    }
+
+    uint32_t address = here(state);
+    uint32_t node = profile->node; // a call belongs to the caller
+    const struct w86_instruction_info* instruction;
+    status = w86_decode(state, state->registers.ip, &instruction);
+    if (status != W86_STATUS_SUCCESS) break;
+
+    uint8_t opcode = instruction->opcode;
+    uint8_t cycles = instruction->cycles;
+    status = instruction->handler(state, instruction);
+    if (status != W86_STATUS_SUCCESS && status != W86_STATUS_HALT) break;
+
+    profile->counts[address]++;
+    profile->opcodes[opcode]++;
+    profile->nodes[node].count++;
+    profile->total++;
+    state->cycles += cycles;
+    instructions++;
+    if (status == W86_STATUS_SUCCESS) status = w86_debug_status(state);
+    if (status != W86_STATUS_SUCCESS || w86_schedule_due(state)) break;
+  }
+
+  *ret = instructions;
+  return status;
+}
+
+// snprintf that keeps counting once out is full
+static void append(char* out, uint32_t size, uint32_t* length, const char* format, uint32_t value) {
+  *length += snprintf(*length < size ? out + *length : nullptr, *length < size ? size - *length : 0, format, value);
+}
+
+uint32_t w86_profile_folded(const struct w86_profile* profile, char* out, uint32_t size) {
+  uint32_t length = 0;
+  uint32_t path[W86_PROFILE_NODE_COUNT];
+  for (uint32_t i = 0; i < profile->used; i++) {
+    if (!profile->nodes[i].count) continue;
+
+    uint32_t depth = 0;
+    for (uint32_t node = i; node; node = profile->nodes[node].parent) path[depth++] = profile->nodes[node].address;
+    append(out, size, &length, "root", 0);
+    while (depth--) append(out, size, &length, ";%05x", path[depth]);
+    append(out, size, &length, " %u\n", profile->nodes[i].count);
+  }
+
+  return length;
+}
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_PROFILE_H_
+#define W86_PROFILE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_PROFILE_NODE_COUNT 4096 // power of two, it doubles as the hash table size
+
+// a frame of the shadow call stack, there's one per distinct path of calls from the root
+struct w86_profile_node {
+  uint32_t address; // linear address that got called, 0 for the root
+  uint32_t parent;
+  uint32_t next; // in the hash chain, 0 ends it since the root is never in one
+  uint32_t count; // instructions or samples with this as the innermost frame
+};
+
+// with an interval of 0 every retired instruction gets counted at its linear address
+// otherwise only cs:ip every interval instructions, the batches just get cut into slices that long
+// call and ret keep the shadow call stack going in both modes, only direct and far calls are implemented so far
+struct w86_profile {
+  uint32_t interval;
+  uint32_t countdown; // instructions left until the next sample
+  uint64_t total; // instructions or samples counted
+  uint32_t node; // innermost frame
+  uint32_t lost; // frames that didn't fit in the pool, their rets don't pop anything
+  uint32_t used;
+  uint32_t opcodes[256];
+  uint32_t buckets[W86_PROFILE_NODE_COUNT];
+  struct w86_profile_node nodes[W86_PROFILE_NODE_COUNT];
+  uint32_t counts[W86_MEMORY_SIZE];
+};
+
+// tracing goes first if both are on, replays of the history are neither counted nor traced twice
+void w86_profile_start(struct w86_cpu_state* state, struct w86_profile* profile, uint32_t interval);
+void w86_profile_stop(struct w86_cpu_state* state);
+void w86_profile_clear(struct w86_profile* profile);
+enum w86_status w86_profile_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret);
+
+void w86_profile_call(struct w86_cpu_state* state);
+void w86_profile_ret(struct w86_cpu_state* state);
+
+// folded stacks for flamegraph.pl and friends, a line per frame with a count: "root;0f01a;0f2c4 1234"
+// returns the length it needs, only as much as fits gets written and out is always terminated if size isn't 0
+uint32_t w86_profile_folded(const struct w86_profile* profile, char* out, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_PROFILE_H_ */
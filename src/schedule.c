@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "schedule.h"
+
+#include <stdint.h>
+
+#include "history.h"
+#include "w86.h"
+
+static inline void place(struct w86_scheduler* scheduler, uint32_t i, struct w86_event* event) {
+  scheduler->heap[i] = event;
+  event->slot = i + 1;
+}
+
+static void sift_up(struct w86_scheduler* scheduler, uint32_t i) {
+  struct w86_event* event = scheduler->heap[i];
+  while (i && scheduler->heap[(i - 1) / 2]->deadline > event->deadline) {
+    place(scheduler, i, scheduler->heap[(i - 1) / 2]);
+    i = (i - 1) / 2;
+  }
+  place(scheduler, i, event);
+}
+
+static void sift_down(struct w86_scheduler* scheduler, uint32_t i) {
+  struct w86_event* event = scheduler->heap[i];
+  while (2 * i + 1 < scheduler->count) {
+    uint32_t child = 2 * i + 1;
+    if (child + 1 < scheduler->count && scheduler->heap[child + 1]->deadline < scheduler->heap[child]->deadline) child++;
+    if (scheduler->heap[child]->deadline >= event->deadline) break;
+    place(scheduler, i, scheduler->heap[child]);
+    i = child;
+  }
+  place(scheduler, i, event);
+}
+
+void w86_scheduler_start(struct w86_cpu_state* state, struct w86_scheduler* scheduler) {
+  *scheduler = (struct w86_scheduler) { .count = 0, .stop = UINT64_MAX };
+  state->scheduler = scheduler;
+}
+
+// whatever was pending just never fires
+void w86_scheduler_stop(struct w86_cpu_state* state) {
+  struct w86_scheduler* scheduler = state->scheduler;
+  for (uint32_t i = 0; i < scheduler->count; i++) scheduler->heap[i]->slot = 0;
+  state->scheduler = nullptr;
+}
+
+// moves it if it's already pending, false if the heap is full
+bool w86_schedule(struct w86_cpu_state* state, struct w86_event* event, uint64_t deadline) {
+  struct w86_scheduler* scheduler = state->scheduler;
+  if (!event->slot) {
+    if (scheduler->count == W86_SCHEDULER_SIZE) return false;
+    event->deadline = deadline;
+    place(scheduler, scheduler->count++, event);
+    sift_up(scheduler, scheduler->count - 1);
+  } else {
+    uint64_t was = event->deadline;
+    event->deadline = deadline;
+    if (deadline < was) {
+      sift_up(scheduler, event->slot - 1);
+    } else {
+      sift_down(scheduler, event->slot - 1);
+    }
+  }
+  if (deadline < scheduler->stop) scheduler->stop = deadline; // a device was programmed in the middle of a slice
+  return true;
+}
+
+void w86_unschedule(struct w86_cpu_state* state, struct w86_event* event) {
+  struct w86_scheduler* scheduler = state->scheduler;
+  if (!event->slot) return;
+
+  uint32_t i = event->slot - 1;
+  event->slot = 0;
+  if (i == --scheduler->count) return;
+
+  // the last one fills the hole and goes whichever way it has to
+  struct w86_event* moved = scheduler->heap[scheduler->count];
+  place(scheduler, i, moved);
+  sift_up(scheduler, i);
+  if (moved->slot == i + 1) sift_down(scheduler, i);
+}
+
+// fires everything that's due in deadline order, callbacks are free to schedule their events again
+// deadlines are absolute, the cycles only go back on a snapshot restore, which brings the devices back with them,
+// or on a seek, which can't go back past here since the devices moved on where the journal didn't see
+void w86_schedule_dispatch(struct w86_cpu_state* state) {
+  struct w86_scheduler* scheduler = state->scheduler;
+  if (scheduler->count && scheduler->heap[0]->deadline <= state->cycles) w86_history_reset(state);
+
+  while (scheduler->count && scheduler->heap[0]->deadline <= state->cycles) {
+    struct w86_event* event = scheduler->heap[0];
+    w86_unschedule(state, event);
+    event->callback(state, event->context);
+  }
+  scheduler->stop = w86_schedule_next(scheduler);
+}
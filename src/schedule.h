@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_SCHEDULE_H_
+#define W86_SCHEDULE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+#define W86_SCHEDULER_SIZE 16 // events that can be pending at once
+
+typedef void w86_event_callback(struct w86_cpu_state* state, void* context);
+
+// owned by whoever schedules it, usually a device with one per timer
+struct w86_event {
+  w86_event_callback* callback;
+  void* context;
+  uint64_t deadline; // in state->cycles
+  uint32_t slot; // in the heap plus one, 0 while it isn't pending
+};
+
+// a binary min-heap on the deadlines, so the next one is always at the top
+// the run loop cuts its batches there, devices are only ever looked at when something of theirs is due
+struct w86_scheduler {
+  struct w86_event* heap[W86_SCHEDULER_SIZE];
+  uint32_t count;
+  uint64_t stop; // the run loops hand control back once the cycles get here
+};
+
+void w86_scheduler_start(struct w86_cpu_state* state, struct w86_scheduler* scheduler);
+void w86_scheduler_stop(struct w86_cpu_state* state);
+bool w86_schedule(struct w86_cpu_state* state, struct w86_event* event, uint64_t deadline);
+void w86_unschedule(struct w86_cpu_state* state, struct w86_event* event);
+void w86_schedule_dispatch(struct w86_cpu_state* state);
+
+static inline uint64_t w86_schedule_next(const struct w86_scheduler* scheduler) {
+  return scheduler->count ? scheduler->heap[0]->deadline : UINT64_MAX;
+}
+
+// checked after every block, so an event is never late by more than one of them
+static inline bool w86_schedule_due(const struct w86_cpu_state* state) {
+  return state->scheduler && state->cycles >= state->scheduler->stop;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_SCHEDULE_H_ */
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "snapshot.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "address.h"
+#include "debug.h"
+#include "history.h"
+#include "io.h"
+#include "schedule.h"
+#include "w86.h"
+
+#define PAGE_BYTES (1 << W86_SNAPSHOT_PAGE_SIZE)
+#define PAGE_DIRTY_WORDS (PAGE_BYTES >> W86_DIRTY_LINE_SIZE >> 5) // words of the ui's bitmaps covering one page
+
+static inline bool page_dirty(const uint32_t* bitmap, uint32_t page) {
+  return bitmap[page / 32] >> page % 32 & 1;
+}
+
+// device state is small, so it's copied every time
+static void save_devices(struct w86_cpu_state* state, struct w86_snapshot* snapshot) {
+  w86_io_flush(state); // queued writes belong to the state being saved
+  snapshot->device_count = state->io_devices.count;
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < state->io_devices.count; i++) {
+    const struct w86_io_device* device = &state->io_devices.devices[i];
+    snapshot->devices[i] = device->context;
+    memcpy(&snapshot->device_state[offset], device->context, device->size);
+    offset += device->size;
+  }
+
+  snapshot->scheduled = state->scheduler;
+  if (state->scheduler) snapshot->scheduler = *state->scheduler;
+}
+
+// left alone if the devices aren't the ones that were saved
+static void restore_devices(struct w86_cpu_state* state, const struct w86_snapshot* snapshot) {
+  if (snapshot->device_count != state->io_devices.count || snapshot->scheduled != (state->scheduler != nullptr)) return;
+  for (uint32_t i = 0; i < snapshot->device_count; i++) {
+    if (snapshot->devices[i] != state->io_devices.devices[i].context) return;
+  }
+
+  w86_io_flush(state);
+  uint32_t offset = 0;
+  for (uint32_t i = 0; i < state->io_devices.count; i++) {
+    const struct w86_io_device* device = &state->io_devices.devices[i];
+    memcpy(device->context, &snapshot->device_state[offset], device->size);
+    offset += device->size;
+  }
+
+  // the deadlines are in cycles, which go back to the snapshot's too
+  if (state->scheduler) {
+    *state->scheduler = snapshot->scheduler;
+    state->scheduler->stop = w86_schedule_next(state->scheduler);
+  }
+}
+
+// only the pages written since are copied when the snapshot is taken again, anything else copies everything
+void w86_snapshot_take(struct w86_cpu_state* state, struct w86_snapshot* snapshot) {
+  bool all = state->snapshot_dirty.snapshot != snapshot;
+  snapshot->registers = state->registers;
+  snapshot->lazy_flags = state->lazy_flags;
+  snapshot->cycles = state->cycles;
+
+  for (uint32_t page = 0; page < W86_SNAPSHOT_PAGE_COUNT; page++) {
+    if (!all && !page_dirty(state->snapshot_dirty.memory, page)) continue;
+    const uint8_t* host = w86_debug_page(state, page)->read;
+    if (host) {
+      memcpy(&snapshot->memory[page * PAGE_BYTES], host, PAGE_BYTES);
+    } else {
+      memset(&snapshot->memory[page * PAGE_BYTES], 0, PAGE_BYTES);
+    }
+  }
+  for (uint32_t page = 0; page < W86_SNAPSHOT_IO_PAGE_COUNT; page++) {
+    if (!all && !page_dirty(&state->snapshot_dirty.io, page)) continue;
+    memcpy(&snapshot->reads[page * PAGE_BYTES], &state->io.reads[page * PAGE_BYTES], PAGE_BYTES);
+    memcpy(&snapshot->writes[page * PAGE_BYTES], &state->io.writes[page * PAGE_BYTES], PAGE_BYTES);
+  }
+  save_devices(state, snapshot);
+
+  state->snapshot_dirty = (struct w86_snapshot_dirty) { .snapshot = snapshot };
+}
+
+// only copies back the pages written since the snapshot was last taken or restored, unless it's a different one
+void w86_snapshot_restore(struct w86_cpu_state* state, const struct w86_snapshot* snapshot) {
+  bool all = state->snapshot_dirty.snapshot != snapshot;
+
+  for (uint32_t page = 0; page < W86_SNAPSHOT_PAGE_COUNT; page++) {
+    if (!all && !page_dirty(state->snapshot_dirty.memory, page)) continue;
+    uint8_t* host = w86_debug_page(state, page)->write;
+    if (!host) continue;
+    memcpy(host, &snapshot->memory[page * PAGE_BYTES], PAGE_BYTES);
+    w86_span_written(state, page * PAGE_BYTES, 0, PAGE_BYTES); // redraws it and drops code cached from it
+  }
+  for (uint32_t page = 0; page < W86_SNAPSHOT_IO_PAGE_COUNT; page++) {
+    if (!all && !page_dirty(&state->snapshot_dirty.io, page)) continue;
+    memcpy(&state->io.reads[page * PAGE_BYTES], &snapshot->reads[page * PAGE_BYTES], PAGE_BYTES);
+    memcpy(&state->io.writes[page * PAGE_BYTES], &snapshot->writes[page * PAGE_BYTES], PAGE_BYTES);
+    memset(&state->dirty.io[page * PAGE_DIRTY_WORDS], 0xff, PAGE_DIRTY_WORDS * sizeof(uint32_t));
+  }
+
+  state->registers = snapshot->registers;
+  state->lazy_flags = snapshot->lazy_flags;
+  state->cycles = snapshot->cycles;
+  restore_devices(state, snapshot);
+  w86_segments_update(state);
+  w86_history_reset(state);
+  state->snapshot_dirty = (struct w86_snapshot_dirty) { .snapshot = snapshot };
+}
+
+// the next restore copies everything, for when memory was changed where the core couldn't see it
+void w86_snapshot_invalidate(struct w86_cpu_state* state) {
+  state->snapshot_dirty.snapshot = nullptr;
+}
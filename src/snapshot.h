@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_SNAPSHOT_H_
+#define W86_SNAPSHOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "schedule.h"
+#include "w86.h"
+
+#define W86_SNAPSHOT_PAGE_COUNT (W86_MEMORY_SIZE >> W86_SNAPSHOT_PAGE_SIZE)
+#define W86_SNAPSHOT_IO_PAGE_COUNT ((1 << 16) >> W86_SNAPSHOT_PAGE_SIZE)
+
+// everything a program can change, port devices included as far as they gave their state a size
+// mmio pages aren't captured and rom pages aren't written back, the bus and io mappings are left as they are
+// devices and the scheduler only come back if the same devices are still mapped, its events belong to them
+struct w86_snapshot {
+  struct w86_register_file registers;
+  struct w86_lazy_flags lazy_flags;
+  uint64_t cycles;
+  uint8_t memory[W86_MEMORY_SIZE];
+  uint8_t reads[1 << 16];
+  uint8_t writes[1 << 16];
+  void* devices[W86_IO_DEVICE_COUNT]; // contexts, to tell whether they're the same ones
+  uint32_t device_count;
+  uint8_t device_state[W86_IO_STATE_SIZE];
+  bool scheduled;
+  struct w86_scheduler scheduler;
+};
+
+void w86_snapshot_take(struct w86_cpu_state* state, struct w86_snapshot* snapshot);
+void w86_snapshot_restore(struct w86_cpu_state* state, const struct w86_snapshot* snapshot);
+void w86_snapshot_invalidate(struct w86_cpu_state* state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_SNAPSHOT_H_ */
@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "trace.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "address.h"
+#include "debug.h"
+#include "decode.h"
+#include "schedule.h"
+#include "w86.h"
+
+// the most a record can take apart from its instruction bytes and its writes, and the most each write can take
+#define RECORD_SIZE (1 + 2 + 3 + 3 + 2 + 2 * W86_TRACE_REGISTER_COUNT + 5)
+#define WRITE_SIZE (5 + 1)
+
+static void spill(struct w86_trace* trace) {
+  if (trace->output) {
+    trace->output(trace->context, trace->buffer, trace->used);
+    trace->used = 0;
+  } else {
+    trace->full = true;
+  }
+}
+
+static inline void put(struct w86_trace* trace, uint8_t byte) {
+  if (trace->used == trace->size) spill(trace);
+  if (!trace->full) trace->buffer[trace->used++] = byte;
+}
+
+static inline void put_word(struct w86_trace* trace, uint16_t word) {
+  put(trace, word);
+  put(trace, word >> 8);
+}
+
+static inline void put_varint(struct w86_trace* trace, uint32_t value) {
+  for (; value >= 0x80; value >>= 7) put(trace, value | 0x80);
+  put(trace, value);
+}
+
+static inline uint32_t zigzag(int32_t value) {
+  return (uint32_t) value << 1 ^ (uint32_t) (value >> 31);
+}
+
+// the journal only has what got overwritten, the new value is whatever is there now
+static void put_writes(struct w86_cpu_state* state, uint64_t first, uint64_t last) {
+  struct w86_trace* trace = state->trace;
+  const struct w86_journal* journal = state->journal;
+  put_varint(trace, last - first);
+  for (uint64_t i = first; i < last; i++) {
+    uint32_t entry = journal->entries[i & (journal->size - 1)];
+    uint32_t address = entry & ((1 << 20) - 1);
+    bool port = entry & W86_JOURNAL_IO;
+    put_varint(trace, zigzag((int32_t) (address - trace->address)) << 1 | port);
+    put(trace, port ? state->io.writes[address] : w86_fetch_byte(state, address, 0));
+    trace->address = address;
+  }
+}
+
+static void record(struct w86_cpu_state* state, uint16_t cs, uint16_t ip, const uint8_t* bytes, uint16_t size, uint64_t head) {
+  struct w86_trace* trace = state->trace;
+  const struct w86_journal* journal = state->journal;
+  uint64_t writes = trace->writes && journal ? journal->head - head : 0;
+  if (journal && writes > journal->size) writes = journal->size; // only the newest ones are still there
+
+  uint16_t mask = 0;
+  uint16_t registers[W86_TRACE_REGISTER_COUNT], last[W86_TRACE_REGISTER_COUNT];
+  if (trace->registers) {
+    struct w86_register_file file = w86_cpu_get_registers(state);
+    memcpy(registers, &file, sizeof(registers));
+    memcpy(last, &trace->last, sizeof(last));
+    for (uint32_t i = 0; i < W86_TRACE_REGISTER_COUNT; i++) mask |= (registers[i] != last[i]) << i;
+    mask &= ~(1 << offsetof(struct w86_register_file, ip) / sizeof(uint16_t)); // the next record's location has it
+    trace->last = file;
+  }
+
+  if (!trace->output && trace->used + RECORD_SIZE + size + writes * WRITE_SIZE > trace->size) trace->full = true;
+  if (trace->full) return;
+
+  put(trace, (cs != trace->cs ? W86_TRACE_CS : 0)
+           | (ip != trace->ip ? W86_TRACE_IP : 0)
+           | (mask ? W86_TRACE_REGISTERS : 0)
+           | (writes ? W86_TRACE_WRITES : 0));
+  if (cs != trace->cs) put_word(trace, cs);
+  if (ip != trace->ip) put_varint(trace, zigzag((int16_t) (ip - trace->ip)));
+  put_varint(trace, size);
+  for (uint32_t i = 0; i < size; i++) put(trace, bytes[i]);
+  trace->cs = cs;
+  trace->ip = ip + size;
+
+  if (mask) {
+    put_word(trace, mask);
+    for (uint32_t i = 0; i < W86_TRACE_REGISTER_COUNT; i++) {
+      if (mask >> i & 1) put_word(trace, registers[i]);
+    }
+  }
+
+  if (writes) put_writes(state, journal->head - writes, journal->head);
+}
+
+// the history went back over journal entries first to last and replayed what it had to
+// the replay writes a subset of the same places, so they're all there is to bring a reader's memory up to date
+void w86_trace_rewind(struct w86_cpu_state* state, uint64_t first, uint64_t last) {
+  struct w86_trace* trace = state->trace;
+  uint64_t writes = trace->writes && state->journal ? last - first : 0;
+  if (!trace->output && trace->used + 1 + 5 + writes * WRITE_SIZE > trace->size) trace->full = true;
+  if (trace->full) return;
+
+  put(trace, W86_TRACE_REWIND | (writes ? W86_TRACE_WRITES : 0));
+  if (writes) put_writes(state, first, last);
+}
+
+void w86_trace_start(struct w86_cpu_state* state, struct w86_trace* trace, uint8_t* buffer, uint32_t size,
+                     w86_trace_output* output, void* context, bool registers, bool writes) {
+  struct w86_register_file file = w86_cpu_get_registers(state);
+  *trace = (struct w86_trace) {
+    .buffer = buffer,
+    .size = size,
+    .output = output,
+    .context = context,
+    .registers = registers,
+    .writes = writes,
+    .cs = file.cs,
+    .ip = file.ip,
+    .last = file,
+    .journal = { .entries = trace->entries, .size = W86_TRACE_JOURNAL_SIZE }
+  };
+  state->trace = trace;
+
+  for (uint32_t i = 0; i < strlen(W86_TRACE_MAGIC); i++) put(trace, W86_TRACE_MAGIC[i]);
+  put(trace, W86_TRACE_VERSION);
+  uint16_t words[W86_TRACE_REGISTER_COUNT];
+  memcpy(words, &file, sizeof(words));
+  for (uint32_t i = 0; i < W86_TRACE_REGISTER_COUNT; i++) put_word(trace, words[i]);
+}
+
+void w86_trace_stop(struct w86_cpu_state* state) {
+  w86_trace_flush(state);
+  state->trace = nullptr;
+}
+
+void w86_trace_flush(struct w86_cpu_state* state) {
+  struct w86_trace* trace = state->trace;
+  if (trace->output && trace->used) spill(trace);
+}
+
+// like w86_block_run, but an instruction at a time so each one can be recorded
+enum w86_status w86_trace_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret) {
+  struct w86_trace* trace = state->trace;
+  bool borrowed = trace->writes && !state->journal;
+  if (borrowed) state->journal = &trace->journal;
+
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint32_t instructions = 0;
+  while (instructions < max_instructions) {
+    if (state->debug && w86_debug_break(state)) {
+      status = W86_STATUS_BREAKPOINT;
+      break;
+    }
+
+    uint16_t cs = state->registers.cs, ip = state->registers.ip;
+    const struct w86_instruction_info* instruction;
+    status = w86_decode(state, ip, &instruction);
+    if (status != W86_STATUS_SUCCESS) break;
+
+    for (uint32_t i = 0; i < instruction->size; i++) trace->bytes[i] = w86_fetch_byte(state, state->bases.cs, ip + i);
+    uint64_t head = state->journal ? state->journal->head : 0;
+    status = instruction->handler(state, instruction);
+    if (status != W86_STATUS_SUCCESS && status != W86_STATUS_HALT) break;
+
+    record(state, cs, ip, trace->bytes, instruction->size, head);
+    state->cycles += instruction->cycles;
+    instructions++;
+    if (status == W86_STATUS_SUCCESS) status = w86_debug_status(state);
+    if (status != W86_STATUS_SUCCESS || w86_schedule_due(state)) break;
+  }
+
+  if (borrowed) state->journal = nullptr;
+  *ret = instructions;
+  return status;
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_TRACE_H_
+#define W86_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "w86.h"
+
+// a trace starts with "W86T", the version and the 14 registers as little endian words in register file order
+// then there's a record per retired instruction:
+//   u8 flags
+//   u16 cs                     if W86_TRACE_CS, otherwise it's the cs of the previous record
+//   varint zigzag(ip - next)   if W86_TRACE_IP, next being where the previous record's instruction ended
+//   varint size, size bytes    the instruction as it was fetched, prefixes and all
+//   u16 mask, u16 per bit set  if W86_TRACE_REGISTERS, the registers that changed, flags included and ip left out
+//   varint count, per write:   if W86_TRACE_WRITES
+//     varint zigzag(address - previous address) << 1 | port, u8 value
+// a record with W86_TRACE_REWIND in its flags is the history going back instead, it has nothing but the writes
+// and those are the places the rewind changed, with the values they have now
+// varints are unsigned leb128, write addresses carry over from one record to the next
+#define W86_TRACE_MAGIC "W86T"
+#define W86_TRACE_VERSION 2
+
+#define W86_TRACE_CS 0b0001
+#define W86_TRACE_IP 0b0010
+#define W86_TRACE_REGISTERS 0b0100
+#define W86_TRACE_WRITES 0b1000
+#define W86_TRACE_REWIND 0b10000
+
+#define W86_TRACE_REGISTER_COUNT (sizeof(struct w86_register_file) / sizeof(uint16_t))
+#define W86_TRACE_JOURNAL_SIZE (1 << 17) // room for the biggest rep movs or stos
+
+typedef void w86_trace_output(void* context, const uint8_t* data, uint32_t size);
+
+// the buffer is handed to output whenever it fills up and after every w86_cpu_run
+// without an output the trace just stops once the buffer is full
+struct w86_trace {
+  uint8_t* buffer;
+  uint32_t size;
+  uint32_t used;
+  w86_trace_output* output;
+  void* context;
+  bool registers;
+  bool writes;
+  bool full;
+  uint16_t cs; // where the next instruction is expected
+  uint16_t ip;
+  uint32_t address; // of the last write
+  struct w86_register_file last;
+  struct w86_journal journal; // only used if there's no history to borrow one from
+  uint32_t entries[W86_TRACE_JOURNAL_SIZE];
+  uint8_t bytes[1 << 16]; // the instruction being run, fetched before it can write over itself
+};
+
+// tracing is checked once per batch, a traced batch goes an instruction at a time instead of through the blocks
+void w86_trace_start(struct w86_cpu_state* state, struct w86_trace* trace, uint8_t* buffer, uint32_t size,
+                     w86_trace_output* output, void* context, bool registers, bool writes);
+void w86_trace_stop(struct w86_cpu_state* state);
+void w86_trace_flush(struct w86_cpu_state* state);
+void w86_trace_rewind(struct w86_cpu_state* state, uint64_t first, uint64_t last);
+enum w86_status w86_trace_run(struct w86_cpu_state* state, uint32_t max_instructions, uint32_t* ret);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* W86_TRACE_H_ */
@@ -2,10 +2,151 @@
 
 #include "w86.h"
 
+#include "address.h"
+#include "block.h"
+#include "debug.h"
 #include "decode.h"
+#include "flags.h"
+#include "history.h"
+#include "io.h"
+#include "pic.h"
+#include "profile.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "trace.h"
+
+// no instruction but the string ones costs more than this, so a slice of remaining / SLICE_CYCLES instructions can't overshoot by much
+#define SLICE_CYCLES 40
+#define INTERRUPT_WINDOW 16 // instructions at a time while an interrupt waits for sti or an eoi
 
 enum w86_status w86_cpu_step(struct w86_cpu_state* state) {
-  enum w86_status status = w86_decode(state);
+  if (state->debug) state->debug->resume = true; // stepping doesn't stop on breakpoints, only watchpoints
+  if (state->history || state->trace || state->profile || state->debug || state->scheduler) return w86_cpu_run(state, 1).status; // so it gets counted and recorded
+
+  const struct w86_instruction_info* instruction;
+  enum w86_status status = w86_decode(state, state->registers.ip, &instruction);
+  if (status != W86_STATUS_SUCCESS) return status;
 
+  status = instruction->handler(state, instruction);
+  if (status == W86_STATUS_SUCCESS || status == W86_STATUS_HALT) state->cycles += instruction->cycles;
+  w86_io_flush(state);
   return status;
 }
+
+static struct w86_run_result execute(struct w86_cpu_state* state, uint32_t max_instructions) {
+  struct w86_run_result result;
+  if (state->history) {
+    result = w86_history_run(state, max_instructions); // the same thing in slices ending on checkpoints
+  } else if (state->trace) {
+    result.status = w86_trace_run(state, max_instructions, &result.instructions);
+  } else if (state->profile) {
+    result.status = w86_profile_run(state, max_instructions, &result.instructions);
+  } else {
+    result.status = w86_block_run(state, max_instructions, &result.instructions);
+  }
+
+  return result;
+}
+
+// hlt with interrupts on, or a poll, skips straight to the next event instead of spinning through the time until then
+// a hlt nothing can end stays a halt and a poll only the host can end stays a poll
+static enum w86_status idle(struct w86_cpu_state* state, enum w86_status status, uint64_t until) {
+  if (!(state->registers.flags & W86_FLAGS_IF) || !state->pic) return status;
+
+  uint64_t next = w86_schedule_next(state->scheduler);
+  if (next > until) next = until;
+  if (next == UINT64_MAX) return status;
+
+  w86_history_reset(state); // a replay couldn't skip the same way
+  if (next > state->cycles) state->cycles = next;
+  w86_schedule_dispatch(state);
+  if (w86_pic_interrupt(state)) return W86_STATUS_SUCCESS; // returns past the hlt
+
+  if (status == W86_STATUS_HALT) state->registers.ip--; // back on the hlt, the next run carries on waiting
+  return W86_STATUS_SUCCESS;
+}
+
+// timed devices cut the batch into slices that end on their next deadline, so in between they cost nothing
+// a request the pic couldn't get through yet is tried again every few instructions instead
+static struct w86_run_result run(struct w86_cpu_state* state, uint32_t max_instructions, uint64_t until) {
+  if (!state->scheduler) return execute(state, max_instructions);
+
+  struct w86_run_result result = { .status = W86_STATUS_SUCCESS, .instructions = 0 };
+  while (result.status == W86_STATUS_SUCCESS && result.instructions < max_instructions && state->cycles < until) {
+    w86_schedule_dispatch(state);
+    if (state->pic) w86_pic_interrupt(state);
+    if (until < state->scheduler->stop) state->scheduler->stop = until;
+
+    uint32_t slice = max_instructions - result.instructions; // the run loops stop on their own at the next event
+    if (state->pic && w86_pic_waiting(state->pic) && slice > INTERRUPT_WINDOW) slice = INTERRUPT_WINDOW;
+
+    struct w86_run_result ran = execute(state, slice);
+    result.status = ran.status;
+    result.instructions += ran.instructions;
+    if (result.status == W86_STATUS_HALT || result.status == W86_STATUS_POLL) result.status = idle(state, result.status, until);
+  }
+
+  return result;
+}
+
+// until is in cycles, and only holds when there's a scheduler to stop the run loops
+static struct w86_run_result batch(struct w86_cpu_state* state, uint32_t max_instructions, uint64_t until) {
+  struct w86_run_result result = { .status = W86_STATUS_SUCCESS, .instructions = 0 };
+  if (state->debug && state->debug->resume && max_instructions) {
+    result = run(state, 1, until); // off the breakpoint it stopped on last time
+    state->debug->resume = false;
+  }
+  if (result.status == W86_STATUS_SUCCESS && result.instructions < max_instructions) {
+    struct w86_run_result rest = run(state, max_instructions - result.instructions, until);
+    result.status = rest.status;
+    result.instructions += rest.instructions;
+  }
+  w86_io_flush(state); // batched devices see everything the batch wrote
+  if (state->trace) w86_trace_flush(state);
+
+  return result;
+}
+
+// runs until something other than a plain success comes back or the instruction budget runs out
+// with a scheduler and a pic, a hlt or a poll with interrupts on waits for the next interrupt inside the call
+struct w86_run_result w86_cpu_run(struct w86_cpu_state* state, uint32_t max_instructions) {
+  return batch(state, max_instructions, UINT64_MAX);
+}
+
+// for pacing, runs until at least max_cycles more have gone by, one instruction over at most unless it's a long rep
+// it's cut into slices that shrink as the budget runs out, w86_cpu_run stays the way to go flat out
+// waiting in a hlt never skips past the end, so paced time still goes by at the same rate
+struct w86_run_result w86_cpu_run_cycles(struct w86_cpu_state* state, uint32_t max_cycles) {
+  struct w86_run_result result = { .status = W86_STATUS_SUCCESS, .instructions = 0 };
+  uint64_t end = state->cycles + max_cycles;
+  while (result.status == W86_STATUS_SUCCESS && state->cycles < end) {
+    uint32_t slice = (end - state->cycles) / SLICE_CYCLES;
+    struct w86_run_result ran = batch(state, slice ? slice : 1, end);
+    result.status = ran.status;
+    result.instructions += ran.instructions;
+  }
+
+  return result;
+}
+
+// has to be called whenever memory or the io arrays are modified behind the core's back
+void w86_cpu_invalidate(struct w86_cpu_state* state) {
+  w86_decode_invalidate(state);
+  w86_snapshot_invalidate(state);
+  w86_history_reset(state);
+}
+
+// the flags in the register file can lag behind, so this is what everything outside the core should look at
+struct w86_register_file w86_cpu_get_registers(const struct w86_cpu_state* state) {
+  struct w86_register_file registers = state->registers;
+  registers.flags = w86_flags_get(state);
+
+  return registers;
+}
+
+void w86_cpu_set_registers(struct w86_cpu_state* state, struct w86_register_file registers) {
+  state->registers = registers;
+  state->lazy_flags.op = W86_FLAGS_OP_NONE;
+  w86_segments_update(state);
+  w86_history_reset(state); // replaying across this wouldn't end up here
+}
@@ -9,6 +9,18 @@ extern "C" {
 
 #include <stdint.h>
 
+enum w86_status {
+  W86_STATUS_SUCCESS,
+  W86_STATUS_HALT,
+  W86_STATUS_UNKNOWN_ERROR,
+  W86_STATUS_UNDEFINED_OPCODE,
+  W86_STATUS_UNIMPLEMENTED_OPCODE,
+  W86_STATUS_INVALID_OPERATION,
+  W86_STATUS_BREAKPOINT, // the debug hit has which one
+  W86_STATUS_WATCHPOINT,
+  W86_STATUS_POLL // spinning on a port only the host can change, cs:ip is at the start of the loop
+};
+
 struct w86_register_file {
   uint16_t ax;
   uint16_t bx;
@@ -36,26 +48,273 @@ struct w86_io_ports {
 #endif
 };
 
-struct w86_cpu_state {
+enum w86_segment_prefix {
+  W86_SEGMENT_PREFIX_NONE,
+  W86_SEGMENT_PREFIX_CS,
+  W86_SEGMENT_PREFIX_DS,
+  W86_SEGMENT_PREFIX_ES,
+  W86_SEGMENT_PREFIX_SS
+};
+
+enum w86_repeat_prefix {
+  W86_REPEAT_PREFIX_NONE,
+  W86_REPEAT_PREFIX_REP,
+  W86_REPEAT_PREFIX_REPE = W86_REPEAT_PREFIX_REP,
+  W86_REPEAT_PREFIX_REPNE
+};
+
+struct w86_instruction_prefixes {
+  enum w86_segment_prefix segment;
+  enum w86_repeat_prefix repeat;
+  bool lock;
+};
+
+struct w86_cpu_state;
+struct w86_instruction_info;
+
+typedef enum w86_status w86_instruction(struct w86_cpu_state* state, const struct w86_instruction_info* instruction);
+
+// everything about an instruction that only depends on its bytes, so it can be decoded once and reused
+struct w86_instruction_info {
+  w86_instruction* handler;
+  struct w86_instruction_prefixes prefixes;
+  uint8_t opcode;
+  uint8_t modrm;
+  int16_t disp;
+  uint16_t imm; // sign extended for imm8sbw and rel8 operands
+  uint16_t imm2; // segment of far pointers
+  uint16_t size; // prefixes included, the 8086 takes any number of them
+  uint8_t cycles; // 8086 clocks including the effective address, handlers add whatever depends on the operands
+};
+
+#define W86_DECODE_CACHE_SIZE 4096
+#define W86_CODE_PAGE_SIZE 12
+#define W86_CODE_PAGE_COUNT (1 << (20 - W86_CODE_PAGE_SIZE))
+
+struct w86_decode_cache_entry {
+  struct w86_instruction_info instruction;
+  uint32_t address;
+  uint32_t generation;
+};
+
+struct w86_decode_cache {
+  struct w86_decode_cache_entry entries[W86_DECODE_CACHE_SIZE];
+  uint32_t generations[W86_CODE_PAGE_COUNT]; // bumped whenever a page with cached code is written
+  bool pages[W86_CODE_PAGE_COUNT];
+  struct w86_instruction_info scratch; // for instructions that can't be cached
+};
+
+#define W86_BLOCK_CACHE_SIZE 1024
+#define W86_BLOCK_POOL_SIZE 8192
+#define W86_BLOCK_MAX_LENGTH 32
+
+typedef uint32_t w86_jit_function(struct w86_cpu_state* state); // returns how many instructions were retired
+
+// a straight-line run of instructions ending in a branch, translated once and then executed back to back
+struct w86_block {
+  struct w86_block* next[2]; // fallthrough and branch target links
+  w86_jit_function* jit; // compiled once the block gets hot
+  uint32_t executions;
+  uint32_t address;
+  uint32_t generation;
+  uint32_t epoch;
+  uint16_t start; // index into the micro-op pool
+  uint16_t bytes;
+  uint16_t cycles; // of all its instructions, so a whole block only adds once
+  uint8_t length;
+  bool breakpoint; // on its first instruction, there's never one on the others
+  bool poll; // nothing but in, register compares and a jcc back to the start, it spins until a port changes
+};
+
+struct w86_block_cache {
+  struct w86_block blocks[W86_BLOCK_CACHE_SIZE];
+  struct w86_instruction_info pool[W86_BLOCK_POOL_SIZE];
+  uint32_t used;
+  uint32_t epoch; // bumped to drop every block when the pool fills up
+};
+
+enum w86_flags_op {
+  W86_FLAGS_OP_NONE, // registers.flags is up to date
+  W86_FLAGS_OP_ADD,
+  W86_FLAGS_OP_SUB,
+  W86_FLAGS_OP_INC, // inc and dec leave cf alone
+  W86_FLAGS_OP_DEC
+};
+
+// the last flag-setting operation, the arithmetic flags only get computed from it when something reads them
+struct w86_lazy_flags {
+  enum w86_flags_op op;
+  bool word;
+  uint16_t a;
+  uint16_t b;
+  uint16_t result;
+};
+
+#define W86_MEMORY_SIZE (1 << 20)
+
+#define W86_BUS_PAGE_SIZE 12
+// the 16 pages past 1 MiB alias the first ones like the 8086's wraparound, so segment:offset never needs wrapping
+#define W86_BUS_PAGE_COUNT ((W86_MEMORY_SIZE + (1 << 16)) >> W86_BUS_PAGE_SIZE)
+
+typedef uint8_t w86_bus_read(void* context, uint32_t address);
+typedef void w86_bus_write(void* context, uint32_t address, uint8_t value);
+
+// memory mapped devices see wrapped addresses
+struct w86_bus_device {
+  w86_bus_read* read;
+  w86_bus_write* write;
+  void* context;
+};
+
+// ram has both pointers, rom only the read one, mmio neither so it goes to the device
+struct w86_bus_page {
+  uint8_t* read;
+  uint8_t* write;
+  struct w86_bus_device device;
+  uint8_t watch; // what the debugger took out of read and write for its watchpoints
+};
+
+#define W86_DIRTY_LINE_SIZE 4
+#define W86_DIRTY_MEMORY_WORDS (1 << (20 - W86_DIRTY_LINE_SIZE - 5))
+#define W86_DIRTY_IO_WORDS (1 << (16 - W86_DIRTY_LINE_SIZE - 5))
+
+#define W86_IO_DEVICE_COUNT 16
+#define W86_IO_QUEUE_SIZE 256
+#define W86_IO_STATE_SIZE 1024 // device state a snapshot has room for, all devices together
+
+struct w86_io_write_record {
+  uint16_t port;
+  uint8_t value;
+};
+
+typedef uint8_t w86_io_read(void* context, uint16_t port);
+typedef void w86_io_write(void* context, uint16_t port, uint8_t value);
+typedef void w86_io_batch(void* context, const struct w86_io_write_record* writes, uint32_t count);
+
+// a missing read or write falls back to the io arrays
+// with flush set, writes are queued and handed over in batches, which is a lot cheaper for handlers living in js
+// the first size bytes at context are the device's state, snapshots save and restore them along with memory
+struct w86_io_device {
+  w86_io_read* read;
+  w86_io_write* write;
+  w86_io_batch* flush;
+  void* context;
+  uint32_t size;
+};
+
+struct w86_io_queue {
+  struct w86_io_write_record writes[W86_IO_QUEUE_SIZE];
+  uint32_t count;
+};
+
+// ports that no device claimed keep using the io arrays
+struct w86_io_devices {
+  uint8_t ports[1 << 16]; // device index + 1, 0 if unmapped
+  struct w86_io_device devices[W86_IO_DEVICE_COUNT];
+  struct w86_io_queue queues[W86_IO_DEVICE_COUNT];
+  uint32_t count;
+  uint32_t size; // of their state together
+};
+
+// one bit per 16 byte line written since the ui last looked, it clears the bits as it redraws
+struct w86_dirty {
+  uint32_t memory[W86_DIRTY_MEMORY_WORDS];
+  uint32_t io[W86_DIRTY_IO_WORDS]; // port writes
+};
+
+#define W86_SNAPSHOT_PAGE_SIZE W86_BUS_PAGE_SIZE // whole bus pages, so each one is a single host run
+#define W86_SNAPSHOT_MEMORY_WORDS (1 << (20 - W86_SNAPSHOT_PAGE_SIZE - 5))
+
+struct w86_snapshot;
+struct w86_trace;
+struct w86_profile;
+struct w86_debug;
+struct w86_scheduler;
+struct w86_pic;
+
+// one bit per page written since the snapshot was taken or restored, so restoring it only copies those back
+struct w86_snapshot_dirty {
+  const struct w86_snapshot* snapshot; // the snapshot the bits are relative to
+  uint32_t memory[W86_SNAPSHOT_MEMORY_WORDS];
+  uint32_t io; // 16 pages of ports, for both io arrays
+};
+
+// journal entries are what a write overwrote, the address or port in the low 20 bits and the old byte in the top 8
+#define W86_JOURNAL_IO (1 << 20)
+#define W86_JOURNAL_ENTRY(address, value) ((uint32_t) (address) | (uint32_t) (value) << 24)
+
+// every byte about to be overwritten in ram or the io writes array, for whoever needs to know what an instruction wrote
+struct w86_journal {
+  uint32_t* entries; // a ring
+  uint32_t size; // a power of two
+  uint64_t head; // entries ever written
+};
+
+struct w86_history_checkpoint {
   struct w86_register_file registers;
+  struct w86_lazy_flags lazy_flags;
+  uint64_t cycles;
+  uint64_t instructions;
+  uint64_t journal; // journal position when it was taken
+};
+
+// reverse execution, a checkpoint every interval instructions and a journal of every byte overwritten in between
+// both are rings the caller allocates, so the memory it takes is bounded, older history just falls off the end
+struct w86_history {
+  struct w86_history_checkpoint* checkpoints;
+  struct w86_journal journal;
+  uint32_t checkpoint_count;
+  uint32_t interval;
+  uint64_t instructions; // retired since the history was started
+  uint64_t taken; // checkpoints
+  bool devices; // a device answered a port since the last slice, replays can't ask it again
+};
+
+// the segment registers shifted into linear addresses, refreshed by w86_segments_update
+struct w86_segment_bases {
+  uint32_t cs;
+  uint32_t ds;
+  uint32_t es;
+  uint32_t ss;
+};
+
+struct w86_cpu_state {
+  struct w86_register_file registers; // flags may be stale, go through w86_cpu_get_registers from the outside
+  struct w86_segment_bases bases;
 #ifdef EMBIND // embind doesn't support pointers to primitive types, so we have cheat a little
   intptr_t memory;
 #else
   uint8_t* memory;
 #endif
   struct w86_io_ports io;
+  struct w86_bus_page bus[W86_BUS_PAGE_COUNT];
+  struct w86_io_devices io_devices;
+  struct w86_dirty dirty;
+  struct w86_snapshot_dirty snapshot_dirty;
+  struct w86_history* history; // nullptr unless reverse execution is on
+  struct w86_journal* journal; // nullptr unless something wants to see writes
+  struct w86_trace* trace; // nullptr unless tracing
+  struct w86_profile* profile; // nullptr unless profiling
+  struct w86_debug* debug; // nullptr unless there are breakpoints or watchpoints
+  struct w86_scheduler* scheduler; // nullptr unless there are timed devices
+  struct w86_pic* pic; // nullptr unless something raises interrupts
+  uint64_t cycles; // 8086 clocks retired, by the timing tables in the intel manuals
+  struct w86_lazy_flags lazy_flags;
+  struct w86_decode_cache decode_cache;
+  struct w86_block_cache block_cache;
 };
 
-enum w86_status {
-  W86_STATUS_SUCCESS,
-  W86_STATUS_HALT,
-  W86_STATUS_UNKNOWN_ERROR,
-  W86_STATUS_UNDEFINED_OPCODE,
-  W86_STATUS_UNIMPLEMENTED_OPCODE,
-  W86_STATUS_INVALID_OPERATION
+struct w86_run_result {
+  enum w86_status status;
+  uint32_t instructions;
 };
 
 enum w86_status w86_cpu_step(struct w86_cpu_state* state);
+struct w86_run_result w86_cpu_run(struct w86_cpu_state* state, uint32_t max_instructions);
+struct w86_run_result w86_cpu_run_cycles(struct w86_cpu_state* state, uint32_t max_cycles);
+void w86_cpu_invalidate(struct w86_cpu_state* state);
+struct w86_register_file w86_cpu_get_registers(const struct w86_cpu_state* state);
+void w86_cpu_set_registers(struct w86_cpu_state* state, struct w86_register_file registers);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "disasm.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* const byte_registers[8] = { "al", "cl", "dl", "bl", "ah", "ch", "dh", "bh" };
+static const char* const word_registers[8] = { "ax", "cx", "dx", "bx", "sp", "bp", "si", "di" };
+static const char* const segment_registers[4] = { "es", "cs", "ss", "ds" };
+static const char* const memory_bases[8] = { "bx+si", "bx+di", "bp+si", "bp+di", "si", "di", "bp", "bx" };
+static const char* const alu[8] = { "add", "or", "adc", "sbb", "and", "sub", "xor", "cmp" };
+static const char* const shifts[8] = { "rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar" };
+static const char* const group3[8] = { "test", "test", "not", "neg", "mul", "imul", "div", "idiv" };
+static const char* const conditions[16] = { "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g" };
+static const char* const strings[12] = { "movsb", "movsw", "cmpsb", "cmpsw", "", "", "stosb", "stosw", "lodsb", "lodsw", "scasb", "scasw" };
+
+struct reader {
+  const uint8_t* bytes;
+  uint32_t size;
+  uint32_t offset;
+  bool short_read;
+};
+
+static uint8_t next_byte(struct reader* reader) {
+  if (reader->offset >= reader->size) {
+    reader->short_read = true;
+    return 0;
+  }
+  return reader->bytes[reader->offset++];
+}
+
+static uint16_t next_word(struct reader* reader) {
+  uint8_t low = next_byte(reader);
+  return low | next_byte(reader) << 8;
+}
+
+// a modrm operand, registers for mod 3 and memory otherwise, with a size if nothing else gives it away
+static void modrm_operand(struct reader* reader, uint8_t modrm, bool word, bool sized, const char* segment, char* out, size_t out_size) {
+  uint8_t mod = modrm >> 6, rm = modrm & 0b111;
+  if (mod == 0b11) {
+    snprintf(out, out_size, "%s", word ? word_registers[rm] : byte_registers[rm]);
+    return;
+  }
+
+  const char* size = sized ? word ? "word ptr " : "byte ptr " : "";
+  const char* prefix = segment ? segment : "";
+  const char* colon = segment ? ":" : "";
+  if (mod == 0b00 && rm == 0b110) {
+    snprintf(out, out_size, "%s%s%s[0x%x]", size, prefix, colon, next_word(reader));
+  } else if (mod == 0b00) {
+    snprintf(out, out_size, "%s%s%s[%s]", size, prefix, colon, memory_bases[rm]);
+  } else {
+    int16_t disp = mod == 0b01 ? (int8_t) next_byte(reader) : (int16_t) next_word(reader);
+    snprintf(out, out_size, "%s%s%s[%s%c0x%x]", size, prefix, colon, memory_bases[rm], disp < 0 ? '-' : '+', disp < 0 ? -disp : disp);
+  }
+}
+
+uint32_t disasm(const uint8_t* bytes, uint32_t size, uint16_t ip, char* out, size_t out_size) {
+  struct reader reader = { .bytes = bytes, .size = size };
+  const char* segment = nullptr;
+  const char* repeat = "";
+  const char* lock = "";
+  uint8_t opcode;
+  while (true) {
+    opcode = next_byte(&reader);
+    if ((opcode & 0b11100111) == 0x26) {
+      segment = segment_registers[opcode >> 3 & 0b11];
+    } else if (opcode == 0xf2) {
+      repeat = "repne ";
+    } else if (opcode == 0xf3) {
+      repeat = "rep ";
+    } else if (opcode == 0xf0) {
+      lock = "lock ";
+    } else {
+      break;
+    }
+    if (reader.short_read) return 0;
+  }
+
+  char a[64] = "", b[64] = "";
+  const char* mnemonic = nullptr;
+  bool word = opcode & 0b1;
+  uint8_t modrm;
+  uint16_t target;
+
+  if (opcode < 0x40 && (opcode & 0b111) < 0b110) { // alu
+    mnemonic = alu[opcode >> 3];
+    switch (opcode & 0b111) {
+    case 0b000:
+    case 0b001:
+      modrm = next_byte(&reader);
+      modrm_operand(&reader, modrm, word, false, segment, a, sizeof(a));
+      snprintf(b, sizeof(b), "%s", word ? word_registers[modrm >> 3 & 0b111] : byte_registers[modrm >> 3 & 0b111]);
+      break;
+
+    case 0b010:
+    case 0b011:
+      modrm = next_byte(&reader);
+      snprintf(a, sizeof(a), "%s", word ? word_registers[modrm >> 3 & 0b111] : byte_registers[modrm >> 3 & 0b111]);
+      modrm_operand(&reader, modrm, word, false, segment, b, sizeof(b));
+      break;
+
+    case 0b100:
+      snprintf(a, sizeof(a), "al");
+      snprintf(b, sizeof(b), "0x%x", next_byte(&reader));
+      break;
+
+    case 0b101:
+      snprintf(a, sizeof(a), "ax");
+      snprintf(b, sizeof(b), "0x%x", next_word(&reader));
+    }
+  } else if (opcode < 0x20 && (opcode & 0b110) == 0b110) {
+    mnemonic = word ? "pop" : "push";
+    snprintf(a, sizeof(a), "%s", segment_registers[opcode >> 3]);
+  } else if ((opcode & 0b11100111) == 0x27) {
+    static const char* const adjusts[4] = { "daa", "das", "aaa", "aas" };
+    mnemonic = adjusts[opcode >> 3 & 0b11];
+  } else if (opcode >= 0x40 && opcode < 0x60) {
+    static const char* const names[4] = { "inc", "dec", "push", "pop" };
+    mnemonic = names[opcode >> 3 & 0b11];
+    snprintf(a, sizeof(a), "%s", word_registers[opcode & 0b111]);
+  } else if ((opcode & 0b11110000) == 0x70) {
+    target = ip + 2 + (int8_t) next_byte(&reader);
+    snprintf(b, sizeof(b), "j%s", conditions[opcode & 0b1111]);
+    mnemonic = b;
+    snprintf(a, sizeof(a), "0x%x", target);
+    snprintf(out, out_size, "%s %s", mnemonic, a);
+    return reader.short_read ? 0 : reader.offset;
+  } else if (opcode >= 0x80 && opcode <= 0x83) {
+    modrm = next_byte(&reader);
+    mnemonic = alu[modrm >> 3 & 0b111];
+    modrm_operand(&reader, modrm, word, true, segment, a, sizeof(a));
+    if (opcode == 0x81) {
+      snprintf(b, sizeof(b), "0x%x", next_word(&reader));
+    } else if (opcode == 0x83) {
+      snprintf(b, sizeof(b), "0x%x", (uint16_t) (int8_t) next_byte(&reader));
+    } else {
+      snprintf(b, sizeof(b), "0x%x", next_byte(&reader));
+    }
+  } else if (opcode >= 0x84 && opcode <= 0x8b) {
+    static const char* const names[4] = { "test", "xchg", "mov", "mov" };
+    mnemonic = names[(opcode - 0x84) >> 1];
+    modrm = next_byte(&reader);
+    const char* reg = word ? word_registers[modrm >> 3 & 0b111] : byte_registers[modrm >> 3 & 0b111];
+    if (opcode >= 0x8a) {
+      snprintf(a, sizeof(a), "%s", reg);
+      modrm_operand(&reader, modrm, word, false, segment, b, sizeof(b));
+    } else {
+      modrm_operand(&reader, modrm, word, false, segment, a, sizeof(a));
+      snprintf(b, sizeof(b), "%s", reg);
+    }
+  } else if (opcode == 0x8c || opcode == 0x8e) {
+    mnemonic = "mov";
+    modrm = next_byte(&reader);
+    const char* sreg = segment_registers[modrm >> 3 & 0b11];
+    if (opcode == 0x8e) {
+      snprintf(a, sizeof(a), "%s", sreg);
+      modrm_operand(&reader, modrm, true, false, segment, b, sizeof(b));
+    } else {
+      modrm_operand(&reader, modrm, true, false, segment, a, sizeof(a));
+      snprintf(b, sizeof(b), "%s", sreg);
+    }
+  } else if (opcode == 0x8d || opcode == 0xc4 || opcode == 0xc5) {
+    mnemonic = opcode == 0x8d ? "lea" : opcode == 0xc4 ? "les" : "lds";
+    modrm = next_byte(&reader);
+    snprintf(a, sizeof(a), "%s", word_registers[modrm >> 3 & 0b111]);
+    modrm_operand(&reader, modrm, true, false, segment, b, sizeof(b));
+  } else if (opcode == 0x8f) {
+    mnemonic = "pop";
+    modrm_operand(&reader, next_byte(&reader), true, true, segment, a, sizeof(a));
+  } else if (opcode == 0x90) {
+    mnemonic = "nop";
+  } else if (opcode > 0x90 && opcode <= 0x97) {
+    mnemonic = "xchg";
+    snprintf(a, sizeof(a), "ax");
+    snprintf(b, sizeof(b), "%s", word_registers[opcode & 0b111]);
+  } else if (opcode == 0x9a || opcode == 0xea) {
+    mnemonic = opcode == 0x9a ? "call" : "jmp";
+    uint16_t pointer = next_word(&reader);
+    snprintf(a, sizeof(a), "0x%x:0x%x", next_word(&reader), pointer);
+  } else if (opcode >= 0x98 && opcode <= 0x9f) {
+    static const char* const names[8] = { "cbw", "cwd", "", "wait", "pushf", "popf", "sahf", "lahf" };
+    mnemonic = names[opcode - 0x98];
+  } else if (opcode >= 0xa0 && opcode <= 0xa3) {
+    mnemonic = "mov";
+    const char* reg = word ? "ax" : "al";
+    char memory[32];
+    snprintf(memory, sizeof(memory), "%s%s[0x%x]", segment ? segment : "", segment ? ":" : "", next_word(&reader));
+    snprintf(a, sizeof(a), "%s", opcode < 0xa2 ? reg : memory);
+    snprintf(b, sizeof(b), "%s", opcode < 0xa2 ? memory : reg);
+  } else if (opcode == 0xa8 || opcode == 0xa9) {
+    mnemonic = "test";
+    snprintf(a, sizeof(a), "%s", word ? "ax" : "al");
+    snprintf(b, sizeof(b), "0x%x", word ? next_word(&reader) : next_byte(&reader));
+  } else if (opcode >= 0xa4 && opcode <= 0xaf) {
+    snprintf(b, sizeof(b), "%s%s%s%s%s", lock, repeat, segment ? segment : "", segment ? " " : "", strings[opcode - 0xa4]);
+    snprintf(out, out_size, "%s", b);
+    return reader.short_read ? 0 : reader.offset;
+  } else if ((opcode & 0b11110000) == 0xb0) {
+    mnemonic = "mov";
+    bool wide = opcode & 0b1000;
+    snprintf(a, sizeof(a), "%s", wide ? word_registers[opcode & 0b111] : byte_registers[opcode & 0b111]);
+    snprintf(b, sizeof(b), "0x%x", wide ? next_word(&reader) : next_byte(&reader));
+  } else if (opcode == 0xc2 || opcode == 0xca) {
+    mnemonic = opcode == 0xc2 ? "ret" : "retf";
+    snprintf(a, sizeof(a), "0x%x", next_word(&reader));
+  } else if (opcode == 0xc3 || opcode == 0xcb) {
+    mnemonic = opcode == 0xc3 ? "ret" : "retf";
+  } else if (opcode == 0xc6 || opcode == 0xc7) {
+    mnemonic = "mov";
+    modrm_operand(&reader, next_byte(&reader), word, true, segment, a, sizeof(a));
+    snprintf(b, sizeof(b), "0x%x", word ? next_word(&reader) : next_byte(&reader));
+  } else if (opcode == 0xcc || opcode == 0xce || opcode == 0xcf) {
+    mnemonic = opcode == 0xcc ? "int3" : opcode == 0xce ? "into" : "iret";
+  } else if (opcode == 0xcd || opcode == 0xd4 || opcode == 0xd5) {
+    mnemonic = opcode == 0xcd ? "int" : opcode == 0xd4 ? "aam" : "aad";
+    snprintf(a, sizeof(a), "0x%x", next_byte(&reader));
+  } else if (opcode >= 0xd0 && opcode <= 0xd3) {
+    modrm = next_byte(&reader);
+    mnemonic = shifts[modrm >> 3 & 0b111];
+    modrm_operand(&reader, modrm, word, true, segment, a, sizeof(a));
+    snprintf(b, sizeof(b), "%s", opcode & 0b10 ? "cl" : "1");
+  } else if (opcode == 0xd7) {
+    mnemonic = "xlat";
+  } else if ((opcode & 0b11111000) == 0xd8) {
+    mnemonic = "esc";
+    modrm = next_byte(&reader);
+    snprintf(a, sizeof(a), "0x%x", (opcode & 0b111) << 3 | (modrm >> 3 & 0b111));
+    modrm_operand(&reader, modrm, true, false, segment, b, sizeof(b));
+  } else if (opcode >= 0xe0 && opcode <= 0xe3) {
+    static const char* const names[4] = { "loopne", "loope", "loop", "jcxz" };
+    mnemonic = names[opcode - 0xe0];
+    target = ip + 2 + (int8_t) next_byte(&reader);
+    snprintf(a, sizeof(a), "0x%x", target);
+  } else if (opcode >= 0xe4 && opcode <= 0xe7) {
+    char port[8];
+    snprintf(port, sizeof(port), "0x%x", next_byte(&reader));
+    mnemonic = opcode & 0b10 ? "out" : "in";
+    snprintf(a, sizeof(a), "%s", opcode & 0b10 ? port : word ? "ax" : "al");
+    snprintf(b, sizeof(b), "%s", opcode & 0b10 ? word ? "ax" : "al" : port);
+  } else if (opcode == 0xe8 || opcode == 0xe9) {
+    mnemonic = opcode == 0xe8 ? "call" : "jmp";
+    target = next_word(&reader);
+    snprintf(a, sizeof(a), "0x%x", (uint16_t) (ip + 3 + target));
+  } else if (opcode == 0xeb) {
+    mnemonic = "jmp";
+    target = ip + 2 + (int8_t) next_byte(&reader);
+    snprintf(a, sizeof(a), "0x%x", target);
+  } else if (opcode >= 0xec && opcode <= 0xef) {
+    mnemonic = opcode & 0b10 ? "out" : "in";
+    snprintf(a, sizeof(a), "%s", opcode & 0b10 ? "dx" : word ? "ax" : "al");
+    snprintf(b, sizeof(b), "%s", opcode & 0b10 ? word ? "ax" : "al" : "dx");
+  } else if (opcode == 0xf4 || opcode == 0xf5) {
+    mnemonic = opcode == 0xf4 ? "hlt" : "cmc";
+  } else if (opcode == 0xf6 || opcode == 0xf7) {
+    modrm = next_byte(&reader);
+    mnemonic = group3[modrm >> 3 & 0b111];
+    modrm_operand(&reader, modrm, word, true, segment, a, sizeof(a));
+    if ((modrm >> 3 & 0b111) < 0b010) snprintf(b, sizeof(b), "0x%x", word ? next_word(&reader) : next_byte(&reader));
+  } else if (opcode >= 0xf8 && opcode <= 0xfd) {
+    static const char* const names[6] = { "clc", "stc", "cli", "sti", "cld", "std" };
+    mnemonic = names[opcode - 0xf8];
+  } else if (opcode == 0xfe || opcode == 0xff) {
+    static const char* const names[8] = { "inc", "dec", "call", "call far", "jmp", "jmp far", "push", "" };
+    modrm = next_byte(&reader);
+    mnemonic = names[modrm >> 3 & 0b111];
+    modrm_operand(&reader, modrm, word, true, segment, a, sizeof(a));
+  }
+
+  if (reader.short_read) return 0;
+  if (!mnemonic || !*mnemonic) {
+    snprintf(out, out_size, "db 0x%x", opcode);
+    return 1;
+  }
+  snprintf(out, out_size, "%s%s%s%s%s%s%s", lock, repeat, mnemonic, *a ? " " : "", a, *b ? ", " : "", b);
+  return reader.offset;
+}
@@ -0,0 +1,12 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_TOOLS_DISASM_H_
+#define W86_TOOLS_DISASM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// intel syntax for one instruction, prefixes included, returns how many bytes it took or 0 if size ran out
+uint32_t disasm(const uint8_t* bytes, uint32_t size, uint16_t ip, char* out, size_t out_size);
+
+#endif /* W86_TOOLS_DISASM_H_ */
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "machine.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus.h"
+#include "io.h"
+#include "w86.h"
+
+bool machine_create(struct machine* machine) {
+  // the caches make the state too big for the stack
+  *machine = (struct machine) {
+    .state = calloc(1, sizeof(struct w86_cpu_state)),
+    .memory = calloc(MACHINE_MEMORY_SIZE, 1),
+    .reads = calloc(MACHINE_IO_SIZE, 1),
+    .writes = calloc(MACHINE_IO_SIZE, 1),
+    .scheduler = malloc(sizeof(struct w86_scheduler)),
+    .pic = malloc(sizeof(struct w86_pic)),
+    .pit = malloc(sizeof(struct w86_pit)),
+    .snapshot = malloc(sizeof(struct w86_snapshot))
+  };
+  if (!machine->state || !machine->memory || !machine->reads || !machine->writes || !machine->scheduler || !machine->pic || !machine->pit
+      || !machine->snapshot) {
+    machine_destroy(machine);
+    fputs("out of memory\n", stderr);
+    return false;
+  }
+
+  machine->state->memory = machine->memory;
+  machine->state->io.reads = machine->reads;
+  machine->state->io.writes = machine->writes;
+  w86_bus_reset(machine->state);
+  machine_reset(machine);
+
+  return true;
+}
+
+void machine_destroy(struct machine* machine) {
+  free(machine->snapshot);
+  free(machine->pit);
+  free(machine->pic);
+  free(machine->scheduler);
+  free(machine->writes);
+  free(machine->reads);
+  free(machine->memory);
+  free(machine->state);
+  *machine = (struct machine) {};
+}
+
+bool machine_load(const char* path, uint8_t* buffer, size_t size) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  fread(buffer, 1, size, file);
+  bool ok = !ferror(file);
+  if (!ok) perror(path);
+  fclose(file);
+
+  return ok;
+}
+
+// back to FFFF:0000 with cleared registers, cycles, writes and devices, memory is left alone
+void machine_reset(struct machine* machine) {
+  machine->state->cycles = 0;
+  w86_cpu_set_registers(machine->state, (struct w86_register_file) { .cs = 0xffff, .ip = 0x0000 });
+  memset(machine->writes, 0, MACHINE_IO_SIZE);
+  w86_io_reset(machine->state);
+  w86_scheduler_start(machine->state, machine->scheduler);
+  w86_pic_start(machine->state, machine->pic);
+  w86_pit_start(machine->state, machine->pit);
+  w86_cpu_invalidate(machine->state);
+}
+
+const char* machine_status_name(enum w86_status status) {
+  switch (status) {
+  case W86_STATUS_SUCCESS:
+    return "success";
+
+  case W86_STATUS_HALT:
+    return "halt";
+
+  case W86_STATUS_UNKNOWN_ERROR:
+    return "unknown error";
+
+  case W86_STATUS_UNDEFINED_OPCODE:
+    return "undefined opcode";
+
+  case W86_STATUS_UNIMPLEMENTED_OPCODE:
+    return "unimplemented opcode";
+
+  case W86_STATUS_INVALID_OPERATION:
+    return "invalid operation";
+
+  case W86_STATUS_BREAKPOINT:
+    return "breakpoint";
+
+  case W86_STATUS_WATCHPOINT:
+    return "watchpoint";
+
+  case W86_STATUS_POLL:
+    return "poll";
+  }
+
+  return "???";
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef W86_TOOLS_MACHINE_H_
+#define W86_TOOLS_MACHINE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pic.h"
+#include "pit.h"
+#include "schedule.h"
+#include "snapshot.h"
+#include "w86.h"
+
+#define MACHINE_MEMORY_SIZE 1048576
+#define MACHINE_IO_SIZE 65536
+
+// a cpu with a full address space and port space and the pc's timer and interrupt controller, like the web frontend sets up
+struct machine {
+  struct w86_cpu_state* state;
+  uint8_t* memory;
+  uint8_t* reads;
+  uint8_t* writes;
+  struct w86_scheduler* scheduler;
+  struct w86_pic* pic;
+  struct w86_pit* pit;
+  struct w86_snapshot* snapshot; // for tools that rerun the same program
+};
+
+bool machine_create(struct machine* machine);
+void machine_destroy(struct machine* machine);
+bool machine_load(const char* path, uint8_t* buffer, size_t size);
+void machine_reset(struct machine* machine);
+const char* machine_status_name(enum w86_status status);
+
+#endif /* W86_TOOLS_MACHINE_H_ */
@@ -0,0 +1,417 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// runs a manifest of jobs on a pool of threads, one line per job:
+//   program.bin [port_reads|-] [max_instructions]
+// blank lines and ones starting with # are skipped, programs and port reads are loaded once however many jobs use them
+// and every instance runs straight off those, only the pages a job writes get copied
+// prints one tab separated line per job in manifest order:
+//   program  status  instructions  cycles  ax bx cx dx si di sp bp cs ds es ss ip flags  port=value,...
+// status is "limit" if it was still going when its instructions ran out
+// with -l, jobs of the same program run in lockstep, up to W86_LOCKSTEP_LANES of them sharing vector registers
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bus.h"
+#include "lockstep.h"
+#include "machine.h"
+#include "w86.h"
+
+#define BATCH_SIZE 1000000
+#define LINE_SIZE 4096
+#define MAX_THREADS 256
+
+// big enough for either a program or port reads
+struct image {
+  struct image* next;
+  char* path;
+  uint8_t* data;
+};
+
+struct job {
+  const struct image* program;
+  const struct image* reads; // nullptr for all zeros
+  uint64_t max_instructions;
+
+  enum w86_status status;
+  uint64_t instructions;
+  uint64_t cycles;
+  struct w86_register_file registers;
+  char* writes; // the ports written to as port=value pairs, nullptr if none were
+};
+
+// what a worker takes at once, the jobs order[first] to order[first + count - 1]
+// always a single one unless they run in lockstep
+struct task {
+  uint32_t first;
+  uint32_t count;
+};
+
+// the tasks a worker still has, from next to end
+// the owner takes them from the front, an idle worker steals the back half of the fullest one it finds
+struct queue {
+  mtx_t lock;
+  uint32_t next;
+  uint32_t end;
+};
+
+struct pool {
+  struct job* jobs;
+  uint32_t* order; // job indices, the ones of a program next to each other
+  struct task* tasks;
+  struct queue* queues;
+  uint32_t threads;
+  bool lockstep;
+};
+
+struct worker {
+  struct pool* pool;
+  uint32_t index;
+  uint64_t vector; // lane instructions its lockstep groups ran together
+  uint64_t scalar;
+};
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-j threads] [-n max_instructions] [-l] manifest.txt\n", name);
+}
+
+// the same path always comes back as the same image, so jobs can share it
+static const struct image* load_image(struct image** images, const char* path) {
+  for (struct image* image = *images; image; image = image->next) {
+    if (!strcmp(image->path, path)) return image;
+  }
+
+  struct image* image = malloc(sizeof(struct image));
+  if (!image) return nullptr;
+  *image = (struct image) { .next = *images, .path = strdup(path), .data = calloc(MACHINE_MEMORY_SIZE, 1) };
+  if (!image->path || !image->data || !machine_load(path, image->data, MACHINE_MEMORY_SIZE)) {
+    free(image->data);
+    free(image->path);
+    free(image);
+    return nullptr;
+  }
+  *images = image;
+
+  return image;
+}
+
+// the written bytes of the port space as "port=value" pairs, a job that wrote none gets nullptr
+static char* format_writes(const uint8_t* writes) {
+  uint32_t count = 0;
+  for (uint32_t port = 0; port < MACHINE_IO_SIZE; port++) count += !!writes[port];
+  if (!count) return nullptr;
+
+  char* out = malloc(count * sizeof("ffff=ff,"));
+  if (!out) return nullptr;
+
+  uint32_t length = 0;
+  for (uint32_t port = 0; port < MACHINE_IO_SIZE; port++) {
+    if (writes[port]) length += sprintf(out + length, "%s%04x=%02x", length ? "," : "", port, writes[port]);
+  }
+
+  return out;
+}
+
+static void start_job(struct machine* machine, const struct job* job) {
+  machine->state->io.reads = job->reads ? job->reads->data : machine->reads;
+  w86_bus_map_shared(machine->state, 0, MACHINE_MEMORY_SIZE, job->program->data);
+  machine_reset(machine);
+}
+
+static void finish_job(const struct machine* machine, struct job* job, enum w86_status status, uint64_t instructions) {
+  job->status = status;
+  job->instructions = instructions;
+  job->cycles = machine->state->cycles;
+  job->registers = w86_cpu_get_registers(machine->state);
+  job->writes = format_writes(machine->writes);
+}
+
+static void run_job(struct machine* machine, struct job* job) {
+  start_job(machine, job);
+
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint64_t instructions = 0;
+  while (status == W86_STATUS_SUCCESS && instructions < job->max_instructions) {
+    uint64_t batch = job->max_instructions - instructions < BATCH_SIZE ? job->max_instructions - instructions : BATCH_SIZE;
+    struct w86_run_result result = w86_cpu_run(machine->state, batch);
+    status = result.status;
+    instructions += result.instructions;
+  }
+
+  finish_job(machine, job, status, instructions);
+}
+
+// a machine per lane, all running the same program
+static void run_lockstep(struct worker* worker, struct machine* machines, const struct task* task) {
+  struct w86_lockstep lockstep;
+  w86_lockstep_start(&lockstep);
+  for (uint32_t i = 0; i < task->count; i++) {
+    const struct job* job = &worker->pool->jobs[worker->pool->order[task->first + i]];
+    start_job(&machines[i], job);
+    w86_lockstep_add(&lockstep, machines[i].state, job->max_instructions);
+  }
+  w86_lockstep_run(&lockstep);
+
+  for (uint32_t i = 0; i < task->count; i++) {
+    const struct w86_lockstep_lane* lane = &lockstep.lanes[i];
+    finish_job(&machines[i], &worker->pool->jobs[worker->pool->order[task->first + i]], lane->status, lane->instructions);
+  }
+  worker->vector += lockstep.vector;
+  worker->scalar += lockstep.scalar;
+}
+
+// the next task of its own, or half of somebody else's when it ran out
+static bool take(struct pool* pool, uint32_t self, uint32_t* task) {
+  struct queue* own = &pool->queues[self];
+  mtx_lock(&own->lock);
+  bool found = own->next < own->end;
+  if (found) *task = own->next++;
+  mtx_unlock(&own->lock);
+  if (found) return true;
+
+  while (true) {
+    uint32_t victim = self, most = 0;
+    for (uint32_t i = 0; i < pool->threads; i++) {
+      if (i == self) continue;
+      mtx_lock(&pool->queues[i].lock);
+      uint32_t left = pool->queues[i].end - pool->queues[i].next; // can be gone by the time it gets there
+      mtx_unlock(&pool->queues[i].lock);
+      if (left > most) {
+        victim = i;
+        most = left;
+      }
+    }
+    if (victim == self) return false;
+
+    struct queue* other = &pool->queues[victim];
+    mtx_lock(&other->lock);
+    uint32_t left = other->end - other->next;
+    uint32_t first = other->end - (left + 1) / 2;
+    uint32_t end = other->end;
+    if (left) other->end = first;
+    mtx_unlock(&other->lock);
+    if (!left) continue;
+
+    *task = first;
+    mtx_lock(&own->lock);
+    own->next = first + 1;
+    own->end = end;
+    mtx_unlock(&own->lock);
+    return true;
+  }
+}
+
+// a machine per thread, or one per lane in lockstep, set up again for every job it takes
+static int work(void* context) {
+  struct worker* worker = context;
+  struct pool* pool = worker->pool;
+  struct machine machines[W86_LOCKSTEP_LANES];
+  uint32_t count = pool->lockstep ? W86_LOCKSTEP_LANES : 1;
+  for (uint32_t i = 0; i < count; i++) {
+    if (machine_create(&machines[i])) continue;
+    while (i--) machine_destroy(&machines[i]);
+    return EXIT_FAILURE;
+  }
+
+  uint32_t task;
+  while (take(pool, worker->index, &task)) {
+    if (pool->lockstep) {
+      run_lockstep(worker, machines, &pool->tasks[task]);
+    } else {
+      run_job(&machines[0], &pool->jobs[pool->order[pool->tasks[task].first]]);
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) machine_destroy(&machines[i]);
+  return EXIT_SUCCESS;
+}
+
+// a task per job, or per group of up to W86_LOCKSTEP_LANES jobs of the same program in lockstep
+static uint32_t plan(const struct image* images, const struct job* jobs, uint32_t job_count, bool lockstep, uint32_t* order, struct task* tasks) {
+  uint32_t ordered = 0;
+  if (!lockstep) {
+    for (uint32_t i = 0; i < job_count; i++) order[ordered++] = i;
+  } else {
+    for (const struct image* image = images; image; image = image->next) {
+      for (uint32_t i = 0; i < job_count; i++) {
+        if (jobs[i].program == image) order[ordered++] = i;
+      }
+    }
+  }
+
+  uint32_t task_count = 0;
+  for (uint32_t i = 0; i < job_count; i++) {
+    struct task* last = task_count ? &tasks[task_count - 1] : nullptr;
+    if (lockstep && last && last->count < W86_LOCKSTEP_LANES && jobs[order[last->first]].program == jobs[order[i]].program) {
+      last->count++;
+    } else {
+      tasks[task_count++] = (struct task) { .first = i, .count = 1 };
+    }
+  }
+
+  return task_count;
+}
+
+// one job per line, false on the first one that can't be read
+static bool parse_manifest(const char* path, uint64_t max_instructions, struct image** images, struct job** jobs, uint32_t* job_count) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  uint32_t capacity = 0;
+  char line[LINE_SIZE];
+  bool ok = true;
+  for (uint32_t number = 1; ok && fgets(line, sizeof(line), file); number++) {
+    char* program = strtok(line, " \t\r\n");
+    if (!program || program[0] == '#') continue;
+    char* reads = strtok(nullptr, " \t\r\n");
+    char* limit = strtok(nullptr, " \t\r\n");
+
+    if (*job_count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      struct job* grown = realloc(*jobs, capacity * sizeof(struct job));
+      if (!grown) {
+        fputs("out of memory\n", stderr);
+        ok = false;
+        break;
+      }
+      *jobs = grown;
+    }
+
+    struct job* job = &(*jobs)[*job_count];
+    *job = (struct job) {
+      .program = load_image(images, program),
+      .reads = reads && strcmp(reads, "-") ? load_image(images, reads) : nullptr,
+      .max_instructions = limit ? strtoull(limit, nullptr, 0) : max_instructions
+    };
+    if (!job->program || (reads && strcmp(reads, "-") && !job->reads)) {
+      fprintf(stderr, "%s:%u: can't load the job\n", path, number);
+      ok = false;
+    }
+    (*job_count)++;
+  }
+  fclose(file);
+
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  uint64_t max_instructions = UINT64_MAX;
+  bool lockstep = false;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* manifest_path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = strtol(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      max_instructions = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-l")) {
+      lockstep = true;
+    } else if (argv[i][0] != '-' && !manifest_path) {
+      manifest_path = argv[i];
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!manifest_path) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (threads < 1) threads = 1;
+  if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+  uint32_t job_count = 0;
+  struct job* jobs = nullptr;
+  struct image* images = nullptr;
+  if (!parse_manifest(manifest_path, max_instructions, &images, &jobs, &job_count)) return EXIT_FAILURE;
+
+  struct pool pool = { .jobs = jobs, .order = malloc((job_count + 1) * sizeof(uint32_t)), .tasks = malloc((job_count + 1) * sizeof(struct task)), .lockstep = lockstep };
+  if (!pool.order || !pool.tasks) {
+    fputs("out of memory\n", stderr);
+    return EXIT_FAILURE;
+  }
+  uint32_t task_count = plan(images, jobs, job_count, lockstep, pool.order, pool.tasks);
+  if ((uint32_t) threads > task_count) threads = task_count ? task_count : 1;
+
+  // contiguous slices to start with, stealing evens them out when some jobs run longer
+  pool.queues = calloc(threads, sizeof(struct queue));
+  pool.threads = threads;
+  struct worker workers[MAX_THREADS];
+  thrd_t handles[MAX_THREADS];
+  if (!pool.queues) {
+    fputs("out of memory\n", stderr);
+    return EXIT_FAILURE;
+  }
+  for (uint32_t i = 0; i < pool.threads; i++) {
+    mtx_init(&pool.queues[i].lock, mtx_plain);
+    pool.queues[i].next = (uint64_t) task_count * i / pool.threads;
+    pool.queues[i].end = (uint64_t) task_count * (i + 1) / pool.threads;
+    workers[i] = (struct worker) { .pool = &pool, .index = i };
+  }
+
+  struct timespec start, end;
+  timespec_get(&start, TIME_UTC);
+  uint32_t started = 0;
+  for (; started < pool.threads; started++) {
+    if (thrd_create(&handles[started], work, &workers[started]) != thrd_success) break;
+  }
+  bool ok = started;
+  for (uint32_t i = 0; i < started; i++) {
+    int result;
+    thrd_join(handles[i], &result);
+    ok &= result == EXIT_SUCCESS;
+  }
+  timespec_get(&end, TIME_UTC);
+  if (!ok) {
+    fputs("a worker couldn't start\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < job_count; i++) {
+    const struct job* job = &jobs[i];
+    const struct w86_register_file* r = &job->registers;
+    printf("%s\t%s\t%llu\t%llu\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%04x\t%s\n",
+           job->program->path, job->status == W86_STATUS_SUCCESS ? "limit" : machine_status_name(job->status),
+           (unsigned long long) job->instructions, (unsigned long long) job->cycles,
+           r->ax, r->bx, r->cx, r->dx, r->si, r->di, r->sp, r->bp, r->cs, r->ds, r->es, r->ss, r->ip, r->flags,
+           job->writes ? job->writes : "-");
+    total += job->instructions;
+    free(job->writes);
+  }
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%u jobs on %u threads, %llu instructions in %.6f seconds, %.2f mips\n", job_count, pool.threads,
+          (unsigned long long) total, seconds, seconds > 0 ? total / seconds / 1e6 : 0.0);
+  if (lockstep) {
+    uint64_t vector = 0, scalar = 0;
+    for (uint32_t i = 0; i < pool.threads; i++) {
+      vector += workers[i].vector;
+      scalar += workers[i].scalar;
+    }
+    fprintf(stderr, "%u lockstep groups, %llu instructions ran together and %llu alone, %.1f%% together\n", task_count,
+            (unsigned long long) vector, (unsigned long long) scalar, vector + scalar ? 100.0 * vector / (vector + scalar) : 0.0);
+  }
+
+  for (uint32_t i = 0; i < pool.threads; i++) mtx_destroy(&pool.queues[i].lock);
+  free(pool.queues);
+  free(pool.tasks);
+  free(pool.order);
+  while (images) {
+    struct image* next = images->next;
+    free(images->data);
+    free(images->path);
+    free(images);
+    images = next;
+  }
+  free(jobs);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// throughput benchmark over the roms in bench/, prints one tab separated line per workload:
+//   workload  instructions  seconds  mips
+// the same format is read back as a baseline, anything slower than it by more than the threshold fails
+// bench/baseline.tsv is a reference run, regenerate it on the machine you compare on:
+//   cmake -S bench -B build/bench && cmake --build build/bench
+//   w86-bench build/bench/*.bin > baseline.tsv
+//   w86-bench -b baseline.tsv -t 5 build/bench/*.bin
+// -H runs with reverse execution on, checkpointing every that many instructions, to see what the journal costs
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "history.h"
+#include "machine.h"
+#include "snapshot.h"
+#include "w86.h"
+
+#define BATCH_SIZE 1000000
+#define MAX_INSTRUCTIONS 1000000000
+#define NAME_SIZE 64
+#define HISTORY_CHECKPOINTS 64
+#define HISTORY_JOURNAL_SIZE (1 << 22)
+
+struct result {
+  char name[NAME_SIZE];
+  uint64_t instructions;
+  double seconds;
+  double mips;
+};
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-r repeats] [-b baseline.tsv] [-t threshold_percent] [-H history_interval] workload.bin...\n", name);
+}
+
+// bench/alu.bin -> alu
+static void workload_name(const char* path, char* name) {
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  size_t length = strcspn(base, ".");
+  if (length >= NAME_SIZE) length = NAME_SIZE - 1;
+  memcpy(name, base, length);
+  name[length] = '\0';
+}
+
+// best of several runs, the rom has to halt on its own
+static bool measure(struct machine* machine, const char* path, uint32_t repeats, struct result* result) {
+  workload_name(path, result->name);
+  result->seconds = 0;
+  if (!machine_load(path, machine->memory, MACHINE_MEMORY_SIZE)) return false;
+  machine_reset(machine);
+  w86_snapshot_take(machine->state, machine->snapshot);
+  for (uint32_t i = 0; i < repeats; i++) {
+    w86_snapshot_restore(machine->state, machine->snapshot); // only copies back what the last run wrote
+
+    enum w86_status status = W86_STATUS_SUCCESS;
+    uint64_t instructions = 0;
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+    while (status == W86_STATUS_SUCCESS && instructions < MAX_INSTRUCTIONS) {
+      struct w86_run_result run = w86_cpu_run(machine->state, BATCH_SIZE);
+      status = run.status;
+      instructions += run.instructions;
+    }
+    timespec_get(&end, TIME_UTC);
+
+    if (status != W86_STATUS_HALT) {
+      fprintf(stderr, "%s: stopped with %s after %llu instructions\n", result->name, machine_status_name(status), (unsigned long long) instructions);
+      return false;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (i == 0 || seconds < result->seconds) result->seconds = seconds;
+    result->instructions = instructions;
+  }
+  result->mips = result->seconds > 0 ? result->instructions / result->seconds / 1e6 : 0;
+
+  return true;
+}
+
+// true if nothing regressed, workloads missing from the baseline are skipped
+static bool compare(const char* path, const struct result* results, int count, double threshold) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+
+  bool ok = true;
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    struct result baseline;
+    unsigned long long instructions;
+    if (sscanf(line, "%63s %llu %lf %lf", baseline.name, &instructions, &baseline.seconds, &baseline.mips) != 4) continue; // header
+
+    for (int i = 0; i < count; i++) {
+      if (strcmp(results[i].name, baseline.name)) continue;
+
+      double change = (results[i].mips - baseline.mips) / baseline.mips * 100;
+      bool regressed = change < -threshold;
+      fprintf(stderr, "%s: %.2f -> %.2f mips (%+.1f%%)%s\n", baseline.name, baseline.mips, results[i].mips, change, regressed ? " REGRESSION" : "");
+      ok &= !regressed;
+    }
+  }
+  fclose(file);
+
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  uint32_t repeats = 5;
+  const char* baseline_path = nullptr;
+  double threshold = 5;
+  uint32_t history_interval = 0;
+  int first = argc;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+      repeats = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      baseline_path = argv[++i];
+    } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+      threshold = strtod(argv[++i], nullptr);
+    } else if (!strcmp(argv[i], "-H") && i + 1 < argc) {
+      history_interval = strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] != '-') {
+      first = i;
+      break;
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (first == argc || !repeats) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct machine machine;
+  if (!machine_create(&machine)) return EXIT_FAILURE;
+
+  int count = argc - first;
+  struct result* results = calloc(count, sizeof(struct result));
+  struct w86_history history;
+  struct w86_history_checkpoint* checkpoints = history_interval ? calloc(HISTORY_CHECKPOINTS, sizeof(struct w86_history_checkpoint)) : nullptr;
+  uint32_t* journal = history_interval ? calloc(HISTORY_JOURNAL_SIZE, sizeof(uint32_t)) : nullptr;
+  if (!results || (history_interval && (!checkpoints || !journal))) {
+    free(journal);
+    free(checkpoints);
+    free(results);
+    machine_destroy(&machine);
+    fputs("out of memory\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if (history_interval) w86_history_start(machine.state, &history, history_interval, checkpoints, HISTORY_CHECKPOINTS, journal, HISTORY_JOURNAL_SIZE);
+
+  bool ok = true;
+  puts("workload\tinstructions\tseconds\tmips");
+  for (int i = 0; i < count && ok; i++) {
+    ok = measure(&machine, argv[first + i], repeats, &results[i]);
+    if (ok) printf("%s\t%llu\t%.6f\t%.2f\n", results[i].name, (unsigned long long) results[i].instructions, results[i].seconds, results[i].mips);
+  }
+  if (ok && baseline_path) ok = compare(baseline_path, results, count, threshold);
+
+  free(journal);
+  free(checkpoints);
+  free(results);
+  machine_destroy(&machine);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// headless runner for flat binaries like the ones test/test.ld produces
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "machine.h"
+#include "profile.h"
+#include "trace.h"
+#include "w86.h"
+
+#define BATCH_SIZE 1000000
+#define TRACE_BUFFER_SIZE 65536
+#define HOT_SPOTS 10
+#define CLOCK_RATE 4772727 // the ibm pc's, for how long it would have taken there
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-n max_instructions] [-i port_reads] [-T trace.bin] [-P profile.folded [-s sample_interval]] program.bin\n", name);
+}
+
+// w86-trace turns it back into something readable
+static void write_trace(void* context, const uint8_t* data, uint32_t size) {
+  fwrite(data, 1, size, context);
+}
+
+static bool write_profile(const struct w86_profile* profile, const char* path) {
+  uint32_t size = w86_profile_folded(profile, nullptr, 0) + 1;
+  char* folded = malloc(size);
+  FILE* file = fopen(path, "w");
+  if (!folded || !file) {
+    perror(path);
+    free(folded);
+    if (file) fclose(file);
+    return false;
+  }
+  w86_profile_folded(profile, folded, size);
+  fputs(folded, file);
+  fclose(file);
+  free(folded);
+  return true;
+}
+
+// the busiest linear addresses, picked by insertion into a short sorted list
+static void print_hot_spots(const struct w86_profile* profile) {
+  uint32_t hot[HOT_SPOTS] = { 0 };
+  uint32_t count = 0;
+  for (uint32_t address = 0; address < W86_MEMORY_SIZE; address++) {
+    uint32_t hits = profile->counts[address];
+    if (!hits || (count == HOT_SPOTS && hits <= profile->counts[hot[count - 1]])) continue;
+
+    uint32_t i = count < HOT_SPOTS ? count++ : count - 1;
+    for (; i && profile->counts[hot[i - 1]] < hits; i--) hot[i] = hot[i - 1];
+    hot[i] = address;
+  }
+
+  printf("hot spots (%s, %llu counted):\n", profile->interval ? "sampled" : "exact", (unsigned long long) profile->total);
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t hits = profile->counts[hot[i]];
+    printf("  %05x: %10u  %5.1f%%\n", hot[i], hits, profile->total ? 100.0 * hits / profile->total : 0.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  uint64_t max_instructions = UINT64_MAX;
+  const char* reads_path = nullptr;
+  const char* trace_path = nullptr;
+  const char* profile_path = nullptr;
+  uint32_t sample_interval = 0;
+  const char* program_path = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      max_instructions = strtoull(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+      reads_path = argv[++i];
+    } else if (!strcmp(argv[i], "-T") && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (!strcmp(argv[i], "-P") && i + 1 < argc) {
+      profile_path = argv[++i];
+    } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      sample_interval = strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] != '-' && !program_path) {
+      program_path = argv[i];
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (!program_path) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  struct machine machine;
+  if (!machine_create(&machine)) return EXIT_FAILURE;
+  struct w86_cpu_state* state = machine.state;
+  uint8_t* writes = machine.writes;
+  if (!machine_load(program_path, machine.memory, MACHINE_MEMORY_SIZE)) return EXIT_FAILURE;
+  if (reads_path && !machine_load(reads_path, machine.reads, MACHINE_IO_SIZE)) return EXIT_FAILURE;
+
+  FILE* trace_file = nullptr;
+  struct w86_trace* trace = nullptr;
+  static uint8_t trace_buffer[TRACE_BUFFER_SIZE];
+  if (trace_path) {
+    trace_file = fopen(trace_path, "wb");
+    if (!trace_file) {
+      perror(trace_path);
+      return EXIT_FAILURE;
+    }
+    trace = malloc(sizeof(struct w86_trace)); // the journal in it is too big for the stack
+    if (!trace) {
+      fputs("out of memory\n", stderr);
+      return EXIT_FAILURE;
+    }
+    w86_trace_start(state, trace, trace_buffer, sizeof(trace_buffer), write_trace, trace_file, true, true);
+  }
+
+  struct w86_profile* profile = nullptr;
+  if (profile_path) {
+    profile = malloc(sizeof(struct w86_profile));
+    if (!profile) {
+      fputs("out of memory\n", stderr);
+      return EXIT_FAILURE;
+    }
+    w86_profile_start(state, profile, sample_interval);
+  }
+
+  enum w86_status status = W86_STATUS_SUCCESS;
+  uint64_t instructions = 0;
+  struct timespec start, end;
+  timespec_get(&start, TIME_UTC);
+  while (status == W86_STATUS_SUCCESS && instructions < max_instructions) {
+    uint64_t batch = max_instructions - instructions < BATCH_SIZE ? max_instructions - instructions : BATCH_SIZE;
+    struct w86_run_result result = w86_cpu_run(state, batch);
+    status = result.status;
+    instructions += result.instructions;
+  }
+  timespec_get(&end, TIME_UTC);
+  if (trace) {
+    w86_trace_stop(state);
+    fclose(trace_file);
+    free(trace);
+  }
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  // only the rows of the port space that were actually written to
+  puts("port writes:");
+  for (uint32_t row = 0; row < MACHINE_IO_SIZE; row += 16) {
+    bool empty = true;
+    for (uint32_t i = 0; i < 16; i++) empty &= !writes[row + i];
+    if (empty) continue;
+
+    printf("  %04x:", row);
+    for (uint32_t i = 0; i < 16; i++) printf(" %02x", writes[row + i]);
+    printf("  |");
+    for (uint32_t i = 0; i < 16; i++) putchar(writes[row + i] >= 0x20 && writes[row + i] < 0x7f ? writes[row + i] : '.');
+    puts("|");
+  }
+
+  struct w86_register_file registers = w86_cpu_get_registers(state);
+  puts("registers:");
+  printf("  ax=%04x bx=%04x cx=%04x dx=%04x si=%04x di=%04x sp=%04x bp=%04x\n",
+         registers.ax, registers.bx, registers.cx, registers.dx, registers.si, registers.di, registers.sp, registers.bp);
+  printf("  cs=%04x ds=%04x es=%04x ss=%04x ip=%04x flags=%04x\n",
+         registers.cs, registers.ds, registers.es, registers.ss, registers.ip, registers.flags);
+
+  printf("status: %s\n", machine_status_name(status));
+  printf("instructions: %llu\n", (unsigned long long) instructions);
+  printf("cycles: %llu (%.6f seconds at 4.77 MHz)\n", (unsigned long long) state->cycles, (double) state->cycles / CLOCK_RATE);
+  printf("seconds: %.6f\n", seconds);
+  printf("instructions/second: %.0f\n", seconds > 0 ? instructions / seconds : 0.0);
+  if (profile) {
+    w86_profile_stop(state);
+    if (!write_profile(profile, profile_path)) return EXIT_FAILURE;
+    print_hot_spots(profile);
+    free(profile);
+  }
+
+  machine_destroy(&machine);
+
+  return status == W86_STATUS_SUCCESS || status == W86_STATUS_HALT || status == W86_STATUS_POLL ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// turns a trace written by w86-run -T back into a listing, one retired instruction per line:
+//   index  cs:ip  bytes  disassembly  changed registers  writes
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "disasm.h"
+#include "trace.h"
+#include "w86.h"
+
+static const char* const register_names[W86_TRACE_REGISTER_COUNT] = {
+  "ax", "bx", "cx", "dx", "si", "di", "sp", "bp", "cs", "ds", "es", "ss", "ip", "flags"
+};
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s trace.bin\n", name);
+}
+
+static bool read_byte(FILE* file, uint8_t* value) {
+  int c = getc(file);
+  *value = c;
+  return c != EOF;
+}
+
+static bool read_word(FILE* file, uint16_t* value) {
+  uint8_t low, high;
+  if (!read_byte(file, &low) || !read_byte(file, &high)) return false;
+  *value = low | high << 8;
+  return true;
+}
+
+static bool read_varint(FILE* file, uint32_t* value) {
+  *value = 0;
+  for (uint32_t shift = 0; shift < 35; shift += 7) {
+    uint8_t byte;
+    if (!read_byte(file, &byte)) return false;
+    *value |= (uint32_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+static bool truncated(void) {
+  fputs("\ntruncated record\n", stderr);
+  return false;
+}
+
+static int32_t unzigzag(uint32_t value) {
+  return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static bool print_writes(FILE* file, uint32_t* address) {
+  uint32_t count;
+  if (!read_varint(file, &count)) return truncated();
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t entry;
+    uint8_t value;
+    if (!read_varint(file, &entry) || !read_byte(file, &value)) return truncated();
+    *address += unzigzag(entry >> 1);
+    if (i == 8) printf(" (%u more)", count - 8);
+    if (i >= 8) continue;
+    printf(entry & 1 ? " port %04x=%02x" : " [%05x]=%02x", *address, value);
+  }
+  return true;
+}
+
+// false on a clean end of the trace, a record cut off halfway is reported
+// the index only counts instructions, the history going back gets a line of its own
+static bool print_record(FILE* file, uint64_t* index, uint16_t* cs, uint16_t* ip, uint32_t* address) {
+  uint8_t flags;
+  if (!read_byte(file, &flags)) return false;
+
+  if (flags & W86_TRACE_REWIND) {
+    printf("%10s  rewind", "");
+    if (flags & W86_TRACE_WRITES && !print_writes(file, address)) return false;
+    putchar('\n');
+    return true;
+  }
+
+  uint32_t delta = 0;
+  uint32_t size;
+  static uint8_t bytes[1 << 16];
+  if ((flags & W86_TRACE_CS && !read_word(file, cs))
+   || (flags & W86_TRACE_IP && !read_varint(file, &delta))
+   || !read_varint(file, &size) || size > sizeof(bytes)
+   || fread(bytes, 1, size, file) != size) {
+    return truncated();
+  }
+  if (flags & W86_TRACE_IP) *ip += unzigzag(delta);
+
+  char text[96];
+  if (!disasm(bytes, size, *ip, text, sizeof(text))) snprintf(text, sizeof(text), "(bad)");
+  char hex[3 * 8 + 4] = "";
+  for (uint32_t i = 0; i < size && i < 8; i++) sprintf(hex + 3 * i, "%02x ", bytes[i]);
+  if (size > 8) strcat(hex, "...");
+  printf("%10llu  %04x:%04x  %-27s %-32s", (unsigned long long) (*index)++, *cs, *ip, hex, text);
+  *ip += size;
+
+  if (flags & W86_TRACE_REGISTERS) {
+    uint16_t mask;
+    if (!read_word(file, &mask)) return truncated();
+    for (uint32_t i = 0; i < W86_TRACE_REGISTER_COUNT; i++) {
+      uint16_t value;
+      if (!(mask >> i & 1)) continue;
+      if (!read_word(file, &value)) return truncated();
+      printf(" %s=%04x", register_names[i], value);
+    }
+  }
+
+  if (flags & W86_TRACE_WRITES && !print_writes(file, address)) return false;
+  putchar('\n');
+
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE* file = fopen(argv[1], "rb");
+  if (!file) {
+    perror(argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  char magic[sizeof(W86_TRACE_MAGIC) - 1];
+  uint8_t version;
+  uint16_t registers[W86_TRACE_REGISTER_COUNT];
+  bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, W86_TRACE_MAGIC, sizeof(magic))
+         && read_byte(file, &version) && version == W86_TRACE_VERSION;
+  for (uint32_t i = 0; ok && i < W86_TRACE_REGISTER_COUNT; i++) ok = read_word(file, &registers[i]);
+  if (!ok) {
+    fprintf(stderr, "%s: not a version %d trace\n", argv[1], W86_TRACE_VERSION);
+    fclose(file);
+    return EXIT_FAILURE;
+  }
+
+  printf("start:");
+  for (uint32_t i = 0; i < W86_TRACE_REGISTER_COUNT; i++) printf(" %s=%04x", register_names[i], registers[i]);
+  putchar('\n');
+
+  uint16_t cs = registers[offsetof(struct w86_register_file, cs) / sizeof(uint16_t)];
+  uint16_t ip = registers[offsetof(struct w86_register_file, ip) / sizeof(uint16_t)];
+  uint32_t address = 0;
+  uint64_t index = 0;
+  while (print_record(file, &index, &cs, &ip, &address)) {}
+  fclose(file);
+
+  return EXIT_SUCCESS;
+}
@@ -1,9 +1,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-import W86, { type MainModule, type W86CpuState } from "./w86.js"
+import type { W86RegisterFile } from "./w86.js"
+import { Command, Control, DEBUG_READ, DEBUG_WORDS, DIRTY_IO_WORDS, DIRTY_MEMORY_WORDS, REGISTERS, REGISTERS_IN, RING_SIZE, Status, loadRegisters, storeRegisters, type ProfileExport, type WorkerReady } from "./shared.js"
 
 interface Emulator {
-  readonly state: W86CpuState;
+  readonly worker: Worker;
+  control: Int32Array;
+  readonly state: {
+    registers: W86RegisterFile;
+  };
   memory: Uint8Array;
   program: Uint8Array;
   io: {
@@ -14,9 +19,19 @@ interface Emulator {
     run: boolean;
     halt: boolean;
     error?: string;
+    hit?: string;   // the breakpoint or watchpoint it stopped on
   };
   readonly memorySize: number;
   readonly ioSize: number;
+  dirty: {
+    memory: Int32Array;
+    io: Int32Array;
+  };
+  redraw: {
+    frame: number;
+    full: boolean;
+    registers?: W86RegisterFile;
+  };
   base: {
     memory: number;
     program: number;
@@ -25,6 +40,16 @@ interface Emulator {
       writes: number;
     };
   };
+  profile: {
+    counts: Uint32Array;
+    opcodes: Uint32Array;
+    drawn: number;
+  };
+  debug: {
+    breakpoints: Int32Array;
+    reads: Int32Array;
+    writes: Int32Array;
+  };
   readonly ui: HTMLFormElement;
 }
 
@@ -238,7 +263,87 @@ function updateIoWritesBase(a: number): void {
   emulator.base.io.writes = a;
 }
 
+// marks everything for a redraw on the next frame, for changes that didn't come from the core
 function updateDisplay(): void {
+  emulator.redraw.full = true;
+  requestRedraw();
+}
+
+// redraws are coalesced, however often this gets called we draw at most once per frame
+function requestRedraw(): void {
+  if (!emulator.redraw.frame) emulator.redraw.frame = requestAnimationFrame(drawDisplay);
+}
+
+// takes the dirty bits of the 16 lines shown from base on, returned as a mask with the first line in bit 0
+function takeDirtyLines(bitmap: Int32Array, base: number): number {
+  const first: number = base >> 4;
+  let lines: number = 0;
+  for (let word: number = first >> 5; word <= (first + 15) >> 5; word++) {
+    const low: number = Math.max(first - word * 32, 0);
+    const high: number = Math.min(first + 15 - word * 32, 31);
+    const mask: number = (high === 31 ? -1 : (1 << high + 1) - 1) & ~((1 << low) - 1);
+    const taken: number = Atomics.and(bitmap, word, ~mask) & mask;
+    const shift: number = word * 32 - first;
+    lines |= shift >= 0 ? taken << shift : taken >>> -shift;
+  }
+  return lines & 0xffff;
+}
+
+function drawView(id: string, data: Uint8Array, base: number, lines: number): void {
+  if (!lines) return;
+  const rows: NodeList = document.getElementById(id)!.querySelectorAll("tbody tr");
+  for (let i: number = 0; i < 16; i++) {
+    if (!(lines >> i & 1)) continue;
+    const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td input");
+    for (let j: number = 0; j < 16; j++) {
+      const cell: HTMLInputElement = <HTMLInputElement> cells.item(j);
+      cell.value = data[base + i * 16 + j]!.toString(16).toUpperCase().padStart(2, "0");
+    }
+  }
+}
+
+// indices of the biggest nonzero counts, biggest first, along with the sum of all of them
+function topCounts(counts: Uint32Array, n: number): { top: number[], total: number } {
+  const top: number[] = [];
+  let total: number = 0;
+  for (let i: number = 0; i < counts.length; i++) {
+    const count: number = counts[i]!;
+    total += count;
+    if (!count || (top.length === n && count <= counts[top[n - 1]!]!)) continue;
+
+    let j: number = top.length < n ? top.push(i) - 1 : n - 1;
+    for (; j && counts[top[j - 1]!]! < count; j--) top[j] = top[j - 1]!;
+    top[j] = i;
+  }
+  return { top, total };
+}
+
+// scanning a megabyte of counters is too much for every frame
+function drawProfile(full: boolean): void {
+  const now: number = performance.now();
+  if (!full && now - emulator.profile.drawn < 500) return;
+  emulator.profile.drawn = now;
+
+  const rows: NodeList = document.getElementById("profile-view")!.querySelectorAll("tbody tr");
+  const columns: [ Uint32Array, number ][] = [ [ emulator.profile.counts, 5 ], [ emulator.profile.opcodes, 2 ] ];
+  columns.forEach(([ counts, digits ]: [ Uint32Array, number ], column: number): void => {
+    const { top, total } = topCounts(counts, rows.length);
+    for (let i: number = 0; i < rows.length; i++) {
+      const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td");
+      const index: number | undefined = top[i];
+      cells.item(column * 3)!.textContent = index === undefined ? "" : index.toString(16).toUpperCase().padStart(digits, "0");
+      cells.item(column * 3 + 1)!.textContent = index === undefined ? "" : counts[index]!.toString();
+      cells.item(column * 3 + 2)!.textContent = index === undefined ? "" : (100 * counts[index]! / total).toFixed(1);
+    }
+  });
+}
+
+function drawDisplay(): void {
+  emulator.redraw.frame = 0;
+  const full: boolean = emulator.redraw.full;
+  emulator.redraw.full = false;
+  syncExecState();
+
   const execState: HTMLOutputElement = <HTMLOutputElement> emulator.ui.elements.namedItem("exec-state");
   if (!emulator.execState.error) {
     if (emulator.execState.run) {
@@ -252,7 +357,7 @@ function updateDisplay(): void {
       execState.classList.replace("status-halt", "status-stop");
     }
     if (emulator.execState.halt) execState.classList.replace("status-run", "status-halt");
-    execState.value = `${emulator.execState.run ? "Running" : "Stopped"}${emulator.execState.halt ? " (Halted)" : ""}`;
+    execState.value = `${emulator.execState.run ? "Running" : "Stopped"}${emulator.execState.halt ? " (Halted)" : ""}${emulator.execState.hit ? ` (${emulator.execState.hit})` : ""}`;
   } else {
     (<Element> emulator.ui.elements.namedItem("run")).classList.remove("hidden");
     (<Element> emulator.ui.elements.namedItem("stop")).classList.add("hidden");
@@ -261,91 +366,61 @@ function updateDisplay(): void {
     execState.value = emulator.execState.error;
   }
 
-  (<HTMLInputElement> emulator.ui.elements.namedItem("ax")).value = emulator.state.registers.ax.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("bx")).value = emulator.state.registers.bx.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("cx")).value = emulator.state.registers.cx.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("dx")).value = emulator.state.registers.dx.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("si")).value = emulator.state.registers.si.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("di")).value = emulator.state.registers.di.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("sp")).value = emulator.state.registers.sp.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("bp")).value = emulator.state.registers.bp.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("cs")).value = emulator.state.registers.cs.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("ds")).value = emulator.state.registers.ds.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("es")).value = emulator.state.registers.es.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("ss")).value = emulator.state.registers.ss.toString(16).toUpperCase().padStart(4, "0");
-  (<HTMLInputElement> emulator.ui.elements.namedItem("ip")).value = emulator.state.registers.ip.toString(16).toUpperCase().padStart(4, "0");
-  for (let i: number = 0; i < 16; i++) {
-    (<HTMLInputElement> emulator.ui.elements.namedItem("flags" + i.toString())).checked = (emulator.state.registers.flags >> i & 1) !== 0;
-  }
-
-  {
-    const rows: NodeList = document.getElementById("memory-view")!.querySelectorAll("tbody tr");
-    for (let i: number = 0; i < 16; i++) {
-      const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td input");
-      for (let j: number = 0; j < 16; j++) {
-        const cell: HTMLInputElement = <HTMLInputElement> cells.item(j);
-        cell.value = emulator.memory[emulator.base.memory + i * 16 + j]!.toString(16).toUpperCase().padStart(2, "0");
-      }
+  // only the registers that differ from what's on screen
+  const registers: W86RegisterFile = emulator.state.registers;
+  const shown: W86RegisterFile | undefined = emulator.redraw.registers;
+  for (const name of [ "ax", "bx", "cx", "dx", "si", "di", "sp", "bp", "cs", "ds", "es", "ss", "ip" ] as const) {
+    if (full || registers[name] !== shown?.[name]) {
+      (<HTMLInputElement> emulator.ui.elements.namedItem(name)).value = registers[name].toString(16).toUpperCase().padStart(4, "0");
     }
   }
-
-  {
-    const rows: NodeList = document.getElementById("program-view")!.querySelectorAll("tbody tr");
+  if (full || registers.flags !== shown?.flags) {
     for (let i: number = 0; i < 16; i++) {
-      const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td input");
-      for (let j: number = 0; j < 16; j++) {
-        const cell: HTMLInputElement = <HTMLInputElement> cells.item(j);
-        cell.value = emulator.program[emulator.base.program + i * 16 + j]!.toString(16).toUpperCase().padStart(2, "0");
-      }
+      (<HTMLInputElement> emulator.ui.elements.namedItem("flags" + i.toString())).checked = (registers.flags >> i & 1) !== 0;
     }
   }
+  emulator.redraw.registers = registers;
 
-  {
-    const rows: NodeList = document.getElementById("io-reads-view")!.querySelectorAll("tbody tr");
-    for (let i: number = 0; i < 16; i++) {
-      const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td input");
-      for (let j: number = 0; j < 16; j++) {
-        const cell: HTMLInputElement = <HTMLInputElement> cells.item(j);
-        cell.value = emulator.io.reads[emulator.base.io.reads + i * 16 + j]!.toString(16).toUpperCase().padStart(2, "0");
-      }
-    }
-  }
+  // the bits get taken even on a full redraw so they don't come back next frame
+  drawView("memory-view", emulator.memory, emulator.base.memory, takeDirtyLines(emulator.dirty.memory, emulator.base.memory) | (full ? 0xffff : 0));
+  drawView("program-view", emulator.program, emulator.base.program, full ? 0xffff : 0);
+  drawView("io-reads-view", emulator.io.reads, emulator.base.io.reads, full ? 0xffff : 0);
+  drawView("io-writes-view", emulator.io.writes, emulator.base.io.writes, takeDirtyLines(emulator.dirty.io, emulator.base.io.writes) | (full ? 0xffff : 0));
+  drawProfile(full);
 
-  {
-    const rows: NodeList = document.getElementById("io-writes-view")!.querySelectorAll("tbody tr");
-    for (let i: number = 0; i < 16; i++) {
-      const cells: NodeList = (<Element> rows.item(i)).querySelectorAll("td input");
-      for (let j: number = 0; j < 16; j++) {
-        const cell: HTMLInputElement = <HTMLInputElement> cells.item(j);
-        cell.value = emulator.io.writes[emulator.base.io.writes + i * 16 + j]!.toString(16).toUpperCase().padStart(2, "0");
-      }
-    }
-  }
+  if (emulator.execState.run) requestRedraw();
 }
 
-function stepEmulator(): void {
-  if (emulator.execState.halt) return;
-  switch (w86.w86CpuStep(emulator.state)) {
-  case w86.W86Status.SUCCESS:
+function handleStatus(status: Status): void {
+  if (status !== Status.BREAKPOINT && status !== Status.WATCHPOINT) emulator.execState.hit = undefined;
+  switch (status) {
+  case Status.SUCCESS:
+  case Status.POLL:
     break;
 
-  case w86.W86Status.HALT:
+  case Status.HALT:
     emulator.execState.halt = true;
     break;
 
-  case w86.W86Status.UNDEFINED_OPCODE:
+  case Status.BREAKPOINT:
+  case Status.WATCHPOINT:
+    emulator.execState.run = false;
+    emulator.execState.hit = `${status === Status.BREAKPOINT ? "Breakpoint" : Atomics.load(emulator.control, Control.HIT_ACCESS) === DEBUG_READ ? "Read watchpoint" : "Write watchpoint"} at 0x${Atomics.load(emulator.control, Control.HIT).toString(16).toUpperCase().padStart(5, "0")}`;
+    break;
+
+  case Status.UNDEFINED_OPCODE:
     emulator.execState.run = false;
     emulator.execState.error = `Undefined opcode at 0x${(((emulator.state.registers.cs << 4) + emulator.state.registers.ip) % (1 << 20)).toString(16).toUpperCase().padStart(5, "0")}`;
     console.warn(emulator.execState.error);
     break;
 
-  case w86.W86Status.UNIMPLEMENTED_OPCODE:
+  case Status.UNIMPLEMENTED_OPCODE:
     emulator.execState.run = false;
     emulator.execState.error = `Unimplemented opcode at 0x${(((emulator.state.registers.cs << 4) + emulator.state.registers.ip) % (1 << 20)).toString(16).toUpperCase().padStart(5, "0")}`;
     console.error(emulator.execState.error);
     break;
 
-  case w86.W86Status.INVALID_OPERATION:
+  case Status.INVALID_OPERATION:
     emulator.execState.run = false;
     emulator.execState.error = `Invalid operation at 0x${(((emulator.state.registers.cs << 4) + emulator.state.registers.ip) % (1 << 20)).toString(16).toUpperCase().padStart(5, "0")}`;
     console.warn(emulator.execState.error);
@@ -358,20 +433,65 @@ function stepEmulator(): void {
   }
 }
 
-function runEmulator(): void {
-  if (emulator.execState.run) {
-    stepEmulator();
-    updateDisplay();
-    setTimeout(runEmulator, 5);
+// resolves once the worker has finished every command up to head
+function settleCommands(head: number): Promise<void> {
+  return new Promise((resolve: () => void): void => {
+    const poll = (): void => {
+      if (Atomics.load(emulator.control, Control.TAIL) - head >= 0) {
+        resolve();
+      } else {
+        setTimeout(poll, 0);
+      }
+    };
+    poll();
+  });
+}
+
+function sendCommand(command: Command): Promise<void> {
+  const head: number = Atomics.load(emulator.control, Control.HEAD);
+  if (head - Atomics.load(emulator.control, Control.TAIL) >= RING_SIZE) {
+    return settleCommands(head - RING_SIZE + 1).then((): Promise<void> => sendCommand(command));
   }
+
+  Atomics.store(emulator.control, Control.RING + head % RING_SIZE, command);
+  Atomics.store(emulator.control, Control.HEAD, head + 1);
+  Atomics.add(emulator.control, Control.WAKE, 1);
+  Atomics.notify(emulator.control, Control.WAKE);
+  return settleCommands(head + 1);
+}
+
+// picks up whatever the worker published
+function syncExecState(): void {
+  emulator.execState.run = Atomics.load(emulator.control, Control.RUNNING) !== 0;
+  emulator.execState.halt = Atomics.load(emulator.control, Control.HALTED) !== 0;
+  handleStatus(<Status> Atomics.load(emulator.control, Control.STATUS));
 }
 
-function resetEmulator(): void {
+// a list of hex linear addresses becomes the bits of one of the debug bitmaps, the worker picks them up with DEBUG_REFRESH
+function setDebugBitmap(bitmap: Int32Array, list: string): Promise<void> {
+  bitmap.fill(0);
+  for (const word of list.split(/[\s,]+/)) {
+    const address: number = parseInt(word, 16);
+    if (word && !isNaN(address) && address >= 0 && address < DEBUG_WORDS * 32) bitmap[address >> 5] = bitmap[address >> 5]! | 1 << (address & 31);
+  }
+  return sendCommand(Command.DEBUG_REFRESH);
+}
+
+function stepEmulator(): Promise<void> {
+  return sendCommand(Command.STEP);
+}
+
+function stepBackEmulator(): Promise<void> {
+  emulator.execState.halt = false;
+  return sendCommand(Command.STEP_BACK);
+}
+
+function resetEmulator(): Promise<void> {
   emulator.execState = {
     run: false,
     halt: false
   };
-  emulator.state.registers = {
+  storeRegisters(emulator.control, REGISTERS_IN, {
     ax: 0x0000,
     bx: 0x0000,
     cx: 0x0000,
@@ -386,14 +506,27 @@ function resetEmulator(): void {
     ss: 0x0000,
     ip: 0x0000,
     flags: 0x0000
-  };
+  });
+  return sendCommand(Command.RESET);
 }
 
-function restartEmulator(): void {
-  resetEmulator();
-  emulator.memory.set(emulator.program);
-  emulator.io.reads.fill(0);
-  emulator.io.writes.fill(0);
+// puts the program in a freshly reset machine and snapshots that for restartEmulator
+function loadEmulator(): Promise<void> {
+  return resetEmulator().then((): Promise<void> => {
+    emulator.memory.set(emulator.program);
+    emulator.io.reads.fill(0);
+    emulator.io.writes.fill(0);
+    sendCommand(Command.INVALIDATE);
+    return sendCommand(Command.SNAPSHOT);
+  });
+}
+
+function restartEmulator(): Promise<void> {
+  emulator.execState = {
+    run: false,
+    halt: false
+  };
+  return sendCommand(Command.RESTORE);
 }
 
 function reloadEmulator(): Promise<void> {
@@ -401,15 +534,15 @@ function reloadEmulator(): Promise<void> {
   if (example.value) {
     return fetch(`test/${example.value}.bin`).then((res: Response): Promise<void> => {
       if (!res.ok) throw new Error(`Got ${res.status} ${res.statusText} when requesting ${res.url}`);
-      return res.arrayBuffer().then((buf: ArrayBuffer): void => {
+      return res.arrayBuffer().then((buf: ArrayBuffer): Promise<void> => {
         emulator.program.fill(0).set(new Uint8Array(buf).subarray(0, emulator.memorySize));
-        restartEmulator();
+        return loadEmulator();
       });
     });
   } else {
-    return (<HTMLInputElement> emulator.ui.elements.namedItem("rom")).files?.item(0)?.arrayBuffer().then((buf: ArrayBuffer): void => {
+    return (<HTMLInputElement> emulator.ui.elements.namedItem("rom")).files?.item(0)?.arrayBuffer().then((buf: ArrayBuffer): Promise<void> => {
       emulator.program.fill(0).set(new Uint8Array(buf).subarray(0, emulator.memorySize));
-      restartEmulator();
+      return loadEmulator();
     })!;
   }
 }
@@ -436,6 +569,7 @@ function reloadEmulator(): Promise<void> {
         }
 
         emulator.memory[emulator.base.memory + i * 16 + j] = parseInt(e.value, 16);
+        sendCommand(Command.INVALIDATE);
 
         updateDisplay();
       });
@@ -470,8 +604,7 @@ function reloadEmulator(): Promise<void> {
 
         emulator.program[emulator.base.program + i * 16 + j] = parseInt(e.value, 16);
 
-        restartEmulator();
-        updateDisplay();
+        loadEmulator().then(updateDisplay);
       });
 
       const cell: Node = document.createElement("td");
@@ -503,6 +636,7 @@ function reloadEmulator(): Promise<void> {
         }
 
         emulator.io.reads[emulator.base.io.reads + i * 16 + j] = parseInt(e.value, 16);
+        sendCommand(Command.INVALIDATE); // so restarting puts it back
 
         updateDisplay();
       });
@@ -535,10 +669,26 @@ function reloadEmulator(): Promise<void> {
   }
 }
 
-const w86: MainModule = await W86();
+// the core lives in a worker, memory, io and registers are read straight out of its shared heap
+const worker: Worker = new Worker(new URL("./worker.js", import.meta.url), { type: "module" });
+const ready: WorkerReady = await new Promise((resolve: (ready: WorkerReady) => void): void => {
+  worker.addEventListener("message", (event: MessageEvent<WorkerReady>): void => resolve(event.data), { once: true });
+});
 
 const emulator: Emulator = {
-  state: new w86.W86CpuState(),
+  worker,
+  control: new Int32Array(ready.control),
+  state: {
+    get registers(): W86RegisterFile {
+      return loadRegisters(emulator.control, REGISTERS);
+    },
+    // also written to the published copy so the display doesn't lag behind
+    set registers(registers: W86RegisterFile) {
+      storeRegisters(emulator.control, REGISTERS_IN, registers);
+      storeRegisters(emulator.control, REGISTERS, registers);
+      sendCommand(Command.SET_REGISTERS);
+    }
+  },
   memory: new Uint8Array(),
   program: new Uint8Array(),
   io: {
@@ -551,6 +701,14 @@ const emulator: Emulator = {
   },
   memorySize: 1048576,
   ioSize: 65536,
+  dirty: {
+    memory: new Int32Array(ready.heap, ready.dirty, DIRTY_MEMORY_WORDS),
+    io: new Int32Array(ready.heap, ready.dirty + DIRTY_MEMORY_WORDS * Int32Array.BYTES_PER_ELEMENT, DIRTY_IO_WORDS)
+  },
+  redraw: {
+    frame: 0,
+    full: true
+  },
   base: {
     memory: 0x00000,
     program: 0x00000,
@@ -559,58 +717,54 @@ const emulator: Emulator = {
       writes: 0x0000
     }
   },
+  profile: {
+    counts: new Uint32Array(ready.heap, ready.profile.counts, 1048576),
+    opcodes: new Uint32Array(ready.heap, ready.profile.opcodes, 256),
+    drawn: 0
+  },
+  debug: {
+    breakpoints: new Int32Array(ready.heap, ready.debug.breakpoints, DEBUG_WORDS),
+    reads: new Int32Array(ready.heap, ready.debug.reads, DEBUG_WORDS),
+    writes: new Int32Array(ready.heap, ready.debug.writes, DEBUG_WORDS)
+  },
   ui: <HTMLFormElement> document.getElementById("emulator")
 };
-emulator.state.registers = {
-  ax: 0x0000,
-  bx: 0x0000,
-  cx: 0x0000,
-  dx: 0x0000,
-  si: 0x0000,
-  di: 0x0000,
-  sp: 0x0000,
-  bp: 0x0000,
-  cs: 0xffff,
-  ds: 0x0000,
-  es: 0x0000,
-  ss: 0x0000,
-  ip: 0x0000,
-  flags: 0x0000
-};
-emulator.state.memory = w86._malloc(emulator.memorySize);
-emulator.state.io = {
-  reads: w86._malloc(emulator.ioSize),
-  writes: w86._malloc(emulator.ioSize)
-};
-emulator.memory = w86.HEAPU8.subarray(emulator.state.memory, emulator.state.memory + emulator.memorySize).fill(0);
+emulator.memory = new Uint8Array(ready.heap, ready.memory, emulator.memorySize);
 emulator.program = new Uint8Array(new ArrayBuffer(emulator.memorySize));
-emulator.io.reads = w86.HEAPU8.subarray(emulator.state.io.reads, emulator.state.io.reads + emulator.ioSize).fill(0);
-emulator.io.writes = w86.HEAPU8.subarray(emulator.state.io.writes, emulator.state.io.writes + emulator.ioSize).fill(0);
+emulator.io.reads = new Uint8Array(ready.heap, ready.reads, emulator.ioSize);
+emulator.io.writes = new Uint8Array(ready.heap, ready.writes, emulator.ioSize);
+
+// the worker's only other message is the answer to PROFILE_EXPORT
+worker.addEventListener("message", (event: MessageEvent<ProfileExport>): void => {
+  const link: HTMLAnchorElement = document.createElement("a");
+  link.href = URL.createObjectURL(new Blob([ event.data.folded ], { type: "text/plain" }));
+  link.download = "w86.folded";
+  link.click();
+  URL.revokeObjectURL(link.href);
+});
 
 (<Element> emulator.ui.elements.namedItem("run")).addEventListener("click", (): void => {
-  emulator.execState.run = true;
-  setTimeout(runEmulator, 5);
+  sendCommand(Command.RUN).then(updateDisplay); // keeps redrawing every frame while running
 });
 
 (<Element> emulator.ui.elements.namedItem("stop")).addEventListener("click", (): void => {
-  emulator.execState.run = false;
-  updateDisplay();
+  sendCommand(Command.STOP).then(updateDisplay);
 });
 
 (<Element> emulator.ui.elements.namedItem("step")).addEventListener("click", (): void => {
-  emulator.execState.run = false;
-  stepEmulator();
-  updateDisplay();
+  stepEmulator().then(updateDisplay);
+});
+
+(<Element> emulator.ui.elements.namedItem("step-back")).addEventListener("click", (): void => {
+  stepBackEmulator().then(updateDisplay);
 });
 
 (<Element> emulator.ui.elements.namedItem("reset")).addEventListener("click", (): void => {
-  resetEmulator();
-  updateDisplay();
+  resetEmulator().then(updateDisplay);
 });
 
 (<Element> emulator.ui.elements.namedItem("restart")).addEventListener("click", (): void => {
-  restartEmulator();
-  updateDisplay();
+  restartEmulator().then(updateDisplay);
 });
 
 (<Element> emulator.ui.elements.namedItem("reload")).addEventListener("click", (): void => {
@@ -790,3 +944,33 @@ emulator.io.writes = w86.HEAPU8.subarray(emulator.state.io.writes, emulator.stat
   updateIoWritesBase(0xff00);
   updateDisplay();
 });
+
+(<Element> emulator.ui.elements.namedItem("clock")).addEventListener("change", (event: Event): void => {
+  Atomics.store(emulator.control, Control.CLOCK, Number((<HTMLSelectElement> event.target).value));
+  sendCommand(Command.SET_CLOCK);
+});
+
+(<Element> emulator.ui.elements.namedItem("profile-mode")).addEventListener("change", (event: Event): void => {
+  const mode: string = (<HTMLSelectElement> event.target).value;
+  sendCommand(mode === "exact" ? Command.PROFILE_EXACT : mode === "sampled" ? Command.PROFILE_SAMPLED : Command.PROFILE_OFF).then(updateDisplay);
+});
+
+(<Element> emulator.ui.elements.namedItem("profile-clear")).addEventListener("click", (): void => {
+  sendCommand(Command.PROFILE_CLEAR).then(updateDisplay);
+});
+
+(<Element> emulator.ui.elements.namedItem("profile-export")).addEventListener("click", (): void => {
+  sendCommand(Command.PROFILE_EXPORT);
+});
+
+(<Element> emulator.ui.elements.namedItem("breakpoints")).addEventListener("change", (event: Event): void => {
+  setDebugBitmap(emulator.debug.breakpoints, (<HTMLInputElement> event.target).value);
+});
+
+(<Element> emulator.ui.elements.namedItem("watch-reads")).addEventListener("change", (event: Event): void => {
+  setDebugBitmap(emulator.debug.reads, (<HTMLInputElement> event.target).value);
+});
+
+(<Element> emulator.ui.elements.namedItem("watch-writes")).addEventListener("change", (event: Event): void => {
+  setDebugBitmap(emulator.debug.writes, (<HTMLInputElement> event.target).value);
+});
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+import type { W86RegisterFile } from "./w86.js"
+
+// the page and the worker talk through an Int32Array over a SharedArrayBuffer
+// commands go through a ring the page writes and the worker drains, everything else is published by the worker
+export enum Control {
+  HEAD,     // commands written by the page
+  TAIL,     // commands finished by the worker
+  WAKE,     // bumped with every command so a sleeping worker notices
+  RUNNING,
+  HALTED,
+  STATUS,   // W86Status value of the last batch
+  HIT,      // linear address of the last breakpoint or watchpoint that stopped it
+  HIT_ACCESS, // W86_DEBUG_READ or W86_DEBUG_WRITE for a watchpoint, 0 for a breakpoint
+  CLOCK,    // Hz to pace the core at, 0 runs it flat out, handed over with SET_CLOCK
+  RING = 9
+}
+
+export const RING_SIZE: number = 64;
+export const REGISTERS: number = Control.RING + RING_SIZE; // registers published by the worker
+export const REGISTERS_IN: number = REGISTERS + 14;        // registers handed over with SET_REGISTERS and RESET
+export const CONTROL_SIZE: number = REGISTERS_IN + 14;
+
+export enum Command {
+  RUN,
+  STOP,
+  STEP,
+  RESET,          // stop, clear the halt and load REGISTERS_IN
+  SET_REGISTERS,
+  INVALIDATE,
+  SNAPSHOT,       // remember the whole machine
+  RESTORE,        // stop, clear the halt and go back to the snapshot, only pages written since get copied
+  STEP_BACK,      // stop, clear the halt and undo the last instruction
+  PROFILE_OFF,
+  PROFILE_SAMPLED, // these two start over with an empty profile
+  PROFILE_EXACT,
+  PROFILE_CLEAR,
+  PROFILE_EXPORT, // the worker answers with a ProfileExport message
+  DEBUG_REFRESH,  // picks up the breakpoint and watchpoint bitmaps the page changed
+  SET_CLOCK
+}
+
+// mirrors enum w86_status, embind's enum objects can't cross threads
+export enum Status {
+  SUCCESS,
+  HALT,
+  UNKNOWN_ERROR,
+  UNDEFINED_OPCODE,
+  UNIMPLEMENTED_OPCODE,
+  INVALID_OPERATION,
+  BREAKPOINT,
+  WATCHPOINT,
+  POLL // waiting on a port the page has to change
+}
+
+// struct w86_dirty, one bit per 16 byte line of memory and then of io writes
+export const DIRTY_MEMORY_WORDS: number = 2048;
+export const DIRTY_IO_WORDS: number = 128;
+
+// struct w86_debug, one bit per linear address in each of the bitmaps
+export const DEBUG_WORDS: number = 32768;
+export const DEBUG_READ: number = 0b01;
+
+export interface WorkerReady {
+  heap: SharedArrayBuffer;
+  control: SharedArrayBuffer;
+  memory: number;
+  reads: number;
+  writes: number;
+  dirty: number;
+  profile: {
+    counts: number;   // Uint32Array of instructions or samples per linear address
+    opcodes: number;  // the same per opcode
+  };
+  debug: {
+    breakpoints: number;
+    reads: number;
+    writes: number;
+  };
+}
+
+export interface ProfileExport {
+  folded: string;     // one "root;caller;callee count" line per call path
+}
+
+const registerNames = [ "ax", "bx", "cx", "dx", "si", "di", "sp", "bp", "cs", "ds", "es", "ss", "ip", "flags" ] as const;
+
+export function loadRegisters(control: Int32Array, at: number): W86RegisterFile {
+  const registers: Record<string, number> = {};
+  registerNames.forEach((name: string, i: number): void => {
+    registers[name] = Atomics.load(control, at + i);
+  });
+  return <W86RegisterFile> <unknown> registers;
+}
+
+export function storeRegisters(control: Int32Array, at: number, registers: W86RegisterFile): void {
+  registerNames.forEach((name: typeof registerNames[number], i: number): void => {
+    Atomics.store(control, at + i, registers[name]);
+  });
+}
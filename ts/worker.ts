@@ -0,0 +1,230 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// runs the core off the main thread, the page only reads the shared heap and sends commands
+// needs a cross origin isolated page (COOP/COEP headers), otherwise there's no SharedArrayBuffer
+
+import W86, { type MainModule, type W86CpuState, type W86DebugHit } from "./w86.js"
+import { Command, Control, CONTROL_SIZE, REGISTERS, REGISTERS_IN, RING_SIZE, Status, loadRegisters, storeRegisters, type ProfileExport, type WorkerReady } from "./shared.js"
+
+const ioSize: number = 65536;
+const batchSize: number = 100000;
+const historyInterval: number = 100000;   // stepping back replays at most this many instructions
+const historyCheckpoints: number = 64;
+const historyJournalSize: number = 1 << 20; // 4 MiB of undo entries
+const profileInterval: number = 1000;     // instructions per sample when not counting every one
+const frameTime: number = 10;             // ms of emulated time run in one go when paced
+const maxLag: number = 100;               // ms a slow host may fall behind before it stops trying to catch up
+
+const w86: MainModule = await W86();
+
+// the core's jit hands us finished wasm modules, we link them against its memory and function table
+interface W86Jit {
+  w86JitInstantiate(code: Uint8Array, memory: WebAssembly.Memory, table: WebAssembly.Table): number;
+  w86JitRelease(index: number): void;
+}
+
+Object.assign(w86, {
+  w86JitInstantiate(code: Uint8Array, memory: WebAssembly.Memory, table: WebAssembly.Table): number {
+    try {
+      const instance: WebAssembly.Instance = new WebAssembly.Instance(new WebAssembly.Module(code), { env: { memory, table } });
+      return w86.addFunction(<(...args: any[]) => any> instance.exports.run, "ii");
+    } catch {
+      return 0; // the block just stays interpreted
+    }
+  },
+  w86JitRelease(index: number): void {
+    w86.removeFunction(index);
+  }
+} satisfies W86Jit);
+
+const state: W86CpuState = new w86.W86CpuState();
+state.memory = w86._malloc(w86.W86_MEMORY_SIZE);
+state.io = {
+  reads: w86._malloc(ioSize),
+  writes: w86._malloc(ioSize)
+};
+w86.HEAPU8.fill(0, state.memory, state.memory + w86.W86_MEMORY_SIZE);
+w86.HEAPU8.fill(0, state.io.reads, state.io.reads + ioSize);
+w86.HEAPU8.fill(0, state.io.writes, state.io.writes + ioSize);
+w86.w86BusReset(state); // all ram, devices can map over it with w86BusMapRom and w86BusMapMmio
+const snapshot: number = w86._malloc(w86.W86_SNAPSHOT_SIZE);
+w86.w86HistoryStart(state, w86._malloc(w86.W86_HISTORY_SIZE), historyInterval,
+                    w86._malloc(historyCheckpoints * w86.W86_HISTORY_CHECKPOINT_SIZE), historyCheckpoints,
+                    w86._malloc(historyJournalSize * Uint32Array.BYTES_PER_ELEMENT), historyJournalSize);
+const profile: number = w86._malloc(w86.W86_PROFILE_SIZE);
+w86.w86ProfileClear(profile); // so the page reads zeros until it's started
+const debug: number = w86._malloc(w86.W86_DEBUG_SIZE);
+w86.w86DebugStart(state, debug); // costs nothing until the page sets a breakpoint or watchpoint
+const scheduler: number = w86._malloc(w86.W86_SCHEDULER_SIZE);
+const pic: number = w86._malloc(w86.W86_PIC_SIZE);
+const pit: number = w86._malloc(w86.W86_PIT_SIZE);
+startDevices();
+
+const control: Int32Array = new Int32Array(new SharedArrayBuffer(CONTROL_SIZE * Int32Array.BYTES_PER_ELEMENT));
+let clock: number = 0;    // Hz, 0 for flat out
+let deadline: number = 0; // when the next paced frame is due
+let polling: boolean = false; // nothing to do until the page changes a port
+state.registers = {
+  ax: 0x0000,
+  bx: 0x0000,
+  cx: 0x0000,
+  dx: 0x0000,
+  si: 0x0000,
+  di: 0x0000,
+  sp: 0x0000,
+  bp: 0x0000,
+  cs: 0xffff,
+  ds: 0x0000,
+  es: 0x0000,
+  ss: 0x0000,
+  ip: 0x0000,
+  flags: 0x0000
+};
+w86.w86SnapshotTake(state, snapshot); // so there is always something to restore
+
+// back to power on for the timer and the interrupt controller, nothing pending and nothing counting
+function startDevices(): void {
+  w86.w86IoReset(state);
+  w86.w86SchedulerStart(state, scheduler);
+  w86.w86PicStart(state, pic); // ports 20h and 21h
+  w86.w86PitStart(state, pit); // ports 40h to 43h, counter 0 on irq 0
+}
+
+function publish(status: Status): void {
+  storeRegisters(control, REGISTERS, state.registers);
+  Atomics.store(control, Control.STATUS, status);
+  if (status === Status.BREAKPOINT || status === Status.WATCHPOINT) {
+    const hit: W86DebugHit = w86.w86DebugHit(debug);
+    Atomics.store(control, Control.HIT, hit.address);
+    Atomics.store(control, Control.HIT_ACCESS, hit.access);
+  }
+  if (status === Status.HALT) Atomics.store(control, Control.HALTED, 1);
+  if (status !== Status.SUCCESS && status !== Status.HALT && status !== Status.POLL) Atomics.store(control, Control.RUNNING, 0);
+  polling = status === Status.POLL;
+}
+
+function execute(command: Command): void {
+  switch (command) {
+  case Command.RUN:
+    Atomics.store(control, Control.RUNNING, 1);
+    deadline = performance.now();
+    break;
+
+  case Command.STOP:
+    Atomics.store(control, Control.RUNNING, 0);
+    break;
+
+  case Command.STEP:
+    Atomics.store(control, Control.RUNNING, 0);
+    if (!Atomics.load(control, Control.HALTED)) publish(w86.w86CpuStep(state).value);
+    break;
+
+  case Command.RESET:
+    Atomics.store(control, Control.RUNNING, 0);
+    Atomics.store(control, Control.HALTED, 0);
+    state.registers = loadRegisters(control, REGISTERS_IN);
+    startDevices();
+    publish(Status.SUCCESS);
+    break;
+
+  case Command.SET_REGISTERS:
+    state.registers = loadRegisters(control, REGISTERS_IN);
+    publish(<Status> Atomics.load(control, Control.STATUS));
+    break;
+
+  case Command.INVALIDATE:
+    w86.w86CpuInvalidate(state);
+    break;
+
+  case Command.SNAPSHOT:
+    w86.w86SnapshotTake(state, snapshot);
+    break;
+
+  case Command.RESTORE:
+    Atomics.store(control, Control.RUNNING, 0);
+    Atomics.store(control, Control.HALTED, 0);
+    w86.w86SnapshotRestore(state, snapshot); // the timer and the interrupt controller come back with it
+    publish(Status.SUCCESS);
+    break;
+
+  case Command.STEP_BACK:
+    Atomics.store(control, Control.RUNNING, 0);
+    Atomics.store(control, Control.HALTED, 0);
+    w86.w86HistoryStepBack(state); // does nothing at the start of what's still recorded
+    publish(Status.SUCCESS);
+    break;
+
+  case Command.PROFILE_OFF:
+    w86.w86ProfileStop(state);
+    break;
+
+  case Command.PROFILE_SAMPLED:
+    w86.w86ProfileStart(state, profile, profileInterval);
+    break;
+
+  case Command.PROFILE_EXACT:
+    w86.w86ProfileStart(state, profile, 0);
+    break;
+
+  case Command.PROFILE_CLEAR:
+    w86.w86ProfileClear(profile);
+    break;
+
+  case Command.PROFILE_EXPORT:
+    postMessage({ folded: w86.w86ProfileFolded(profile) } satisfies ProfileExport);
+    break;
+
+  case Command.DEBUG_REFRESH:
+    w86.w86DebugRefresh(state);
+    break;
+
+  case Command.SET_CLOCK:
+    clock = Atomics.load(control, Control.CLOCK);
+    deadline = performance.now();
+  }
+}
+
+// everything the page sent since the last call, in order
+function drain(): void {
+  let tail: number = Atomics.load(control, Control.TAIL);
+  while (tail !== Atomics.load(control, Control.HEAD)) {
+    execute(<Command> Atomics.load(control, Control.RING + tail % RING_SIZE));
+    polling = false; // any command might be the one that changed the port
+    Atomics.store(control, Control.TAIL, ++tail);
+  }
+}
+
+publish(Status.SUCCESS);
+postMessage({
+  heap: <SharedArrayBuffer> w86.HEAPU8.buffer,
+  control: <SharedArrayBuffer> control.buffer,
+  memory: state.memory,
+  reads: state.io.reads,
+  writes: state.io.writes,
+  dirty: state.dirty,
+  profile: {
+    counts: w86.w86ProfileCounts(profile).byteOffset,
+    opcodes: w86.w86ProfileOpcodes(profile).byteOffset
+  },
+  debug: {
+    breakpoints: w86.w86DebugBreakpoints(debug).byteOffset,
+    reads: w86.w86DebugReads(debug).byteOffset,
+    writes: w86.w86DebugWrites(debug).byteOffset
+  }
+} satisfies WorkerReady);
+
+while (true) {
+  const wake: number = Atomics.load(control, Control.WAKE);
+  drain();
+  if (!Atomics.load(control, Control.RUNNING) || Atomics.load(control, Control.HALTED) || polling) {
+    Atomics.wait(control, Control.WAKE, wake);
+  } else if (!clock) {
+    publish(w86.w86CpuRun(state, batchSize).status.value);
+  } else if (performance.now() < deadline) {
+    Atomics.wait(control, Control.WAKE, wake, deadline - performance.now()); // a command cuts it short
+  } else {
+    // a frame's worth of cycles, then sleep until the next one is due
+    publish(w86.w86CpuRunCycles(state, Math.round(clock * frameTime / 1000)).status.value);
+    deadline = Math.max(deadline, performance.now() - maxLag) + frameTime;
+  }
+}